@@ -0,0 +1,114 @@
+/**
+ * @file arena.c
+ * @brief Chunked bump-pointer arena for harvested word storage
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+
+/** Rounds n up to a multiple of the power of two a */
+#define ALIGN_UP(n, a) (((n) + (a) - 1) & ~((size_t)(a) - 1))
+
+/**
+ * Maps a new chunk with room for at least size bytes
+ * and makes it the current one.
+ *
+ * @param a  pointer to arena
+ * @param size  minimum number of free bytes needed
+ */
+static void new_chunk(arena *a, size_t size);
+
+void arena_init(arena *a)
+{
+	memset(a, 0, sizeof(*a));
+	a->next_size = ARENA_MIN_CHUNK;
+}
+
+static void new_chunk(arena *a, size_t size)
+{
+	size_t n = a->next_size;
+	arena_chunk *c;
+
+	while (n < size + sizeof(arena_chunk))
+		n <<= 1;
+	c = mmap(NULL, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (c == MAP_FAILED) {
+		perror("can't allocate arena chunk");
+		exit(1);
+	}
+	c->size = n;
+	c->next = a->head;
+	a->head = c;
+	a->cur = (char *)(c + 1);
+	a->end = (char *)c + n;
+	if (a->next_size < ARENA_MAX_CHUNK)
+		a->next_size <<= 1;
+}
+
+void* arena_alloc(arena *a, size_t size)
+{
+	char *p = (char *)ALIGN_UP((uintptr_t)a->cur, 8);
+
+	if (a->cur == NULL || (size_t)(a->end - p) < size) {
+		new_chunk(a, size);
+		p = a->cur;	/* chunk data is page aligned past the header */
+	}
+	a->used += size + (size_t)(p - a->cur);
+	a->cur = p + size;
+	return p;
+}
+
+char* arena_strdup(arena *a, const char *s, size_t len)
+{
+	/* length prefix + chars + '\0', keeping prefixes 4 byte aligned */
+	size_t size = ALIGN_UP(sizeof(uint32_t) + len + 1, sizeof(uint32_t));
+	char *p;
+
+	if ((size_t)(a->end - a->cur) < size)
+		new_chunk(a, size);
+	p = a->cur;
+	a->cur += size;
+	a->used += size;
+	*(uint32_t *)(void *)p = (uint32_t)len;
+	p += sizeof(uint32_t);
+	memcpy(p, s, len);
+	p[len] = '\0';
+	return p;
+}
+
+char* arena_strdup_count(arena *a, const char *s, size_t len)
+{
+	/* counter + length prefix + chars + '\0' */
+	size_t size = ALIGN_UP(2 * sizeof(uint32_t) + len + 1, sizeof(uint32_t));
+	char *p;
+
+	if ((size_t)(a->end - a->cur) < size)
+		new_chunk(a, size);
+	p = a->cur;
+	a->cur += size;
+	a->used += size;
+	((uint32_t *)(void *)p)[0] = 1;
+	((uint32_t *)(void *)p)[1] = (uint32_t)len;
+	p += 2 * sizeof(uint32_t);
+	memcpy(p, s, len);
+	p[len] = '\0';
+	return p;
+}
+
+void arena_free(arena *a)
+{
+	arena_chunk *cur = a->head, *nxt;
+
+	while (cur != NULL) {
+		nxt = cur->next;
+		munmap(cur, cur->size);
+		cur = nxt;
+	}
+	arena_init(a);
+}
@@ -0,0 +1,96 @@
+/**
+ * @file arena.h
+ * @brief Chunked bump-pointer arena for harvested word storage
+ *
+ * All the bytes of the unique words are appended to large chunks obtained
+ * with mmap, so a new word costs a pointer bump instead of malloc calls and
+ * releasing the whole set is a handful of munmap calls. Strings are stored
+ * length-prefixed (32 bit length right before the first char) and
+ * NUL-terminated, so they can still be used as C strings.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Size of the first chunk, next ones double up to ARENA_MAX_CHUNK */
+#define ARENA_MIN_CHUNK (1UL << 20)
+#define ARENA_MAX_CHUNK (64UL << 20)
+
+/** Length of a string allocated with arena_strdup */
+#define ARENA_LEN(s) (((const uint32_t *)(const void *)(s))[-1])
+
+/** Counter of a string allocated with arena_strdup_count (lvalue) */
+#define ARENA_COUNT(s) (((uint32_t *)(void *)(s))[-2])
+
+/**
+ * @brief Struct for arena chunk header (chunk data follows it).
+ */
+typedef struct _arena_chunk {
+	struct _arena_chunk *next;
+	size_t size;	/* mapped size, header included */
+} arena_chunk;
+
+/**
+ * @brief Struct for the arena.
+ */
+typedef struct _arena {
+	arena_chunk *head;	/* most recent chunk */
+	char *cur;	/* next free byte in head chunk */
+	char *end;	/* end of head chunk */
+	size_t next_size;	/* size of the next chunk to map */
+	size_t used;	/* bytes handed out */
+} arena;
+
+/**
+ * Initializes an empty arena (no memory is mapped until first use).
+ *
+ * @param a  pointer to arena
+ */
+void arena_init(arena *a);
+
+/**
+ * Allocates size bytes, aligned to 8 bytes.
+ *
+ * @param a  pointer to arena
+ * @param size  number of bytes
+ *
+ * @return pointer to allocated memory
+ */
+void* arena_alloc(arena *a, size_t size);
+
+/**
+ * Copies the string to the arena, length-prefixed and NUL-terminated.
+ *
+ * @param a  pointer to arena
+ * @param s  string to be copied (needs not be NUL-terminated)
+ * @param len  string length
+ *
+ * @return pointer to the copy, ARENA_LEN() gives its length
+ */
+char* arena_strdup(arena *a, const char *s, size_t len);
+
+/**
+ * Copies the string to the arena like arena_strdup, with a 32 bit
+ * counter (set to 1) before the length prefix.
+ *
+ * @param a  pointer to arena
+ * @param s  string to be copied (needs not be NUL-terminated)
+ * @param len  string length
+ *
+ * @return pointer to the copy, ARENA_COUNT() gives its counter
+ */
+char* arena_strdup_count(arena *a, const char *s, size_t len);
+
+/**
+ * Unmaps all arena chunks, leaving the arena empty.
+ *
+ * @param a  pointer to arena
+ */
+void arena_free(arena *a);
+
+#endif
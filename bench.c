@@ -0,0 +1,815 @@
+/**
+ * @file bench.c
+ * @brief Benchmarks of the harvesting stages and of the password testing kernels
+ *
+ * The program generates a reproducible synthetic corpus (make bench): a tree of
+ * text files whose words are drawn from a random vocabulary with a Zipf
+ * distribution (word of rank k drawn with a probability proportional to
+ * 1/k^skew), all of them from a seeded generator, so the same options always
+ * give the same corpus (in the subdirectory corpus of the directory given). A
+ * stamp of the options is kept next to it, and the corpus is only generated again
+ * when they change. A ZipCrypto encrypted ZIP file whose password is no word of
+ * the corpus is written next to it too, so bruteforce can be run on the whole
+ * dictionary harvested.
+ * The stages of wordharvest are then measured apart, on the page cache:
+ * walking the tree (see walker.h), reading the files, tokenizing and hashing
+ * the words (see tokenizer.h), inserting them in the set of unique words (see
+ * hashset.h) and writing the unique words (see writer.h). Microbenchmarks follow
+ * for the word hash function (see hash.h) by word length, and for the ZipCrypto
+ * kernels (see zipcrypto.h): candidates tested one by one, in SIMD groups, and
+ * with the keys of the shared prefixes reused, in the order of the vocabulary
+ * and sorted. With the option -g, the corpus is only generated (e.g. to train
+ * the profile of make pgo).
+ * Implemented to be used in linux systems.
+ *
+ * @author Victor C. Leal
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <ftw.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#include "hash.h"
+#include "hashset.h"
+#include "tokenizer.h"
+#include "walker.h"
+#include "writer.h"
+#include "zipfile.h"
+#include "zipcrypto.h"
+#include "stats.h"
+
+/** Files per subdirectory of the corpus */
+#define BENCH_DIR_FILES 16
+
+/** Password of the ZIP file of the corpus (never harvested, '-' is a separator) */
+#define BENCH_PASSWORD "bench-password"
+
+/** Hashes computed for each word length */
+#define BENCH_HASHES (1UL << 22)
+
+/** Candidates tested by each ZipCrypto kernel */
+#define BENCH_CANDIDATES (1UL << 20)
+
+/** Candidates handed to the group kernels at once */
+#define BENCH_GROUP 256
+
+/**
+ * @brief Struct for the corpus options.
+ */
+typedef struct _corpus_opts {
+	char *dir;	/* corpus directory */
+	size_t files;	/* number of files */
+	size_t size;	/* size of each file */
+	size_t vocab;	/* number of words of the vocabulary */
+	double skew;	/* Zipf exponent (0 for uniform) */
+	uint64_t seed;	/* seed of the generator */
+} corpus_opts;
+
+/**
+ * @brief Struct for a file of the corpus, mapped while measured.
+ */
+typedef struct _bench_file {
+	char *path;
+	char *map;
+	size_t size;
+} bench_file;
+
+/**
+ * @brief Struct for the files found by the walk.
+ */
+typedef struct _file_list {
+	bench_file *files;
+	size_t n, cap;
+} file_list;
+
+/**
+ * @brief Struct for a word of a file, hashed by the tokenizer.
+ */
+typedef struct _bench_token {
+	const char *word;
+	size_t len;
+	uint64_t hash;
+} bench_token;
+
+/**
+ * @brief Struct for the words tokenized (tokenizer callback context).
+ */
+typedef struct _token_list {
+	bench_token *tokens;	/* NULL to only count the words */
+	size_t n, cap;
+	uint64_t sum;	/* hashes added up, so no hash is optimized out */
+} token_list;
+
+/**
+ * Next number of the generator (splitmix64).
+ *
+ * @param state  pointer to generator state
+ *
+ * @return pseudorandom 64 bit number
+ */
+static inline uint64_t next_random(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * Generates the vocabulary: words of 2 to 12 lower case letters,
+ * some of them ending with digits.
+ *
+ * @param n  number of words
+ * @param state  pointer to generator state
+ *
+ * @return array of n strings
+ */
+char** make_vocabulary(size_t n, uint64_t *state);
+
+/**
+ * Builds the cumulative Zipf distribution of the ranks of the vocabulary.
+ *
+ * @param n  number of words
+ * @param skew  Zipf exponent
+ *
+ * @return array of n cumulative probabilities (the last one is 1)
+ */
+double* make_zipf(size_t n, double skew);
+
+/**
+ * Draws the rank of a word from the cumulative distribution.
+ *
+ * @param cdf  cumulative probabilities
+ * @param n  number of words
+ * @param state  pointer to generator state
+ *
+ * @return rank of the word
+ */
+size_t draw_word(const double *cdf, size_t n, uint64_t *state);
+
+/**
+ * Appends a little-endian field to a buffer.
+ *
+ * @return pointer past the field
+ */
+static unsigned char* put_le(unsigned char *p, uint32_t v, int bytes);
+
+/**
+ * Writes a ZipCrypto encrypted ZIP file with one stored entry. Exits on error.
+ *
+ * @param path  string with ZIP file name
+ * @param password  string with password
+ * @param data  entry content
+ * @param len  content length
+ * @param state  pointer to generator state (encryption header)
+ */
+void write_zip(const char *path, const char *password, const char *data, size_t len, uint64_t *state);
+
+/**
+ * Removes a file or an empty directory of a previous corpus (nftw callback).
+ */
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw);
+
+/**
+ * Generates the corpus and its ZIP file, unless the directory already has
+ * the corpus of the same options. Exits on error.
+ *
+ * @param co  pointer to corpus options
+ * @param vocab  vocabulary
+ * @param state  pointer to generator state (after the vocabulary)
+ */
+void make_corpus(const corpus_opts *co, char **vocab, uint64_t *state);
+
+/**
+ * Walk callback appending each file found to the list.
+ */
+int add_file(char *path, void *ctx);
+
+/**
+ * Tokenizer callback counting the words, and keeping them if the
+ * list is to be filled.
+ */
+void add_token(const char *word, size_t len, uint64_t hash, void *ctx);
+
+/**
+ * Prints the time of a stage and its rates (and its bytes per second, if any).
+ */
+static void print_stage(const char *name, double elapsed, double n, const char *unit, double bytes);
+
+/**
+ * Measures the stages of the harvest on the corpus files.
+ *
+ * @param dir  string with directory of the corpus
+ */
+void bench_stages(const char *dir);
+
+/**
+ * Measures the hash function on words of several lengths.
+ *
+ * @param state  pointer to generator state
+ */
+void bench_hash(uint64_t *state);
+
+/**
+ * Compares two candidates, for sorting.
+ */
+static int cmp_cand(const void *a, const void *b);
+
+/**
+ * Measures the ZipCrypto kernels on the ZIP file of the corpus.
+ *
+ * @param dir  string with corpus directory
+ * @param vocab  vocabulary (the candidates)
+ * @param n  number of words of the vocabulary
+ */
+void bench_zipcrypto(const char *dir, char **vocab, size_t n);
+
+/**
+ * Parses a size in bytes, with an optional K, M or G suffix.
+ *
+ * @param str  string with size
+ *
+ * @return size in bytes, 0 if invalid
+ */
+size_t parse_size(const char *str);
+
+/**
+ * Prints program help message with proper usage options
+ */
+void usage(void);
+
+char** make_vocabulary(size_t n, uint64_t *state)
+{
+	char **vocab = malloc(n * sizeof(char *));
+	size_t len, digits;
+	uint64_t r;
+
+	if (!vocab) {
+		perror("can't allocate vocabulary");
+		exit(1);
+	}
+	for (size_t i = 0; i < n; i++) {
+		r = next_random(state);
+		len = 2 + r % 11;
+		/* one word in eight ends with 1 to 4 digits */
+		digits = (r >> 8) % 8 == 0 ? 1 + (r >> 16) % 4 : 0;
+		if (!(vocab[i] = malloc(len + digits + 1))) {
+			perror("can't allocate vocabulary");
+			exit(1);
+		}
+		for (size_t k = 0; k < len; k++)
+			vocab[i][k] = 'a' + next_random(state) % 26;
+		for (size_t k = 0; k < digits; k++)
+			vocab[i][len + k] = '0' + next_random(state) % 10;
+		vocab[i][len + digits] = '\0';
+	}
+	return vocab;
+}
+
+double* make_zipf(size_t n, double skew)
+{
+	double *cdf = malloc(n * sizeof(double)), sum = 0;
+
+	if (!cdf) {
+		perror("can't allocate distribution");
+		exit(1);
+	}
+	for (size_t k = 0; k < n; k++)
+		cdf[k] = sum += 1 / pow(k + 1, skew);
+	for (size_t k = 0; k < n; k++)
+		cdf[k] /= sum;
+	cdf[n - 1] = 1;
+	return cdf;
+}
+
+size_t draw_word(const double *cdf, size_t n, uint64_t *state)
+{
+	double u = (next_random(state) >> 11) * 0x1p-53;
+	size_t lo = 0, hi = n - 1, mid;
+
+	/* first rank whose cumulative probability reaches u */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (cdf[mid] < u)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static unsigned char* put_le(unsigned char *p, uint32_t v, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+		*p++ = v >> (8 * i);
+	return p;
+}
+
+void write_zip(const char *path, const char *password, const char *data, size_t len, uint64_t *state)
+{
+	static const char name[] = "corpus.txt";
+	size_t nlen = sizeof(name) - 1, csize = ZIP_HEADER_SIZE + len;
+	uint32_t crc = crc32(0, (const unsigned char *)data, len);
+	unsigned char local[30], central[46], end[22], *enc = malloc(csize), *p, c;
+	uint32_t t;
+	zc_keys k;
+	FILE *f;
+
+	if (!enc) {
+		perror("can't allocate ZIP file");
+		exit(1);
+	}
+	/* random header, its last byte the check byte (high byte of the CRC) */
+	for (size_t i = 0; i < ZIP_HEADER_SIZE; i++)
+		enc[i] = next_random(state);
+	enc[ZIP_HEADER_SIZE - 1] = crc >> 24;
+	memcpy(enc + ZIP_HEADER_SIZE, data, len);
+	zc_init_keys(&k, password, strlen(password));
+	for (size_t i = 0; i < csize; i++) {
+		t = (k.k2 | 2) & 0xffff;
+		c = enc[i];
+		enc[i] ^= (t * (t ^ 1)) >> 8;
+		zc_update(&k, c);
+	}
+	/* local header: version, flags (encrypted), method (stored), time, date,
+	   crc, sizes, name length, extra length */
+	p = put_le(local, 0x04034b50, 4);
+	p = put_le(p, 20, 2);
+	p = put_le(p, 1, 2);
+	p = put_le(p, ZIP_STORED, 2);
+	p = put_le(p, 0, 4);
+	p = put_le(p, crc, 4);
+	p = put_le(p, csize, 4);
+	p = put_le(p, len, 4);
+	p = put_le(p, nlen, 2);
+	put_le(p, 0, 2);
+	/* central header: the same fields, comment, disk, attributes, offset */
+	p = put_le(central, 0x02014b50, 4);
+	p = put_le(p, 20, 2);
+	memcpy(p, local + 4, 26);
+	p = put_le(p + 26, 0, 2);
+	p = put_le(p, 0, 2);
+	p = put_le(p, 0, 2);
+	p = put_le(p, 0, 4);
+	put_le(p, 0, 4);
+	/* end of central directory: disks, entries, size and offset of the directory */
+	p = put_le(end, 0x06054b50, 4);
+	p = put_le(p, 0, 4);
+	p = put_le(p, 1, 2);
+	p = put_le(p, 1, 2);
+	p = put_le(p, sizeof(central) + nlen, 4);
+	p = put_le(p, sizeof(local) + nlen + csize, 4);
+	put_le(p, 0, 2);
+	if (!(f = fopen(path, "wb")) ||
+	    fwrite(local, sizeof(local), 1, f) != 1 || fwrite(name, nlen, 1, f) != 1 ||
+	    fwrite(enc, csize, 1, f) != 1 ||
+	    fwrite(central, sizeof(central), 1, f) != 1 || fwrite(name, nlen, 1, f) != 1 ||
+	    fwrite(end, sizeof(end), 1, f) != 1 || fclose(f) != 0) {
+		perror("can't write ZIP file");
+		exit(1);
+	}
+	free(enc);
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	(void)st, (void)flag, (void)ftw;
+	return remove(path);
+}
+
+void make_corpus(const corpus_opts *co, char **vocab, uint64_t *state)
+{
+	char *path = malloc(strlen(co->dir) + 64), *buf = malloc(co->size + 64), params[256], old[256];
+	double *cdf = make_zipf(co->vocab, co->skew), start = stats_clock();
+	size_t len, w, line = 0;
+	FILE *f;
+
+	if (!path || !buf) {
+		perror("can't allocate corpus buffer");
+		exit(1);
+	}
+	snprintf(params, sizeof(params), "files %zu size %zu vocabulary %zu skew %g seed %llu\n",
+	         co->files, co->size, co->vocab, co->skew, (unsigned long long)co->seed);
+	sprintf(path, "%s/corpus.params", co->dir);
+	/* the same options generate the same corpus */
+	if ((f = fopen(path, "r"))) {
+		len = fread(old, 1, sizeof(old) - 1, f);
+		old[len] = '\0';
+		fclose(f);
+		if (!strcmp(old, params)) {
+			printf("corpus    %zu files of %.1f MB in %s, already generated\n",
+			       co->files, co->size / 1e6, co->dir);
+			free(cdf);
+			free(path);
+			free(buf);
+			return;
+		}
+	}
+	/* files of a corpus of other options are left out */
+	sprintf(path, "%s/corpus", co->dir);
+	if ((mkdir(co->dir, 0755) < 0 && errno != EEXIST) ||
+	    (nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS) < 0 && errno != ENOENT) ||
+	    mkdir(path, 0755) < 0) {
+		perror("can't create corpus directory");
+		exit(1);
+	}
+	for (size_t i = 0; i < co->files; i++) {
+		if (i % BENCH_DIR_FILES == 0) {
+			sprintf(path, "%s/corpus/%04zu", co->dir, i / BENCH_DIR_FILES);
+			if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+				perror("can't create corpus directory");
+				exit(1);
+			}
+		}
+		/* words separated by spaces, lines of 8 to 15 words, some punctuation */
+		for (len = 0; len < co->size; ) {
+			w = draw_word(cdf, co->vocab, state);
+			len += sprintf(buf + len, "%s", vocab[w]);
+			if (line-- == 0) {
+				buf[len++] = '\n';
+				line = 8 + next_random(state) % 8;
+			}
+			else if (next_random(state) % 16 == 0)
+				len += sprintf(buf + len, ", ");
+			else
+				buf[len++] = ' ';
+		}
+		sprintf(path, "%s/corpus/%04zu/f%06zu.txt", co->dir, i / BENCH_DIR_FILES, i);
+		if (!(f = fopen(path, "w")) || fwrite(buf, co->size, 1, f) != 1 || fclose(f) != 0) {
+			perror("can't write corpus file");
+			exit(1);
+		}
+	}
+	/* the entry is the start of the last file */
+	sprintf(path, "%s/bench.zip", co->dir);
+	write_zip(path, BENCH_PASSWORD, buf, co->size < 4096 ? co->size : 4096, state);
+	sprintf(path, "%s/corpus.params", co->dir);
+	if (!(f = fopen(path, "w")) || fputs(params, f) < 0 || fclose(f) != 0) {
+		perror("can't write corpus stamp");
+		exit(1);
+	}
+	printf("corpus    %zu files of %.1f MB in %s, generated in %.1f s\n",
+	       co->files, co->size / 1e6, co->dir, stats_clock() - start);
+	free(cdf);
+	free(path);
+	free(buf);
+}
+
+int add_file(char *path, void *ctx)
+{
+	file_list *fl = ctx;
+
+	if (fl->n == fl->cap) {
+		fl->cap = fl->cap ? 2 * fl->cap : 256;
+		if (!(fl->files = realloc(fl->files, fl->cap * sizeof(bench_file)))) {
+			perror("can't allocate file list");
+			exit(1);
+		}
+	}
+	fl->files[fl->n].path = strdup(path);
+	fl->files[fl->n].map = NULL;
+	fl->files[fl->n++].size = 0;
+	return 0;
+}
+
+void add_token(const char *word, size_t len, uint64_t hash, void *ctx)
+{
+	token_list *tl = ctx;
+
+	tl->sum += hash;
+	if (tl->tokens) {
+		if (tl->n == tl->cap) {
+			tl->cap *= 2;
+			if (!(tl->tokens = realloc(tl->tokens, tl->cap * sizeof(bench_token)))) {
+				perror("can't allocate token list");
+				exit(1);
+			}
+		}
+		tl->tokens[tl->n].word = word;
+		tl->tokens[tl->n].len = len;
+		tl->tokens[tl->n].hash = hash;
+	}
+	tl->n++;
+}
+
+static void print_stage(const char *name, double elapsed, double n, const char *unit, double bytes)
+{
+	printf("%-9s %.3f s, ", name, elapsed);
+	stats_rate(stdout, n, elapsed);
+	printf(" %s/s", unit);
+	if (bytes)
+		printf(", %.1f MB/s", bytes / 1e6 / elapsed);
+}
+
+void bench_stages(const char *dir)
+{
+	ext_set es = { 0 };
+	file_list fl = { 0 };
+	token_list tl = { 0 };
+	hashset *hs = hashset_create(0);
+	char *out = malloc(strlen(dir) + sizeof("/bench.out"));
+	double t, t_insert = 0;
+	size_t bytes = 0, words, rest, probes, max, written = 0;
+	volatile unsigned char sink = 0;
+	const char *stored;
+	outbuf *ob;
+	writer *w;
+	struct stat st;
+	int fd;
+
+	if (!out) {
+		perror("can't allocate output file name");
+		exit(1);
+	}
+	/* walk */
+	sprintf(out, "%s/corpus", dir);
+	ext_set_add(&es, "txt");
+	t = stats_clock();
+	walk_tree(out, &es, add_file, &fl);
+	t = stats_clock() - t;
+	ext_set_free(&es);
+	print_stage("walk", t, fl.n, "files", 0);
+	printf(" (%zu files)\n", fl.n);
+	/* read: the files are mapped and every page touched, once cached */
+	t = stats_clock();
+	for (size_t i = 0; i < fl.n; i++) {
+		if ((fd = open(fl.files[i].path, O_RDONLY)) < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+			fprintf(stderr, "can't open file %s\n", fl.files[i].path);
+			exit(1);
+		}
+		fl.files[i].size = st.st_size;
+		fl.files[i].map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+		close(fd);
+		if (fl.files[i].map == MAP_FAILED) {
+			fprintf(stderr, "can't map file %s\n", fl.files[i].path);
+			exit(1);
+		}
+		for (size_t k = 0; k < fl.files[i].size; k += 4096)
+			sink ^= fl.files[i].map[k];
+		bytes += fl.files[i].size;
+	}
+	t = stats_clock() - t;
+	print_stage("read", t, fl.n, "files", bytes);
+	printf(" (%.1f MB)\n", bytes / 1e6);
+	/* tokenize: words found and hashed, only counted */
+	t = stats_clock();
+	for (size_t i = 0; i < fl.n; i++) {
+		rest = tokenize_block(fl.files[i].map, fl.files[i].size, add_token, &tl);
+		if (rest < fl.files[i].size)
+			tokenize_word(fl.files[i].map + rest, fl.files[i].size - rest, add_token, &tl);
+	}
+	t = stats_clock() - t;
+	words = tl.n;
+	print_stage("tokenize", t, words, "words", bytes);
+	printf(" (%zu words, %s)\n", words, tokenizer_name());
+	/* dedup: the words of each file are tokenized first, only the insertions timed */
+	tl.cap = 1 << 16;
+	if (!(tl.tokens = malloc(tl.cap * sizeof(bench_token)))) {
+		perror("can't allocate token list");
+		exit(1);
+	}
+	for (size_t i = 0; i < fl.n; i++) {
+		tl.n = 0;
+		rest = tokenize_block(fl.files[i].map, fl.files[i].size, add_token, &tl);
+		if (rest < fl.files[i].size)
+			tokenize_word(fl.files[i].map + rest, fl.files[i].size - rest, add_token, &tl);
+		t = stats_clock();
+		for (size_t k = 0; k < tl.n; k++)
+			hashset_insert_hash(hs, tl.tokens[k].hash, tl.tokens[k].word, tl.tokens[k].len, &stored);
+		t_insert += stats_clock() - t;
+	}
+	probes = hashset_probes(hs, &max);
+	print_stage("dedup", t_insert, words, "words", 0);
+	printf(" (%zu unique, load %.2f, probe length mean %.2f max %zu)\n", hs->count,
+	       (double)hs->count / (hs->mask + 1), hs->count ? (double)probes / hs->count : 0.0, max);
+	/* write: the unique words, one per line */
+	sprintf(out, "%s/bench.out", dir);
+	t = stats_clock();
+	w = writer_open(out, 0, 0, 1);
+	ob = writer_batch(w);
+	for (size_t i = 0; i <= hs->mask; i++) {
+		if (!hs->slots[i].hash)
+			continue;
+		writer_word(w, &ob, hs->slots[i].word, ARENA_LEN(hs->slots[i].word));
+		written += ARENA_LEN(hs->slots[i].word) + 1;
+	}
+	writer_put(w, ob);
+	writer_close(w);
+	t = stats_clock() - t;
+	print_stage("write", t, hs->count, "words", written);
+	printf(" (%.1f MB)\n", written / 1e6);
+	unlink(out);
+	for (size_t i = 0; i < fl.n; i++) {
+		munmap(fl.files[i].map, fl.files[i].size);
+		free(fl.files[i].path);
+	}
+	free(fl.files);
+	free(tl.tokens);
+	free(out);
+	hashset_destroy(hs);
+	(void)sink;
+}
+
+void bench_hash(uint64_t *state)
+{
+	static const size_t lens[] = { 4, 8, 12, 16, 32, 64, 128 };
+	unsigned char buf[4096 + 128];
+	uint64_t sum = 0;
+	double t;
+
+	for (size_t i = 0; i < sizeof(buf); i++)
+		buf[i] = next_random(state);
+	for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+		t = stats_clock();
+		/* the offset moves so unaligned reads are measured too */
+		for (size_t i = 0; i < BENCH_HASHES; i++)
+			sum += hash_function((const char *)buf + (i & 4095), lens[l]);
+		t = stats_clock() - t;
+		printf("hash      %3zu bytes: %.1f ns, ", lens[l], t * 1e9 / BENCH_HASHES);
+		stats_rate(stdout, BENCH_HASHES, t);
+		printf(" hashes/s, %.2f GB/s\n", BENCH_HASHES * lens[l] / t / 1e9);
+	}
+	/* keeps the hashes from being optimized out */
+	if (sum == 0)
+		printf("\n");
+}
+
+static int cmp_cand(const void *a, const void *b)
+{
+	const zc_cand *x = a, *y = b;
+	int r = memcmp(x->pw, y->pw, x->len < y->len ? x->len : y->len);
+
+	return r ? r : (x->len > y->len) - (x->len < y->len);
+}
+
+void bench_zipcrypto(const char *dir, char **vocab, size_t n)
+{
+	char *path = malloc(strlen(dir) + sizeof("/bench.zip"));
+	zc_cand *c = malloc(BENCH_CANDIDATES * sizeof(zc_cand));
+	const char *kernels[] = { "scalar", "group", "prefixed", "prefixed" };
+	zip_archive *za;
+	size_t found = 0, step;
+	double t;
+
+	if (!path || !c) {
+		perror("can't allocate candidates");
+		exit(1);
+	}
+	sprintf(path, "%s/bench.zip", dir);
+	if (!(za = zip_open(path)) || za->n == 0) {
+		fprintf(stderr, "can't read ZIP file %s\n", path);
+		exit(1);
+	}
+	/* the vocabulary repeated, in its own order (no shared prefixes) */
+	for (size_t i = 0; i < BENCH_CANDIDATES; i++) {
+		c[i].pw = vocab[i % n];
+		c[i].len = strlen(vocab[i % n]);
+	}
+	for (int k = 0; k < 4; k++) {
+		/* last run: sorted, so neighbours share prefixes */
+		if (k == 3)
+			qsort(c, BENCH_CANDIDATES, sizeof(zc_cand), cmp_cand);
+		t = stats_clock();
+		for (size_t i = 0; i < BENCH_CANDIDATES; i += step) {
+			step = BENCH_CANDIDATES - i < BENCH_GROUP ? BENCH_CANDIDATES - i : BENCH_GROUP;
+			if (k == 0) {
+				for (size_t j = 0; j < step; j++)
+					found += zc_test(za, c[i + j].pw, c[i + j].len);
+			}
+			else if (k == 1)
+				found += zc_test_many(za, c + i, step) < step;
+			else
+				found += zc_test_prefixed(za, c + i, step) < step;
+		}
+		t = stats_clock() - t;
+		printf("zipcrypto %-8s %s: ", kernels[k], k == 3 ? "sorted  " : "unsorted");
+		stats_rate(stdout, BENCH_CANDIDATES, t);
+		printf(" candidates/s (%s)\n", k ? zipcrypto_name() : "scalar");
+	}
+	if (found)
+		fprintf(stderr, "the password was found in the vocabulary\n");
+	zip_close(za);
+	free(path);
+	free(c);
+}
+
+size_t parse_size(const char *str)
+{
+	char *end;
+	unsigned long long n = strtoull(str, &end, 10);
+
+	if (end == str || str[0] == '-')
+		return 0;
+	switch (*end) {
+		case 'G': case 'g':
+			n <<= 10;
+			/* fall through */
+		case 'M': case 'm':
+			n <<= 10;
+			/* fall through */
+		case 'K': case 'k':
+			n <<= 10;
+			end++;
+			break;
+	}
+	return *end ? 0 : n;
+}
+
+void usage(void)
+{
+	fprintf(stderr, "Usage: bench [-g] [-n files] [-s size] [-v vocabulary] [-z skew] [-S seed] -d directory\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	corpus_opts co = { .files = 64, .size = 1 << 20, .vocab = 100000, .skew = 1.0, .seed = 1 };
+	uint64_t state;
+	char **vocab, *end;
+	int opt, generate = 0;
+
+	while ((opt = getopt(argc, argv, ":gd:n:s:v:z:S:")) != -1) {
+		switch (opt) {
+			case 'g':
+				generate = 1;
+				break;
+			case 'd':
+				co.dir = optarg;
+				break;
+			case 'n':
+				if ((co.files = strtoul(optarg, &end, 10)) == 0 || *end) {
+					fprintf(stderr, "option '-n' requires a positive number\n");
+					usage();
+				}
+				break;
+			case 's':
+				if (!(co.size = parse_size(optarg))) {
+					fprintf(stderr, "option '-s' requires a positive size (with K, M or G suffix)\n");
+					usage();
+				}
+				break;
+			case 'v':
+				if ((co.vocab = strtoul(optarg, &end, 10)) == 0 || *end) {
+					fprintf(stderr, "option '-v' requires a positive number\n");
+					usage();
+				}
+				break;
+			case 'z':
+				co.skew = strtod(optarg, &end);
+				if (*end || co.skew < 0) {
+					fprintf(stderr, "option '-z' requires a non negative number\n");
+					usage();
+				}
+				break;
+			case 'S':
+				co.seed = strtoull(optarg, &end, 10);
+				if (*end) {
+					fprintf(stderr, "option '-S' requires a number\n");
+					usage();
+				}
+				break;
+			case ':':
+			/* missing option argument */
+				fprintf(stderr, "option '-%c' requires an argument\n", optopt);
+				usage();
+				break;
+			case '?':
+			default:
+			/* invalid option */
+				fprintf(stderr, "option '-%c' is invalid\n", optopt);
+				usage();
+				break;
+		}
+	}
+	if (!co.dir) {
+		fprintf(stderr, "missing required option '-d'\n");
+		usage();
+	}
+	/* the CRC table also encrypts the ZIP file of the corpus */
+	zipcrypto_init();
+	state = co.seed;
+	vocab = make_vocabulary(co.vocab, &state);
+	make_corpus(&co, vocab, &state);
+	if (!generate) {
+		tokenizer_init();
+		bench_stages(co.dir);
+		bench_hash(&state);
+		bench_zipcrypto(co.dir, vocab, co.vocab);
+	}
+	for (size_t i = 0; i < co.vocab; i++)
+		free(vocab[i]);
+	free(vocab);
+	return 0;
+}
@@ -0,0 +1,760 @@
+/**
+ * @file bruteforce.c
+ * @brief Program which does a dictionary attack to find the password of a ZIP file
+ *
+ * The program reads the ZIP file passed as an option (-f) once, keeping the
+ * encryption header of its ZipCrypto encrypted entries in memory (see zipfile.h),
+ * and tests each line of the dictionary file passed as an option (-l) as the
+ * password. Wrong passwords are rejected by the encryption header check bytes,
+ * and only the few passing them are verified decrypting and inflating the entry
+ * cheapest to verify (see zipfile.h), so nothing is ever extracted to disk.
+ * The dictionary is streamed (memory mapped when it is a big regular file, read
+ * otherwise, "-" being stdin), only a bounded window of it in memory.
+ * A binary dictionary written by wordharvest (see dictfile.h) is recognized by
+ * its magic and tested straight from its length buckets.
+ * With the option -j, the dictionary is read in batches of a few thousand lines
+ * tested by a pool of threads (see crack.h), all of them stopping as soon as
+ * one finds the password.
+ * With the option -r, each candidate is mangled by every rule of a rules file
+ * (hashcat syntax subset, see rules.h) in memory by the testing threads, so the
+ * variants never need to be expanded in a dictionary on disk.
+ * With the option --checkpoint, the progress is saved periodically and when the
+ * program is interrupted (SIGINT, SIGTERM) in a checkpoint file (see checkpoint.h),
+ * and the option --restore resumes the attack it describes where it stopped.
+ * Several ZIP files can be attacked in one run (-f repeated, or more file names
+ * after the options): the dictionary is read once and each candidate tested on
+ * every archive whose password is not found yet, the keys of its password only
+ * computed once.
+ * With the option --serve, the program coordinates an attack distributed over
+ * workers connecting over TCP, started with the option --worker on each node
+ * (see dist.h): the dictionary is split in ranges handed to the workers, each
+ * one testing its ranges with its own pool of threads (-j).
+ * With the option --gpu, the candidates are tested on an OpenCL device (see
+ * gpu.h, built with make OPENCL=1), only the few passing the header checks
+ * verified on the CPU.
+ * With the option --stats, the candidates tested per second, by each testing
+ * thread too, and the peak memory are reported to stderr every few seconds and
+ * at the end (see stats.h).
+ * Implemented to be used in linux systems.
+ *
+ * @author Victor C. Leal
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "zipfile.h"
+#include "zipcrypto.h"
+#include "crack.h"
+#include "dictfile.h"
+#include "checkpoint.h"
+#include "dist.h"
+#include "stats.h"
+
+/** Regular dictionaries at least this big are memory mapped instead of read */
+#define MMAP_MIN (64 * 1024)
+
+/** Long-only command-line options */
+enum { OPT_CHECKPOINT = 256, OPT_RESTORE, OPT_SERVE, OPT_WORKER, OPT_GPU, OPT_STATS };
+
+/**
+ * @brief Struct for the --stats reports of an attack.
+ */
+typedef struct _attack_stats {
+	const uint64_t *tested;	/* candidates tested by each testing thread */
+	int threads;
+} attack_stats;
+
+/** Set by SIGINT and SIGTERM: no more batches are read */
+static volatile sig_atomic_t stop;
+
+/**
+ * Signal handler asking the dictionary readers to stop.
+ *
+ * @param sig  signal number
+ */
+void on_signal(int sig);
+
+/**
+ * Splits the mapped dictionary in batches ending at line breaks, pointing
+ * in the map (no copy), so testing starts with the first batch.
+ *
+ * @param cc  pointer to testing engine
+ * @param map  mapped dictionary
+ * @param size  dictionary size (or end of a range, at a line break)
+ * @param start  offset of the first line (from a checkpoint or a range, 0 otherwise)
+ */
+void map_batches(crack_ctx *cc, char *map, size_t size, size_t start);
+
+/**
+ * Splits each length bucket of the binary dictionary in batches of words
+ * of that length, pointing in the map (no copy).
+ *
+ * @param cc  pointer to testing engine
+ * @param df  pointer to mapped binary dictionary
+ * @param start  offset of the first word (from a checkpoint or a range, 0 otherwise)
+ * @param end  offset past the last word (dictionary size, or end of a range)
+ */
+void dict_batches(crack_ctx *cc, const dict_file *df, size_t start, size_t end);
+
+/**
+ * Reads the dictionary in batches ending at line breaks.
+ *
+ * @param cc  pointer to testing engine
+ * @param fd  dictionary file descriptor
+ * @param dictionary  string with dictionary file name
+ * @param start  offset of the first line (from a checkpoint, 0 otherwise)
+ */
+void read_batches(crack_ctx *cc, int fd, const char *dictionary, size_t start);
+
+/**
+ * Opens an archive to attack. Prints the reason to stderr on error.
+ *
+ * @param zipname  string with ZIP file name
+ *
+ * @return pointer to archive, or NULL if it can't be read or has no ZipCrypto entries
+ */
+zip_archive* open_target(const char *zipname);
+
+/**
+ * Tests the lines of the dictionary as the password of the archives,
+ * streaming it (big regular files are mapped, pipes and "-" for stdin are read).
+ *
+ * @param zas  array of archives, NULL ones are left out
+ * @param nzas  number of archives
+ * @param dictionary  string with dictionary file name
+ * @param jobs  number of testing threads
+ * @param rules  mangling rules, NULL for none
+ * @param ck  checkpoint to resume from and record the progress in, NULL for none
+ * @param gpu  device testing the candidates, NULL to test on the CPU
+ * @param passwords  array set to the password found of each archive (to be freed),
+ *                   or NULL (the entries of the NULL archives are left as they are)
+ * @param interval  seconds between the --stats reports, 0 for none
+ */
+void crack(zip_archive **zas, size_t nzas, const char *dictionary, int jobs,
+           const rule_set *rules, checkpoint *ck, gpu_ctx *gpu, char **passwords,
+           unsigned interval);
+
+/**
+ * Prints the candidates tested per second, in all and by each testing thread,
+ * for the --stats reports (see stats.h).
+ *
+ * @param f  stream written
+ * @param elapsed  seconds since the start
+ * @param final  1 for the final report
+ * @param ctx  pointer to attack stats
+ */
+void print_stats(FILE *f, double elapsed, int final, void *ctx);
+
+/**
+ * Splits the dictionary of a distributed attack in ranges ending at line breaks
+ * (or inside the length buckets of a binary dictionary). Exits on error.
+ *
+ * @param job  pointer to attack, its dictionary size and ranges set
+ */
+void split_ranges(dist_job *job);
+
+/**
+ * Runs a worker of a distributed attack, testing the ranges handed by the
+ * coordinator until the attack is over.
+ *
+ * @param addr  string with coordinator address (host:port)
+ * @param jobs  number of testing threads
+ * @param gpu  1 to test the candidates on the GPU, 0 on the CPU
+ *
+ * @return 0 on success, 1 on error
+ */
+int work(const char *addr, int jobs, int gpu);
+
+/**
+ * Prints usage of the program in stderr and exits.
+ */
+void usage(void);
+
+void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+void map_batches(crack_ctx *cc, char *map, size_t size, size_t start)
+{
+	char *nl;
+	size_t off, end;
+	batch *b;
+
+	madvise(map, size, MADV_SEQUENTIAL);
+	/* batch boundaries only depend on the previous one, so a restored
+	   attack splits the rest of the file like the interrupted one */
+	for (off = start; off < size && !crack_found(cc) && !stop; off = end) {
+		end = off + CRACK_BATCH;
+		if (end >= size)
+			end = size;
+		else if ((nl = memchr(map + end - 1, '\n', size - end + 1)))
+			end = nl - map + 1;
+		else
+			end = size;
+		b = crack_batch(cc);
+		b->data = map + off;
+		b->len = end - off;
+		b->off = off;
+		b->mapped = 1;
+		crack_submit(cc, b);
+	}
+}
+
+void dict_batches(crack_ctx *cc, const dict_file *df, size_t start, size_t end)
+{
+	const dict_bucket *bk;
+	size_t per, count, first, last;
+	batch *b;
+
+	madvise((void *)df->map, df->size, MADV_SEQUENTIAL);
+	for (uint32_t i = 0; i < df->hdr->nbuckets; i++) {
+		bk = &df->buckets[i];
+		per = CRACK_BATCH / bk->len;
+		per = per < CRACK_GROUP ? CRACK_GROUP : per;
+		/* buckets follow each other in the file, a restored attack resumes in one
+		   (and a range may start and end in one) */
+		first = 0;
+		if (start > bk->words_off)
+			first = (start - bk->words_off) / bk->len;
+		last = bk->count;
+		if (end < bk->words_off + bk->count * bk->len)
+			last = end > bk->words_off ? (end - bk->words_off) / bk->len : 0;
+		for (uint64_t k = first; k < last && !crack_found(cc) && !stop; k += count) {
+			count = last - k < per ? last - k : per;
+			b = crack_batch(cc);
+			b->data = (char *)dict_word(df, bk, k);
+			b->len = count * bk->len;
+			b->off = (const unsigned char *)b->data - df->map;
+			b->fixed = bk->len;
+			b->mapped = 1;
+			crack_submit(cc, b);
+		}
+	}
+}
+
+void read_batches(crack_ctx *cc, int fd, const char *dictionary, size_t start)
+{
+	batch *b = crack_batch(cc), *nb;
+	char *last;
+	size_t tail, pos = start;	/* offset of the batch start in the stream */
+	ssize_t r = 0;
+
+	/* skip what a previous attack tested (pipes are read up to there) */
+	if (start && lseek(fd, start, SEEK_SET) != (off_t)start) {
+		crack_reserve(b, CRACK_BATCH);
+		for (size_t left = start; left > 0 && !stop; left -= r) {
+			if ((r = read(fd, b->buf, left < b->cap ? left : b->cap)) <= 0) {
+				fprintf(stderr, "can't skip to the checkpoint in %s\n", dictionary);
+				exit(1);
+			}
+		}
+	}
+	while (!crack_found(cc) && !stop) {
+		/* a line longer than the batch grows it */
+		if (b->len == b->cap)
+			crack_reserve(b, b->cap + 1);
+		if ((r = read(fd, b->buf + b->len, b->cap - b->len)) <= 0)
+			break;
+		b->len += r;
+		if (!(last = memrchr(b->buf, '\n', b->len)))
+			continue;
+		/* the unfinished last line is carried over to the next batch */
+		nb = crack_batch(cc);
+		tail = b->buf + b->len - (last + 1);
+		crack_reserve(nb, tail > CRACK_BATCH ? tail : CRACK_BATCH);
+		memcpy(nb->buf, last + 1, tail);
+		nb->len = tail;
+		b->len -= tail;
+		b->data = b->buf;
+		b->off = pos;
+		pos += b->len;
+		crack_submit(cc, b);
+		b = nb;
+	}
+	if (r < 0 && !(errno == EINTR && stop))
+		fprintf(stderr, "can't read dictionary file %s\n", dictionary);
+	/* last line without a line break */
+	b->data = b->buf;
+	b->off = pos;
+	if (b->len)
+		crack_submit(cc, b);
+	else
+		crack_release(cc, b);
+}
+
+zip_archive* open_target(const char *zipname)
+{
+	zip_archive *za = zip_open(zipname);
+
+	if (za && za->n == 0) {
+		fprintf(stderr, "%s has no ZipCrypto encrypted entries%s\n", zipname,
+		        za->skipped ? " (AES or strong encryption is not supported)" : "");
+		zip_close(za);
+		return NULL;
+	}
+	return za;
+}
+
+void crack(zip_archive **zas, size_t nzas, const char *dictionary, int jobs,
+           const rule_set *rules, checkpoint *ck, gpu_ctx *gpu, char **passwords,
+           unsigned interval)
+{
+	int fd = strcmp(dictionary, "-") ? open(dictionary, O_RDONLY | O_CLOEXEC) : STDIN_FILENO;
+	/* with one thread, batches are tested by the reading thread */
+	crack_ctx *cc = crack_create(zas, nzas, jobs > 1 ? jobs : 0, rules);
+	char *map = MAP_FAILED, magic[sizeof(dict_header)];
+	size_t start = ck ? ck->resume : 0;
+	attack_stats as = { .threads = jobs };
+	uint64_t *tested = NULL;
+	stats *sts = NULL;
+	struct stat st;
+	dict_file df;
+
+	if (fd < 0) {
+		perror("can't open dictionary file");
+		exit(1);
+	}
+	if (ck)
+		crack_checkpoint(cc, ck);
+	if (gpu)
+		crack_gpu(cc, gpu);
+	if (interval) {
+		if (!(tested = calloc(jobs, sizeof(uint64_t)))) {
+			perror("can't allocate stats");
+			exit(1);
+		}
+		crack_count_threads(cc, tested);
+		as.tested = tested;
+		sts = stats_start(interval, print_stats, &as);
+	}
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+	    pread(fd, magic, sizeof(magic), 0) == sizeof(magic) && dict_is_binary(magic, sizeof(magic))) {
+		if (dict_open(fd, &df) < 0)
+			exit(1);
+		dict_batches(cc, &df, start, df.size);
+		crack_finish(cc, passwords);
+		dict_close(&df);
+	}
+	else {
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= MMAP_MIN)
+			map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED)
+			map_batches(cc, map, st.st_size, start);
+		else
+			read_batches(cc, fd, dictionary, start);
+		crack_finish(cc, passwords);
+		if (map != MAP_FAILED)
+			munmap(map, st.st_size);
+	}
+	if (sts)
+		stats_finish(sts);
+	free(tested);
+	if (fd != STDIN_FILENO)
+		close(fd);
+}
+
+void print_stats(FILE *f, double elapsed, int final, void *ctx)
+{
+	const attack_stats *as = ctx;
+	uint64_t total = 0;
+
+	for (int i = 0; i < as->threads; i++)
+		total += stats_get(&as->tested[i]);
+	fprintf(f, "%" PRIu64 " candidates (", total);
+	stats_rate(f, total, elapsed);
+	fprintf(f, "/s, per thread");
+	for (int i = 0; i < as->threads; i++) {
+		fputc(' ', f);
+		stats_rate(f, stats_get(&as->tested[i]), elapsed);
+	}
+	fputc(')', f);
+}
+
+void split_ranges(dist_job *job)
+{
+	int fd = open(job->dictionary, O_RDONLY | O_CLOEXEC);
+	char *map, *nl, magic[sizeof(dict_header)];
+	uint64_t off, end, per, count;
+	size_t cap;
+	struct stat st;
+	dict_file df;
+
+	if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		fprintf(stderr, "option '--serve' requires a dictionary file%s\n", fd < 0 ? " to read" : "");
+		exit(1);
+	}
+	job->dict_size = st.st_size;
+	/* ranges of text dictionaries are at least DIST_RANGE long */
+	cap = st.st_size / DIST_RANGE + 1;
+	if (pread(fd, magic, sizeof(magic), 0) == sizeof(magic) && dict_is_binary(magic, sizeof(magic))) {
+		if (dict_open(fd, &df) < 0)
+			exit(1);
+		cap = 0;
+		for (uint32_t i = 0; i < df.hdr->nbuckets; i++) {
+			per = DIST_RANGE / df.buckets[i].len ? DIST_RANGE / df.buckets[i].len : 1;
+			cap += (df.buckets[i].count + per - 1) / per;
+		}
+		if (!(job->ranges = calloc(cap, sizeof(dist_range)))) {
+			perror("can't allocate ranges");
+			exit(1);
+		}
+		for (uint32_t i = 0; i < df.hdr->nbuckets; i++) {
+			const dict_bucket *bk = &df.buckets[i];
+
+			per = DIST_RANGE / bk->len ? DIST_RANGE / bk->len : 1;
+			for (uint64_t k = 0; k < bk->count; k += count) {
+				count = bk->count - k < per ? bk->count - k : per;
+				off = bk->words_off + k * bk->len;
+				job->ranges[job->nranges++] = (dist_range){ .off = off, .end = off + count * bk->len };
+			}
+		}
+		dict_close(&df);
+		close(fd);
+		return;
+	}
+	if (!(job->ranges = calloc(cap, sizeof(dist_range)))) {
+		perror("can't allocate ranges");
+		exit(1);
+	}
+	map = st.st_size ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("can't read dictionary file");
+		exit(1);
+	}
+	/* like map_batches, ranges end at the first line break past their size */
+	for (off = 0; off < (uint64_t)st.st_size; off = end) {
+		end = off + DIST_RANGE;
+		if (end >= (uint64_t)st.st_size)
+			end = st.st_size;
+		else if ((nl = memchr(map + end - 1, '\n', st.st_size - end + 1)))
+			end = nl - map + 1;
+		else
+			end = st.st_size;
+		job->ranges[job->nranges++] = (dist_range){ .off = off, .end = end };
+	}
+	if (map)
+		munmap(map, st.st_size);
+}
+
+int work(const char *addr, int jobs, int gpu)
+{
+	dist_worker *w = dist_connect(addr, jobs, &stop);
+	zip_archive **zas, **cur;
+	char **found, *map = MAP_FAILED, magic[sizeof(dict_header)];
+	rule_set *rules = NULL;
+	gpu_ctx *dev = NULL;
+	dist_job *job;
+	crack_ctx *cc;
+	uint64_t id, off, end;
+	struct stat st;
+	dict_file df;
+	int fd, binary;
+
+	if (!w)
+		return 1;
+	job = &w->job;
+	/* the ranges are only meaningful in the same dictionary */
+	if ((fd = open(job->dictionary, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &st) < 0 ||
+	    (uint64_t)st.st_size != job->dict_size) {
+		fprintf(stderr, "dictionary file %s is not the one of the coordinator\n", job->dictionary);
+		if (fd >= 0)
+			close(fd);
+		dist_close(w);
+		return 1;
+	}
+	binary = pread(fd, magic, sizeof(magic), 0) == sizeof(magic) && dict_is_binary(magic, sizeof(magic));
+	if (binary && dict_open(fd, &df) < 0)
+		exit(1);
+	if (!binary && st.st_size && (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		perror("can't read dictionary file");
+		exit(1);
+	}
+	if (job->rules)
+		rules = rules_load(job->rules);
+	zas = calloc(job->nzip, sizeof(zip_archive *));
+	cur = calloc(job->nzip, sizeof(zip_archive *));
+	found = calloc(job->nzip, sizeof(char *));
+	if (!zas || !cur || !found) {
+		perror("can't allocate ZIP files");
+		exit(1);
+	}
+	/* archives this node can't read are left to the others */
+	for (size_t i = 0; i < job->nzip; i++)
+		zas[i] = open_target(job->zipnames[i]);
+	zipcrypto_init();
+	if (gpu && !(dev = gpu_create(zas, job->nzip))) {
+		dist_close(w);
+		return 1;
+	}
+	while (dist_next(w, &id, &off, &end)) {
+		/* archives whose password was found are left out of the next ranges */
+		for (size_t i = 0; i < job->nzip; i++)
+			cur[i] = dist_solved(w, i) ? NULL : zas[i];
+		cc = crack_create(cur, job->nzip, jobs > 1 ? jobs : 0, rules);
+		crack_count(cc, &w->tested);
+		if (dev)
+			crack_gpu(cc, dev);
+		if (binary)
+			dict_batches(cc, &df, off, end);
+		else
+			map_batches(cc, map, end, off);
+		crack_finish(cc, found);
+		for (size_t i = 0; i < job->nzip; i++) {
+			if (!found[i])
+				continue;
+			printf("The password of %s is %s\n", job->zipnames[i], found[i]);
+			dist_found(w, i, found[i]);
+			free(found[i]);
+			found[i] = NULL;
+		}
+		/* an interrupted range is handed again */
+		if (!stop)
+			dist_done(w, id);
+	}
+	if (dev)
+		gpu_free(dev);
+	for (size_t i = 0; i < job->nzip; i++)
+		if (zas[i])
+			zip_close(zas[i]);
+	if (binary)
+		dict_close(&df);
+	else if (map != MAP_FAILED)
+		munmap(map, st.st_size);
+	close(fd);
+	free(zas);
+	free(cur);
+	free(found);
+	if (rules)
+		rules_free(rules);
+	dist_close(w);
+	return 0;
+}
+
+void usage(void)
+{
+	fprintf(stderr, "Usage: bruteforce [-j threads] [-r rules] [--checkpoint file | --gpu] [--stats[=seconds]] -l dictionary -f zipfile [zipfile...]\n"
+	                "       bruteforce [-j threads] [--stats[=seconds]] --restore file\n"
+	                "       bruteforce [-r rules] --serve port -l dictionary -f zipfile [zipfile...]\n"
+	                "       bruteforce [-j threads] [--gpu] --worker host:port\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, jobs = 0, gpu = 0, interval = 0;
+	char *dictionary = NULL, *rulesname = NULL, **zipnames, **passwords;
+	char *ckname = NULL, *restore = NULL, *serve = NULL, *worker = NULL;
+	size_t nzip = 0, nfound = 0, valid = 0;
+	zip_archive **zas;
+	rule_set *rules = NULL;
+	checkpoint *ck = NULL;
+	gpu_ctx *dev = NULL;
+	struct sigaction sa = { .sa_handler = on_signal };
+	static const struct option long_opts[] = {
+		{ "checkpoint", required_argument, NULL, OPT_CHECKPOINT },
+		{ "restore", required_argument, NULL, OPT_RESTORE },
+		{ "serve", required_argument, NULL, OPT_SERVE },
+		{ "worker", required_argument, NULL, OPT_WORKER },
+		{ "gpu", no_argument, NULL, OPT_GPU },
+		{ "stats", optional_argument, NULL, OPT_STATS },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	/* at most one ZIP file per argument */
+	if (!(zipnames = calloc(argc, sizeof(char *)))) {
+		perror("can't allocate ZIP file names");
+		exit(1);
+	}
+	/* comand-line options and arguments */
+	while ((opt = getopt_long (argc, argv, ":l:f:j:r:", long_opts, NULL)) != -1) {
+		switch (opt) {
+			case 'l':
+				dictionary = optarg;
+				break;
+			case 'f':
+				zipnames[nzip++] = optarg;
+				break;
+			case 'r':
+				rulesname = optarg;
+				break;
+			case 'j':
+				jobs = atoi(optarg);
+				if (jobs < 1) {
+					fprintf(stderr, "option '-j' requires a positive number\n");
+					usage();
+				}
+				break;
+			case OPT_CHECKPOINT:
+				ckname = optarg;
+				break;
+			case OPT_RESTORE:
+				restore = optarg;
+				break;
+			case OPT_SERVE:
+				serve = optarg;
+				break;
+			case OPT_WORKER:
+				worker = optarg;
+				break;
+			case OPT_GPU:
+				gpu = 1;
+				break;
+			case OPT_STATS:
+				interval = optarg ? atoi(optarg) : STATS_INTERVAL;
+				if (interval <= 0) {
+					fprintf(stderr, "option '--stats' requires a positive number of seconds\n");
+					usage();
+				}
+				break;
+			case ':':
+			/* missing option argument */
+				fprintf(stderr, "option '-%c' requires an argument\n", optopt);
+				usage();
+				break;
+			case '?':
+			default:
+			/* invalid option */
+				fprintf(stderr, "option '-%c' is invalid\n", optopt);
+				usage();
+				break;
+		}
+	}
+	/* more ZIP files after the options */
+	if (nzip)
+		while (optind < argc)
+			zipnames[nzip++] = argv[optind++];
+	/* a worker gets the attack from the coordinator */
+	if (worker) {
+		if (dictionary || nzip || optind < argc || rulesname || ckname || restore || serve || interval) {
+			fprintf(stderr, "option '--worker' only accepts '-j' and '--gpu'\n");
+			usage();
+		}
+		free(zipnames);
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+		return work(worker, jobs ? jobs : 1, gpu);
+	}
+	/* batches still on the device would be recorded as tested, the coordinator tests none */
+	if (gpu && (ckname || restore || serve)) {
+		fprintf(stderr, "option '--gpu' can't be used with checkpoints or '--serve'\n");
+		usage();
+	}
+	if (serve && (ckname || restore)) {
+		fprintf(stderr, "option '--serve' can't be used with checkpoints\n");
+		usage();
+	}
+	/* the coordinator reports the rate of the workers */
+	if (serve && interval) {
+		fprintf(stderr, "option '--stats' can't be used with '--serve'\n");
+		usage();
+	}
+	/* a restored attack uses the options saved (the number of threads can change) */
+	if (restore) {
+		if (dictionary || nzip || optind < argc || rulesname || ckname) {
+			fprintf(stderr, "option '--restore' only accepts '-j' and '--stats'\n");
+			usage();
+		}
+		if (!(ck = ckpt_restore(restore)))
+			return 1;
+		dictionary = ck->dictionary;
+		free(zipnames);
+		zipnames = ck->zipnames;
+		nzip = ck->nzip;
+		rulesname = ck->rules;
+		if (jobs)
+			ck->jobs = jobs;
+		jobs = ck->jobs;
+	}
+	if (jobs == 0)
+		jobs = 1;
+	/* missing required options */
+	if (!dictionary || !nzip) {
+		fprintf(stderr, "missing required option '-%c'\n", dictionary ? 'f' : 'l');
+		usage();
+	}
+	zas = calloc(nzip, sizeof(zip_archive *));
+	passwords = calloc(nzip, sizeof(char *));
+	if (!zas || !passwords) {
+		perror("can't allocate ZIP files");
+		exit(1);
+	}
+	/* archives whose password a restored attack already found are left out
+	   (the ones of a distributed attack are opened by the workers) */
+	for (size_t i = 0; i < nzip && !serve; i++) {
+		if (ck && ck->passwords[i])
+			passwords[i] = strdup(ck->passwords[i]);
+		else if ((zas[i] = open_target(zipnames[i])))
+			valid++;
+	}
+	if (rulesname)
+		rules = rules_load(rulesname);
+	if (ckname)
+		ck = ckpt_create(ckname, dictionary, zipnames, nzip, rulesname, jobs);
+	/* interrupted attacks save their progress (or stop their workers) */
+	if (ck || serve) {
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+	}
+	zipcrypto_init();
+	if (gpu && valid && !(dev = gpu_create(zas, nzip)))
+		exit(1);
+	if (dev)
+		fprintf(stderr, "testing on %s\n", gpu_name(dev));
+	if (serve) {
+		dist_job job = { .dictionary = dictionary, .rules = rulesname, .zipnames = zipnames,
+		                 .nzip = nzip, .passwords = passwords };
+
+		split_ranges(&job);
+		dist_serve(serve, &job, &stop);
+		free(job.ranges);
+	}
+	else if (valid)
+		crack(zas, nzip, dictionary, jobs, rules, ck, dev, passwords, interval);
+	for (size_t i = 0; i < nzip; i++) {
+		if (passwords[i] && nzip == 1)
+			printf("The password is %s\n", passwords[i]);
+		else if (passwords[i])
+			printf("The password of %s is %s\n", zipnames[i], passwords[i]);
+		else if ((zas[i] || serve) && !stop && nzip == 1)
+			fprintf(stderr, "password not found\n");
+		else if ((zas[i] || serve) && !stop)
+			fprintf(stderr, "password of %s not found\n", zipnames[i]);
+		nfound += passwords[i] != NULL;
+	}
+	if (ck && nfound < nzip && stop) {
+		if (ckpt_save(ck) == 0)
+			fprintf(stderr, "interrupted, resume with --restore %s\n", ck->path);
+		ckpt_free(ck, 0);
+	}
+	else if (ck)
+		ckpt_free(ck, 1);
+	if (dev)
+		gpu_free(dev);
+	for (size_t i = 0; i < nzip; i++) {
+		if (zas[i])
+			zip_close(zas[i]);
+		free(passwords[i]);
+	}
+	if (!restore)
+		free(zipnames);
+	free(zas);
+	free(passwords);
+	if (rules)
+		rules_free(rules);
+	return nfound == nzip ? 0 : 1;
+}
@@ -47,7 +47,7 @@ def main():
 	# Brute force through dictionary entries
 	with open(args.dictionary, 'r') as f:
 		os.chdir(pathZip)
-		for line in f.readlines():
+		for line in f:
 			password = line.strip('\n')
 			# Test passwords
 			try:
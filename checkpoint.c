@@ -0,0 +1,328 @@
+/**
+ * @file checkpoint.c
+ * @brief Progress checkpoints of a dictionary attack, to resume it later
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "checkpoint.h"
+
+/** First line of a checkpoint file */
+#define CKPT_HEADER "bruteforce checkpoint 1"
+
+/**
+ * Allocates the checkpoint with its file names.
+ */
+static checkpoint* alloc_ckpt(const char *path);
+
+/**
+ * Appends an archive to the attack options.
+ */
+static void add_zip(checkpoint *ck, const char *zipname);
+
+/**
+ * Writes the checkpoint file (lock held).
+ */
+static int save(checkpoint *ck);
+
+/**
+ * Gets the dictionary size and modification time (nothing for "-").
+ *
+ * @return 0 on success, -1 on error
+ */
+static int dict_identity(const char *dictionary, uint64_t *size, int64_t *mtime);
+
+/**
+ * qsort comparison function for ranges, by offset.
+ */
+static int cmp_range(const void *a, const void *b);
+
+static checkpoint* alloc_ckpt(const char *path)
+{
+	checkpoint *ck = calloc(1, sizeof(checkpoint));
+	size_t len = strlen(path);
+
+	if (!ck || !(ck->path = strdup(path)) || !(ck->tmp = malloc(len + 5))) {
+		perror("can't allocate checkpoint");
+		exit(1);
+	}
+	memcpy(ck->tmp, path, len);
+	memcpy(ck->tmp + len, ".tmp", 5);
+	pthread_mutex_init(&ck->lock, NULL);
+	ck->last = time(NULL);
+	return ck;
+}
+
+static void add_zip(checkpoint *ck, const char *zipname)
+{
+	if (ck->nzip == ck->zip_cap) {
+		ck->zip_cap = ck->zip_cap ? 2 * ck->zip_cap : 8;
+		ck->zipnames = realloc(ck->zipnames, ck->zip_cap * sizeof(char *));
+		ck->passwords = realloc(ck->passwords, ck->zip_cap * sizeof(char *));
+		if (!ck->zipnames || !ck->passwords) {
+			perror("can't allocate checkpoint");
+			exit(1);
+		}
+	}
+	if (!(ck->zipnames[ck->nzip] = strdup(zipname))) {
+		perror("can't allocate checkpoint");
+		exit(1);
+	}
+	ck->passwords[ck->nzip++] = NULL;
+}
+
+static int dict_identity(const char *dictionary, uint64_t *size, int64_t *mtime)
+{
+	struct stat st;
+
+	*size = 0;
+	*mtime = 0;
+	if (strcmp(dictionary, "-") == 0)
+		return 0;
+	if (stat(dictionary, &st) < 0)
+		return -1;
+	*size = st.st_size;
+	*mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	return 0;
+}
+
+static int cmp_range(const void *a, const void *b)
+{
+	const ckpt_range *x = a, *y = b;
+
+	return (x->off > y->off) - (x->off < y->off);
+}
+
+checkpoint* ckpt_create(const char *path, const char *dictionary, char *const *zipnames,
+                        size_t nzip, const char *rules, int jobs)
+{
+	checkpoint *ck = alloc_ckpt(path);
+
+	if (!(ck->dictionary = strdup(dictionary)) || (rules && !(ck->rules = strdup(rules)))) {
+		perror("can't allocate checkpoint");
+		exit(1);
+	}
+	for (size_t i = 0; i < nzip; i++)
+		add_zip(ck, zipnames[i]);
+	ck->jobs = jobs;
+	dict_identity(dictionary, &ck->dict_size, &ck->dict_mtime);
+	return ck;
+}
+
+checkpoint* ckpt_restore(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	checkpoint *ck;
+	char *line = NULL, *val, *pw;
+	size_t cap = 0, skip_cap = 0, idx;
+	ssize_t len;
+	uint64_t size, a, b;
+	int64_t mtime;
+	int ok = 0;
+
+	if (!f) {
+		perror("can't open checkpoint file");
+		return NULL;
+	}
+	ck = alloc_ckpt(path);
+	while ((len = getline(&line, &cap, f)) >= 0) {
+		if (len > 0 && line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (!ok) {
+			if (strcmp(line, CKPT_HEADER) != 0)
+				break;
+			ok = 1;
+			continue;
+		}
+		if (!(val = strchr(line, ' ')))
+			continue;
+		*val++ = '\0';
+		if (strcmp(line, "dictionary") == 0)
+			ck->dictionary = strdup(val);
+		else if (strcmp(line, "zipfile") == 0)
+			add_zip(ck, val);
+		else if (strcmp(line, "found") == 0 && (pw = strchr(val, ' ')) &&
+		         sscanf(val, "%zu", &idx) == 1 && idx < ck->nzip && !ck->passwords[idx])
+			ck->passwords[idx] = strdup(pw + 1);
+		else if (strcmp(line, "rules") == 0)
+			ck->rules = strdup(val);
+		else if (strcmp(line, "jobs") == 0)
+			ck->jobs = atoi(val);
+		else if (strcmp(line, "dictsize") == 0)
+			sscanf(val, "%" SCNu64 " %" SCNd64, &ck->dict_size, &ck->dict_mtime);
+		else if (strcmp(line, "resume") == 0)
+			sscanf(val, "%" SCNu64, &ck->resume);
+		else if (strcmp(line, "done") == 0 && sscanf(val, "%" SCNu64 " %" SCNu64, &a, &b) == 2) {
+			if (ck->nskip == skip_cap) {
+				skip_cap = skip_cap ? 2 * skip_cap : 64;
+				if (!(ck->skip = realloc(ck->skip, skip_cap * sizeof(ckpt_range)))) {
+					perror("can't allocate checkpoint");
+					exit(1);
+				}
+			}
+			ck->skip[ck->nskip++] = (ckpt_range){ 0, a, b };
+		}
+	}
+	free(line);
+	fclose(f);
+	if (!ok || !ck->dictionary || !ck->nzip) {
+		fprintf(stderr, "invalid checkpoint file %s\n", path);
+		ckpt_free(ck, 0);
+		return NULL;
+	}
+	/* the offsets are only meaningful in the same dictionary */
+	if (dict_identity(ck->dictionary, &size, &mtime) < 0 ||
+	    size != ck->dict_size || mtime != ck->dict_mtime) {
+		fprintf(stderr, "dictionary file %s changed since the checkpoint\n", ck->dictionary);
+		ckpt_free(ck, 0);
+		return NULL;
+	}
+	if (ck->nskip)
+		qsort(ck->skip, ck->nskip, sizeof(ckpt_range), cmp_range);
+	return ck;
+}
+
+uint64_t ckpt_begin(checkpoint *ck, uint64_t off, uint64_t end, int *skip)
+{
+	size_t lo = 0, hi = ck->nskip, mid;
+	uint64_t seq;
+
+	/* last restored range starting at or before off */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (ck->skip[mid].off <= off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*skip = lo > 0 && ck->skip[lo - 1].end >= end;
+	pthread_mutex_lock(&ck->lock);
+	seq = ck->seq++;
+	pthread_mutex_unlock(&ck->lock);
+	return seq;
+}
+
+void ckpt_found(checkpoint *ck, size_t zip, const char *password)
+{
+	pthread_mutex_lock(&ck->lock);
+	if (!ck->passwords[zip] && !(ck->passwords[zip] = strdup(password))) {
+		perror("can't allocate checkpoint");
+		exit(1);
+	}
+	/* right away, a password is worth more than the progress */
+	save(ck);
+	ck->last = time(NULL);
+	pthread_mutex_unlock(&ck->lock);
+}
+
+void ckpt_done(checkpoint *ck, uint64_t seq, uint64_t off, uint64_t end)
+{
+	size_t i;
+	time_t now;
+
+	pthread_mutex_lock(&ck->lock);
+	if (seq == ck->done_seq) {
+		ck->done_seq++;
+		ck->resume = end;
+		/* batches finished early now follow the prefix */
+		for (i = 0; i < ck->npending && ck->pending[i].seq == ck->done_seq; i++) {
+			ck->done_seq++;
+			ck->resume = ck->pending[i].end;
+		}
+		if (i) {
+			ck->npending -= i;
+			memmove(ck->pending, ck->pending + i, ck->npending * sizeof(ckpt_range));
+		}
+	}
+	else {
+		if (ck->npending == ck->pending_cap) {
+			ck->pending_cap = ck->pending_cap ? 2 * ck->pending_cap : 64;
+			if (!(ck->pending = realloc(ck->pending, ck->pending_cap * sizeof(ckpt_range)))) {
+				perror("can't allocate checkpoint");
+				exit(1);
+			}
+		}
+		for (i = ck->npending; i > 0 && ck->pending[i - 1].seq > seq; i--)
+			ck->pending[i] = ck->pending[i - 1];
+		ck->pending[i] = (ckpt_range){ seq, off, end };
+		ck->npending++;
+	}
+	if ((now = time(NULL)) - ck->last >= CKPT_INTERVAL) {
+		save(ck);
+		ck->last = now;
+	}
+	pthread_mutex_unlock(&ck->lock);
+}
+
+static int save(checkpoint *ck)
+{
+	FILE *f = fopen(ck->tmp, "w");
+	int err;
+
+	if (!f) {
+		perror("can't write checkpoint file");
+		return -1;
+	}
+	fprintf(f, CKPT_HEADER "\ndictionary %s\n", ck->dictionary);
+	for (size_t i = 0; i < ck->nzip; i++)
+		fprintf(f, "zipfile %s\n", ck->zipnames[i]);
+	for (size_t i = 0; i < ck->nzip; i++)
+		if (ck->passwords[i])
+			fprintf(f, "found %zu %s\n", i, ck->passwords[i]);
+	if (ck->rules)
+		fprintf(f, "rules %s\n", ck->rules);
+	fprintf(f, "jobs %d\ndictsize %" PRIu64 " %" PRId64 "\nresume %" PRIu64 "\n",
+	        ck->jobs, ck->dict_size, ck->dict_mtime, ck->resume);
+	for (size_t i = 0; i < ck->npending; i++)
+		fprintf(f, "done %" PRIu64 " %" PRIu64 "\n", ck->pending[i].off, ck->pending[i].end);
+	/* restored ranges not reached yet are still finished */
+	for (size_t i = 0; i < ck->nskip; i++)
+		if (ck->skip[i].end > ck->resume)
+			fprintf(f, "done %" PRIu64 " %" PRIu64 "\n", ck->skip[i].off, ck->skip[i].end);
+	/* on disk before it replaces the previous one */
+	err = fflush(f) != 0 || fsync(fileno(f)) < 0;
+	err |= ferror(f) | fclose(f);
+	if (err || rename(ck->tmp, ck->path) < 0) {
+		perror("can't write checkpoint file");
+		return -1;
+	}
+	return 0;
+}
+
+int ckpt_save(checkpoint *ck)
+{
+	int ret;
+
+	pthread_mutex_lock(&ck->lock);
+	ret = save(ck);
+	ck->last = time(NULL);
+	pthread_mutex_unlock(&ck->lock);
+	return ret;
+}
+
+void ckpt_free(checkpoint *ck, int remove_file)
+{
+	if (remove_file)
+		unlink(ck->path);
+	pthread_mutex_destroy(&ck->lock);
+	free(ck->path);
+	free(ck->tmp);
+	free(ck->dictionary);
+	for (size_t i = 0; i < ck->nzip; i++) {
+		free(ck->zipnames[i]);
+		free(ck->passwords[i]);
+	}
+	free(ck->zipnames);
+	free(ck->passwords);
+	free(ck->rules);
+	free(ck->pending);
+	free(ck->skip);
+	free(ck);
+}
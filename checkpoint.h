@@ -0,0 +1,143 @@
+/**
+ * @file checkpoint.h
+ * @brief Progress checkpoints of a dictionary attack, to resume it later
+ *
+ * Every batch submitted gets a sequence number and the range of dictionary bytes
+ * it holds (offsets in the file, or in the stream when it is read). Batches are
+ * finished out of order by the testing threads, so the progress is the resume
+ * offset (end of the batches finished with no gap since the first one) plus the
+ * ranges of the batches finished past it. The checkpoint is saved every
+ * CKPT_INTERVAL seconds by the thread finishing a batch (to a temporary file
+ * renamed over the previous one), and once more when the attack is interrupted.
+ * A restored attack starts reading the dictionary at the resume offset and skips
+ * the batches inside the ranges already finished. Rules are all applied within
+ * a batch (see crack.h), so a batch is finished with every rule.
+ * An attack on several archives also records each password found (saved right
+ * away), and a restored attack leaves those archives out.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/** Seconds between checkpoints */
+#define CKPT_INTERVAL 30
+
+/**
+ * @brief Struct for a finished batch.
+ */
+typedef struct _ckpt_range {
+	uint64_t seq;	/* batch sequence number (0 for restored ranges) */
+	uint64_t off;	/* dictionary bytes [off, end) */
+	uint64_t end;
+} ckpt_range;
+
+/**
+ * @brief Struct for the checkpoint of an attack.
+ */
+typedef struct _checkpoint {
+	char *path;	/* checkpoint file */
+	char *tmp;
+	char *dictionary;	/* attack options */
+	char **zipnames;
+	char **passwords;	/* password found of each archive, or NULL */
+	size_t nzip, zip_cap;
+	char *rules;	/* NULL without rules */
+	int jobs;
+	uint64_t dict_size;	/* dictionary identity (0 for streams) */
+	int64_t dict_mtime;	/* nanoseconds */
+	pthread_mutex_t lock;
+	uint64_t seq;	/* next sequence number */
+	uint64_t done_seq;	/* batches finished with no gap since the first one */
+	uint64_t resume;	/* dictionary offset where they end */
+	ckpt_range *pending;	/* batches finished past done_seq, by sequence number */
+	size_t npending, pending_cap;
+	ckpt_range *skip;	/* ranges finished before the restore, by offset */
+	size_t nskip;
+	time_t last;	/* time of the last save */
+} checkpoint;
+
+/**
+ * Creates the checkpoint of a new attack (nothing is written yet).
+ * Exits on error.
+ *
+ * @param path  string with checkpoint file name
+ * @param dictionary  string with dictionary file name ("-" for stdin)
+ * @param zipnames  array of ZIP file names
+ * @param nzip  number of ZIP files
+ * @param rules  string with rules file name, NULL for none
+ * @param jobs  number of testing threads
+ *
+ * @return pointer to new checkpoint
+ */
+checkpoint* ckpt_create(const char *path, const char *dictionary, char *const *zipnames,
+                        size_t nzip, const char *rules, int jobs);
+
+/**
+ * Loads a saved checkpoint and checks the dictionary did not change.
+ * Prints the reason to stderr on error.
+ *
+ * @param path  string with checkpoint file name
+ *
+ * @return pointer to checkpoint, or NULL on error
+ */
+checkpoint* ckpt_restore(const char *path);
+
+/**
+ * Gives the next sequence number to a batch being submitted.
+ *
+ * @param ck  pointer to checkpoint
+ * @param off  dictionary offset of the batch
+ * @param end  dictionary offset past the batch
+ * @param skip  set to 1 if the batch was finished before the restore
+ *
+ * @return batch sequence number
+ */
+uint64_t ckpt_begin(checkpoint *ck, uint64_t off, uint64_t end, int *skip);
+
+/**
+ * Records the password found for an archive (from any thread)
+ * and saves the checkpoint.
+ *
+ * @param ck  pointer to checkpoint
+ * @param zip  index of the archive in zipnames
+ * @param password  password found
+ */
+void ckpt_found(checkpoint *ck, size_t zip, const char *password);
+
+/**
+ * Records a finished batch (from any thread), saving the checkpoint
+ * when CKPT_INTERVAL seconds passed since the last save.
+ *
+ * @param ck  pointer to checkpoint
+ * @param seq  batch sequence number
+ * @param off  dictionary offset of the batch
+ * @param end  dictionary offset past the batch
+ */
+void ckpt_done(checkpoint *ck, uint64_t seq, uint64_t off, uint64_t end);
+
+/**
+ * Writes the checkpoint file. Prints the reason to stderr on error.
+ *
+ * @param ck  pointer to checkpoint
+ *
+ * @return 0 on success, -1 on error
+ */
+int ckpt_save(checkpoint *ck);
+
+/**
+ * Deallocates the checkpoint, removing its file if asked
+ * (the attack is over).
+ *
+ * @param ck  pointer to checkpoint
+ * @param remove_file  1 to remove the checkpoint file
+ */
+void ckpt_free(checkpoint *ck, int remove_file);
+
+#endif
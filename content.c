@@ -0,0 +1,473 @@
+/**
+ * @file content.c
+ * @brief Sniffing of the files harvested, and readers of compressed files and documents
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <lzma.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "content.h"
+#include "zipfile.h"
+
+/**
+ * @brief Struct for a magic number and the kind of content it starts.
+ */
+typedef struct _magic {
+	const char *bytes;
+	size_t len;
+	int kind;
+} magic;
+
+/** Magic numbers checked (binaries without one are told by their bytes) */
+static const magic magics[] = {
+	{ "\x1f\x8b", 2, CONTENT_GZIP },
+	{ "\xfd" "7zXZ\0", 6, CONTENT_XZ },
+	{ "\x28\xb5\x2f\xfd", 4, CONTENT_ZSTD },
+	{ "PK\x03\x04", 4, CONTENT_ZIP },
+	{ "\x7f" "ELF", 4, CONTENT_BINARY },
+	{ "%PDF-", 5, CONTENT_BINARY },
+	{ "\x89PNG", 4, CONTENT_BINARY },
+	{ "\xff\xd8\xff", 3, CONTENT_BINARY },
+	{ "GIF8", 4, CONTENT_BINARY },
+	{ "7z\xbc\xaf\x27\x1c", 6, CONTENT_BINARY },
+	{ "Rar!\x1a\x07", 6, CONTENT_BINARY },
+	{ "OggS", 4, CONTENT_BINARY }
+};
+
+/** Offset of the magic number of tar archives (NUL padded headers, text members) */
+#define TAR_MAGIC 257
+
+/** Entries holding the text of the documents: OOXML (docx) and OpenDocument (odt) */
+static const char *const doc_entries[] = { "word/document.xml", "content.xml" };
+
+/** Tags separating words (paragraphs, cells, tabs, breaks), other tags can split
+    a word in runs of different formatting */
+static const char *const doc_breaks[] = {
+	"w:p", "w:tab", "w:br", "w:cr", "w:tc",
+	"text:p", "text:h", "text:s", "text:tab", "text:line-break", "table:table-cell"
+};
+
+/**
+ * @brief Struct for a reader of decompressed content.
+ */
+struct _content_reader {
+	int kind;
+	int fd;
+	int eof;	/* compressed input read up to the end */
+	int done;	/* content read up to the end */
+	int sniffed;	/* first block of content checked */
+	unsigned char *in;	/* compressed block (CONTENT_IN bytes) */
+	z_stream z;	/* gzip and deflated documents */
+	unsigned long members;	/* gzip members decompressed */
+	lzma_stream x;
+#ifdef HAVE_ZSTD
+	ZSTD_DStream *zs;
+	ZSTD_inBuffer zin;
+#endif
+	zip_archive *za;	/* document container */
+	zip_entry e;	/* document text */
+	uint64_t pos;	/* bytes of the document text consumed */
+	int in_tag;	/* inside the XML markup */
+	int in_entity;
+	int name_done;	/* tag name complete */
+	char tag[16];	/* tag name (cut) */
+	size_t tag_len;
+};
+
+/**
+ * Byte entropy of a block.
+ *
+ * @param counts  occurrences of each byte value
+ * @param n  block size
+ *
+ * @return entropy in bits per byte
+ */
+static double entropy(const size_t *counts, size_t n);
+
+/**
+ * Opens the text entry of a document container.
+ *
+ * @return 0 on success, -1 if it is not a supported document
+ */
+static int open_document(content_reader *cr, const char *path);
+
+/**
+ * Reads the next compressed block.
+ *
+ * @return number of bytes read, 0 at the end, -1 on error
+ */
+static ssize_t fill(content_reader *cr);
+
+/**
+ * Readers of each kind of content (see content_read).
+ */
+static ssize_t read_gzip(content_reader *cr, char *buf, size_t cap);
+static ssize_t read_xz(content_reader *cr, char *buf, size_t cap);
+#ifdef HAVE_ZSTD
+static ssize_t read_zstd(content_reader *cr, char *buf, size_t cap);
+#endif
+static ssize_t read_document(content_reader *cr, char *buf, size_t cap);
+
+/**
+ * Strips the XML markup of a block of document text in place, tags breaking
+ * words (see doc_breaks) and entities becoming separators. The state is kept
+ * in the reader, as markup can be cut between blocks.
+ *
+ * @return length of the text left
+ */
+static size_t strip_markup(content_reader *cr, char *buf, size_t n);
+
+static double entropy(const size_t *counts, size_t n)
+{
+	double h = 0, p;
+
+	for (int i = 0; i < 256; i++) {
+		if (counts[i]) {
+			p = (double)counts[i] / n;
+			h -= p * log2(p);
+		}
+	}
+	return h;
+}
+
+int content_sniff(const unsigned char *buf, size_t n)
+{
+	size_t counts[256] = { 0 }, ctrl = 0;
+
+	for (size_t i = 0; i < sizeof(magics) / sizeof(magics[0]); i++)
+		if (n >= magics[i].len && memcmp(buf, magics[i].bytes, magics[i].len) == 0)
+			return magics[i].kind;
+	if (n >= TAR_MAGIC + 5 && memcmp(buf + TAR_MAGIC, "ustar", 5) == 0)
+		return CONTENT_TEXT;
+	for (size_t i = 0; i < n; i++)
+		counts[buf[i]]++;
+	if (counts[0])
+		return CONTENT_BINARY;
+	/* control chars other than tab, newlines and form feed, and DEL */
+	for (int c = 1; c < 32; c++)
+		if (c != '\t' && c != '\n' && c != '\r' && c != '\f')
+			ctrl += counts[c];
+	ctrl += counts[127];
+	if (ctrl * 32 > n)
+		return CONTENT_BINARY;
+	/* too few bytes for a meaningful entropy */
+	if (n >= 512 && entropy(counts, n) > CONTENT_MAX_ENTROPY)
+		return CONTENT_BINARY;
+	return CONTENT_TEXT;
+}
+
+static int open_document(content_reader *cr, const char *path)
+{
+	size_t i;
+
+	if (!(cr->za = zip_open(path)))
+		return -1;
+	for (i = 0; i < sizeof(doc_entries) / sizeof(doc_entries[0]); i++)
+		if (zip_find(cr->za, doc_entries[i], &cr->e) == 0)
+			break;
+	/* any other ZIP file is a binary */
+	if (i == sizeof(doc_entries) / sizeof(doc_entries[0]))
+		return -1;
+	/* flag bit 0: encrypted */
+	if ((cr->e.flags & 1) || (cr->e.method != ZIP_STORED && cr->e.method != ZIP_DEFLATED)) {
+		fprintf(stderr, "%s: encrypted or unsupported document, skipped\n", path);
+		return -1;
+	}
+	if (cr->e.method == ZIP_DEFLATED && inflateInit2(&cr->z, -MAX_WBITS) != Z_OK) {
+		fprintf(stderr, "can't initialize the decompression of %s\n", path);
+		return -1;
+	}
+	/* the markup is stripped, the text is never checked */
+	cr->sniffed = 1;
+	return 0;
+}
+
+content_reader* content_open(int fd, const char *path, int kind)
+{
+	content_reader *cr = calloc(1, sizeof(content_reader));
+	lzma_stream init = LZMA_STREAM_INIT;
+	int err = 0;
+
+	if (!cr) {
+		perror("can't allocate content reader");
+		exit(1);
+	}
+	cr->kind = kind;
+	cr->fd = fd;
+	cr->x = init;
+	switch (kind) {
+		case CONTENT_ZIP:
+			if (open_document(cr, path) < 0) {
+				if (cr->za)
+					zip_close(cr->za);
+				free(cr);
+				return NULL;
+			}
+			return cr;
+		case CONTENT_GZIP:
+			/* gzip header only, concatenated members are reset one by one */
+			err = inflateInit2(&cr->z, 16 + MAX_WBITS) != Z_OK;
+			break;
+		case CONTENT_XZ:
+			err = lzma_stream_decoder(&cr->x, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK;
+			break;
+		case CONTENT_ZSTD:
+#ifdef HAVE_ZSTD
+			err = !(cr->zs = ZSTD_createDStream());
+			break;
+#else
+			fprintf(stderr, "%s: built without zstd support (make ZSTD=1)\n", path);
+			free(cr);
+			return NULL;
+#endif
+	}
+	if (err) {
+		fprintf(stderr, "can't initialize the decompression of %s\n", path);
+		free(cr);
+		return NULL;
+	}
+	if (!(cr->in = malloc(CONTENT_IN))) {
+		perror("can't allocate content reader");
+		exit(1);
+	}
+	return cr;
+}
+
+static ssize_t fill(content_reader *cr)
+{
+	ssize_t n = read(cr->fd, cr->in, CONTENT_IN);
+
+	if (n == 0)
+		cr->eof = 1;
+	return n;
+}
+
+static ssize_t read_gzip(content_reader *cr, char *buf, size_t cap)
+{
+	ssize_t n;
+	int r;
+
+	cr->z.next_out = (Bytef *)buf;
+	cr->z.avail_out = cap;
+	while (cr->z.avail_out == cap && !cr->done) {
+		if (cr->z.avail_in == 0) {
+			if ((n = fill(cr)) < 0)
+				return -1;
+			/* end of the file, even in a truncated member */
+			if (n == 0) {
+				cr->done = 1;
+				break;
+			}
+			cr->z.next_in = cr->in;
+			cr->z.avail_in = n;
+		}
+		r = inflate(&cr->z, Z_NO_FLUSH);
+		if (r == Z_STREAM_END) {
+			cr->members++;
+			inflateReset(&cr->z);
+		}
+		/* padding after the last member */
+		else if (r == Z_DATA_ERROR && cr->members && cr->z.total_out == 0)
+			cr->done = 1;
+		else if (r != Z_OK && r != Z_BUF_ERROR)
+			return -1;
+	}
+	return cap - cr->z.avail_out;
+}
+
+static ssize_t read_xz(content_reader *cr, char *buf, size_t cap)
+{
+	ssize_t n;
+	lzma_ret r;
+
+	cr->x.next_out = (uint8_t *)buf;
+	cr->x.avail_out = cap;
+	while (cr->x.avail_out == cap && !cr->done) {
+		if (cr->x.avail_in == 0 && !cr->eof) {
+			if ((n = fill(cr)) < 0)
+				return -1;
+			cr->x.next_in = cr->in;
+			cr->x.avail_in = n;
+		}
+		r = lzma_code(&cr->x, cr->eof ? LZMA_FINISH : LZMA_RUN);
+		if (r == LZMA_STREAM_END)
+			cr->done = 1;
+		else if (r != LZMA_OK)
+			return -1;
+	}
+	return cap - cr->x.avail_out;
+}
+
+#ifdef HAVE_ZSTD
+static ssize_t read_zstd(content_reader *cr, char *buf, size_t cap)
+{
+	ZSTD_outBuffer out = { buf, cap, 0 };
+	ssize_t n;
+
+	while (out.pos == 0 && !cr->done) {
+		if (cr->zin.pos == cr->zin.size) {
+			if ((n = fill(cr)) < 0)
+				return -1;
+			if (n == 0) {
+				cr->done = 1;
+				break;
+			}
+			cr->zin.src = cr->in;
+			cr->zin.size = n;
+			cr->zin.pos = 0;
+		}
+		/* concatenated frames are decompressed one after the other */
+		if (ZSTD_isError(ZSTD_decompressStream(cr->zs, &out, &cr->zin)))
+			return -1;
+	}
+	return out.pos;
+}
+#endif
+
+static ssize_t read_document(content_reader *cr, char *buf, size_t cap)
+{
+	uint64_t left;
+	size_t n;
+	int r;
+
+	do {
+		if (cr->done)
+			return 0;
+		left = cr->e.csize - cr->pos;
+		if (cr->e.method == ZIP_STORED) {
+			n = left < cap ? left : cap;
+			memcpy(buf, cr->e.data + cr->pos, n);
+			cr->pos += n;
+			cr->done = cr->pos == cr->e.csize;
+		}
+		else {
+			/* the entry is in the mapping, fed in pieces zlib can count */
+			if (cr->z.avail_in == 0 && left) {
+				cr->z.next_in = (Bytef *)cr->e.data + cr->pos;
+				cr->z.avail_in = left < UINT_MAX ? left : UINT_MAX;
+				cr->pos += cr->z.avail_in;
+			}
+			cr->z.next_out = (Bytef *)buf;
+			cr->z.avail_out = cap;
+			r = inflate(&cr->z, Z_NO_FLUSH);
+			if (r == Z_STREAM_END || (r == Z_BUF_ERROR && cr->z.avail_in == 0 && cr->pos == cr->e.csize))
+				cr->done = 1;
+			else if (r != Z_OK && r != Z_BUF_ERROR)
+				return -1;
+			n = cap - cr->z.avail_out;
+		}
+		n = strip_markup(cr, buf, n);
+	} while (n == 0);
+	return n;
+}
+
+static size_t strip_markup(content_reader *cr, char *buf, size_t n)
+{
+	size_t j = 0;
+	char c;
+
+	for (size_t i = 0; i < n; i++) {
+		c = buf[i];
+		if (cr->in_tag) {
+			if (c == '>') {
+				cr->in_tag = 0;
+				for (size_t k = 0; k < sizeof(doc_breaks) / sizeof(doc_breaks[0]); k++) {
+					if (strlen(doc_breaks[k]) == cr->tag_len &&
+					    memcmp(doc_breaks[k], cr->tag, cr->tag_len) == 0) {
+						buf[j++] = '\n';
+						break;
+					}
+				}
+			}
+			/* name of an opening or closing tag, up to its attributes */
+			else if (!cr->name_done) {
+				if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || (c == '/' && cr->tag_len))
+					cr->name_done = 1;
+				else if (c != '/' && cr->tag_len < sizeof(cr->tag))
+					cr->tag[cr->tag_len++] = c;
+			}
+		}
+		else if (cr->in_entity) {
+			if (c == ';') {
+				cr->in_entity = 0;
+				buf[j++] = ' ';
+			}
+		}
+		else if (c == '<') {
+			cr->in_tag = 1;
+			cr->name_done = 0;
+			cr->tag_len = 0;
+		}
+		else if (c == '&')
+			cr->in_entity = 1;
+		else
+			buf[j++] = c;
+	}
+	return j;
+}
+
+ssize_t content_read(content_reader *cr, char *buf, size_t cap)
+{
+	ssize_t n = 0;
+
+	switch (cr->kind) {
+		case CONTENT_GZIP:
+			n = read_gzip(cr, buf, cap);
+			break;
+		case CONTENT_XZ:
+			n = read_xz(cr, buf, cap);
+			break;
+#ifdef HAVE_ZSTD
+		case CONTENT_ZSTD:
+			n = read_zstd(cr, buf, cap);
+			break;
+#endif
+		case CONTENT_ZIP:
+			n = read_document(cr, buf, cap);
+			break;
+	}
+	/* e.g. a compressed binary */
+	if (n > 0 && !cr->sniffed) {
+		cr->sniffed = 1;
+		if (content_sniff((const unsigned char *)buf, n < CONTENT_SNIFF ? n : CONTENT_SNIFF) != CONTENT_TEXT) {
+			cr->done = 1;
+			return 0;
+		}
+	}
+	return n;
+}
+
+void content_close(content_reader *cr)
+{
+	switch (cr->kind) {
+		case CONTENT_GZIP:
+			inflateEnd(&cr->z);
+			break;
+		case CONTENT_XZ:
+			lzma_end(&cr->x);
+			break;
+#ifdef HAVE_ZSTD
+		case CONTENT_ZSTD:
+			ZSTD_freeDStream(cr->zs);
+			break;
+#endif
+		case CONTENT_ZIP:
+			if (cr->e.method == ZIP_DEFLATED)
+				inflateEnd(&cr->z);
+			zip_close(cr->za);
+			break;
+	}
+	free(cr->in);
+	free(cr);
+}
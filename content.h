@@ -0,0 +1,85 @@
+/**
+ * @file content.h
+ * @brief Sniffing of the files harvested, and readers of compressed files and documents
+ *
+ * Files are matched by extension, so the first CONTENT_SNIFF bytes of each one
+ * are checked before it is tokenized: known magic numbers tell compressed files
+ * and ZIP containers from other binaries, and the remaining ones are told from
+ * text by a NUL byte, too many control chars, or a byte entropy higher than any
+ * text (compressed or encrypted data), so they are skipped instead of flooding
+ * the dictionary with junk.
+ * Compressed files (gzip, xz, and zstd if built with make ZSTD=1) are
+ * decompressed while being read, and the text of OOXML and OpenDocument
+ * documents (docx and odt ZIP containers) is inflated from the mapped container
+ * with its XML markup stripped, so both are tokenized without temporary files.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef CONTENT_H
+#define CONTENT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/** Bytes checked at the start of each file */
+#define CONTENT_SNIFF 4096
+
+/** Highest byte entropy of text, in bits per byte (random data is close to 8) */
+#define CONTENT_MAX_ENTROPY 7.2
+
+/** Size of the compressed blocks read by the readers */
+#define CONTENT_IN (256 * 1024)
+
+/** Kinds of content told by content_sniff */
+enum { CONTENT_TEXT, CONTENT_BINARY, CONTENT_GZIP, CONTENT_XZ, CONTENT_ZSTD, CONTENT_ZIP };
+
+/**
+ * @brief Struct for a reader of decompressed content (defined in content.c).
+ */
+typedef struct _content_reader content_reader;
+
+/**
+ * Tells the kind of content of a file from its first bytes.
+ *
+ * @param buf  first bytes of the file
+ * @param n  number of bytes (up to CONTENT_SNIFF)
+ *
+ * @return kind of content (CONTENT_*)
+ */
+int content_sniff(const unsigned char *buf, size_t n);
+
+/**
+ * Opens a reader of the decompressed content of a compressed file, or of the
+ * text of a document. Prints the reason to stderr on error (a ZIP container
+ * which is not a document is left out silently).
+ *
+ * @param fd  file descriptor, at the start of the file (kept open by the caller
+ *            until content_close)
+ * @param path  string with file name
+ * @param kind  kind of content (CONTENT_GZIP to CONTENT_ZIP)
+ *
+ * @return pointer to new reader, or NULL on error
+ */
+content_reader* content_open(int fd, const char *path, int kind);
+
+/**
+ * Reads the next block of content. Content which turns out not to be text
+ * once decompressed ends right away.
+ *
+ * @param cr  pointer to reader
+ * @param buf  destination buffer
+ * @param cap  buffer size
+ *
+ * @return number of bytes read, 0 at the end, -1 on error
+ */
+ssize_t content_read(content_reader *cr, char *buf, size_t cap);
+
+/**
+ * Closes the reader and deallocates it.
+ *
+ * @param cr  pointer to reader
+ */
+void content_close(content_reader *cr);
+
+#endif
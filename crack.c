@@ -0,0 +1,411 @@
+/**
+ * @file crack.c
+ * @brief Password testing engine fed with batches of candidates
+ *
+ * @author Victor C. Leal
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "crack.h"
+
+/**
+ * Records the password of a target (the first one found if several threads do).
+ */
+static void found_password(crack_ctx *cc, crack_target *t, const zc_cand *c);
+
+/**
+ * Records a password found by the GPU backend (archive index given to crack_create).
+ */
+static void gpu_found(void *arg, size_t zip, const char *pw, size_t len);
+
+/**
+ * Tests a group of candidates on every target whose password is not found
+ * yet, recording the passwords found.
+ *
+ * @return 1 if every password is found, 0 otherwise
+ */
+static int test_group(crack_ctx *cc, const zc_cand *c, size_t n, const mangle_buf *mb);
+
+/**
+ * Tests every rule applied to each candidate of the group, the variants
+ * generated in the thread buffers, word after word.
+ *
+ * @return 1 if every password is found, 0 otherwise
+ */
+static int test_rules(crack_ctx *cc, const zc_cand *c, size_t n, mangle_buf *mb);
+
+/**
+ * Tests each line of the batch as the password (or each candidate of a fixed
+ * length batch), in the order of the dictionary, stopping as soon as any
+ * thread has found it.
+ */
+static void test_batch(crack_ctx *cc, batch *b, mangle_buf *mb);
+
+/**
+ * Allocates the buffers of a testing thread (only with rules).
+ */
+static void mangle_init(crack_ctx *cc, mangle_buf *mb, int id);
+
+/**
+ * Deallocates the buffers of a testing thread.
+ */
+static void mangle_free(mangle_buf *mb);
+
+/**
+ * Testing thread main loop.
+ */
+static void* tester(void *arg);
+
+static void found_password(crack_ctx *cc, crack_target *t, const zc_cand *c)
+{
+	pthread_mutex_lock(&cc->lock);
+	if (!t->found) {
+		t->password = strndup(c->pw, c->len);
+		__atomic_store_n(&t->found, 1, __ATOMIC_RELAXED);
+		if (cc->ck)
+			ckpt_found(cc->ck, t->id, t->password);
+		if (--cc->left == 0)
+			__atomic_store_n(&cc->found, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&cc->lock);
+}
+
+static void gpu_found(void *arg, size_t zip, const char *pw, size_t len)
+{
+	crack_ctx *cc = arg;
+	zc_cand c = { .pw = pw, .len = len };
+
+	/* archives left out of this engine are ignored */
+	for (size_t i = 0; i < cc->ntargets; i++)
+		if (cc->targets[i].id == zip)
+			found_password(cc, &cc->targets[i], &c);
+}
+
+static int test_group(crack_ctx *cc, const zc_cand *c, size_t n, const mangle_buf *mb)
+{
+	zc_prefix p;
+	zc_key_rows k;
+	crack_target *t;
+	size_t lanes, r;
+
+	if (cc->tested)
+		__atomic_add_fetch(cc->tested, n, __ATOMIC_RELAXED);
+	if (cc->thread_tested)
+		__atomic_add_fetch(&cc->thread_tested[mb->id], n, __ATOMIC_RELAXED);
+	if (cc->gpu) {
+		gpu_test(cc->gpu, c, n, gpu_found, cc);
+		return crack_found(cc);
+	}
+	/* neighbours share prefixes in sorted dictionaries and among rule variants */
+	zc_prefix_init(&p);
+	for (size_t i = 0; i < n; i += lanes) {
+		lanes = n - i < ZC_KEYS_GROUP ? n - i : ZC_KEYS_GROUP;
+		/* the keys do not depend on the archive, computed once for all */
+		zc_prefix_keys(&p, c + i, lanes, &k);
+		for (size_t j = 0; j < cc->ntargets; j++) {
+			t = &cc->targets[j];
+			if (__atomic_load_n(&t->found, __ATOMIC_RELAXED))
+				continue;
+			if ((r = zc_test_keys(t->za, &k, lanes)) < lanes)
+				found_password(cc, t, &c[i + r]);
+		}
+	}
+	return crack_found(cc);
+}
+
+static int test_rules(crack_ctx *cc, const zc_cand *c, size_t n, mangle_buf *mb)
+{
+	const rule_set *rs = cc->rules;
+	size_t k = 0, len;
+	char *out;
+
+	/* the variants of a word are adjacent, most of them keeping its prefix */
+	for (size_t i = 0; i < n; i++) {
+		for (size_t r = 0; r < rs->n; r++) {
+			out = mb->buf + k * RULE_MAX;
+			if ((len = rule_apply(&rs->rules[r], c[i].pw, c[i].len, out)) == RULE_REJECT)
+				continue;
+			mb->cand[k].pw = out;
+			mb->cand[k++].len = len;
+			if (k < CRACK_GROUP)
+				continue;
+			if (test_group(cc, mb->cand, k, mb))
+				return 1;
+			if (crack_found(cc))
+				return 0;
+			k = 0;
+		}
+	}
+	return test_group(cc, mb->cand, k, mb);
+}
+
+static void test_batch(crack_ctx *cc, batch *b, mangle_buf *mb)
+{
+	const char *p = b->data, *end = b->data + b->len, *nl;
+	size_t n = 0, step, cap = b->fixed ? b->len / b->fixed : 0;
+
+	if (cap > b->cand_cap) {
+		b->cand_cap = cap;
+		if (!(b->cand = realloc(b->cand, cap * sizeof(zc_cand)))) {
+			perror("can't allocate candidate batch");
+			exit(1);
+		}
+	}
+	if (b->fixed) {
+		for (; n < cap; n++) {
+			b->cand[n].pw = p + n * b->fixed;
+			b->cand[n].len = b->fixed;
+		}
+	}
+	else {
+		for (; p < end; p = nl + 1, n++) {
+			if (!(nl = memchr(p, '\n', end - p)))
+				nl = end;
+			if (n == b->cand_cap) {
+				b->cand_cap = b->cand_cap ? 2 * b->cand_cap : 1024;
+				if (!(b->cand = realloc(b->cand, b->cand_cap * sizeof(zc_cand)))) {
+					perror("can't allocate candidate batch");
+					exit(1);
+				}
+			}
+			/* strip the line break (also from dictionaries with CRLF lines) */
+			b->cand[n].pw = p;
+			b->cand[n].len = nl - p;
+			if (nl > p && nl[-1] == '\r')
+				b->cand[n].len--;
+		}
+	}
+	for (size_t i = 0; i < n && !crack_found(cc); i += step) {
+		step = n - i < CRACK_GROUP ? n - i : CRACK_GROUP;
+		if (cc->rules ? test_rules(cc, b->cand + i, step, mb) : test_group(cc, b->cand + i, step, mb))
+			return;
+	}
+}
+
+static void mangle_init(crack_ctx *cc, mangle_buf *mb, int id)
+{
+	memset(mb, 0, sizeof(*mb));
+	mb->cc = cc;
+	mb->id = id;
+	if (!cc->rules)
+		return;
+	mb->buf = malloc(CRACK_GROUP * RULE_MAX);
+	mb->cand = malloc(CRACK_GROUP * sizeof(zc_cand));
+	if (!mb->buf || !mb->cand) {
+		perror("can't allocate rule buffers");
+		exit(1);
+	}
+}
+
+static void mangle_free(mangle_buf *mb)
+{
+	free(mb->buf);
+	free(mb->cand);
+}
+
+static void* tester(void *arg)
+{
+	mangle_buf *mb = arg;
+	crack_ctx *cc = mb->cc;
+	unsigned spins = 0;
+	batch *b;
+
+	for (;;) {
+		if ((b = lfq_pop(cc->queue)) != NULL) {
+			test_batch(cc, b, mb);
+			crack_release(cc, b);
+			spins = 0;
+			continue;
+		}
+		/* closed: the batches pushed before closing are popped first */
+		if (__atomic_load_n(&cc->closed, __ATOMIC_ACQUIRE)) {
+			if (!(b = lfq_pop(cc->queue)))
+				break;
+			test_batch(cc, b, mb);
+			crack_release(cc, b);
+			continue;
+		}
+		lfq_backoff(&spins);
+	}
+	mangle_free(mb);
+	return NULL;
+}
+
+crack_ctx* crack_create(zip_archive *const *zas, size_t nzas, int nthreads,
+                        const rule_set *rules)
+{
+	crack_ctx *cc = calloc(1, sizeof(crack_ctx));
+
+	if (!cc || !(cc->targets = calloc(nzas ? nzas : 1, sizeof(crack_target)))) {
+		perror("can't allocate testing engine");
+		exit(1);
+	}
+	for (size_t i = 0; i < nzas; i++) {
+		if (!zas[i])
+			continue;
+		cc->targets[cc->ntargets].za = zas[i];
+		cc->targets[cc->ntargets++].id = i;
+	}
+	cc->left = cc->ntargets;
+	cc->found = cc->ntargets == 0;
+	cc->nthreads = nthreads;
+	cc->rules = rules;
+	pthread_mutex_init(&cc->lock, NULL);
+	if (nthreads == 0) {
+		mangle_init(cc, &cc->mb, 0);
+		return cc;
+	}
+	cc->queue = lfq_create(CRACK_QUEUE * nthreads);
+	cc->threads = calloc(nthreads, sizeof(pthread_t));
+	cc->mbs = calloc(nthreads, sizeof(mangle_buf));
+	if (!cc->threads || !cc->mbs) {
+		perror("can't allocate testing engine");
+		exit(1);
+	}
+	for (int i = 0; i < nthreads; i++) {
+		mangle_init(cc, &cc->mbs[i], i);
+		if (pthread_create(&cc->threads[i], NULL, tester, &cc->mbs[i]) != 0) {
+			perror("can't create testing thread");
+			exit(1);
+		}
+	}
+	return cc;
+}
+
+void crack_checkpoint(crack_ctx *cc, checkpoint *ck)
+{
+	cc->ck = ck;
+}
+
+void crack_count(crack_ctx *cc, uint64_t *tested)
+{
+	cc->tested = tested;
+}
+
+void crack_count_threads(crack_ctx *cc, uint64_t *tested)
+{
+	cc->thread_tested = tested;
+}
+
+void crack_gpu(crack_ctx *cc, gpu_ctx *g)
+{
+	cc->gpu = g;
+}
+
+batch* crack_batch(crack_ctx *cc)
+{
+	batch *b;
+
+	pthread_mutex_lock(&cc->lock);
+	if ((b = cc->pool) != NULL)
+		cc->pool = b->next;
+	pthread_mutex_unlock(&cc->lock);
+	if (!b && !(b = calloc(1, sizeof(batch)))) {
+		perror("can't allocate candidate batch");
+		exit(1);
+	}
+	return b;
+}
+
+void crack_reserve(batch *b, size_t cap)
+{
+	if (b->cap >= cap)
+		return;
+	while (b->cap < cap)
+		b->cap = b->cap ? 2 * b->cap : CRACK_BATCH;
+	if (!(b->buf = realloc(b->buf, b->cap))) {
+		perror("can't allocate candidate batch");
+		exit(1);
+	}
+}
+
+void crack_submit(crack_ctx *cc, batch *b)
+{
+	unsigned spins = 0;
+	int skip = 0;
+
+	if (crack_found(cc)) {
+		crack_release(cc, b);
+		return;
+	}
+	if (cc->ck) {
+		b->seq = ckpt_begin(cc->ck, b->off, b->off + b->len, &skip);
+		b->tracked = 1;
+		/* finished before the restore */
+		if (skip) {
+			crack_release(cc, b);
+			return;
+		}
+	}
+	if (!cc->nthreads) {
+		test_batch(cc, b, &cc->mb);
+		crack_release(cc, b);
+		return;
+	}
+	while (!lfq_push(cc->queue, b))
+		lfq_backoff(&spins);
+}
+
+void crack_release(crack_ctx *cc, batch *b)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t lo, hi;
+
+	if (b->tracked) {
+		ckpt_done(cc->ck, b->seq, b->off, b->off + b->len);
+		b->tracked = 0;
+	}
+	if (b->mapped) {
+		/* pages shared with the neighbour batches are left alone */
+		lo = ((uintptr_t)b->data + page - 1) & ~(page - 1);
+		hi = ((uintptr_t)b->data + b->len) & ~(page - 1);
+		if (lo < hi)
+			madvise((void *)lo, hi - lo, MADV_DONTNEED);
+		b->mapped = 0;
+	}
+	b->fixed = 0;
+	b->off = 0;
+	b->len = 0;
+	b->data = b->buf;
+	pthread_mutex_lock(&cc->lock);
+	b->next = cc->pool;
+	cc->pool = b;
+	pthread_mutex_unlock(&cc->lock);
+}
+
+size_t crack_finish(crack_ctx *cc, char **passwords)
+{
+	size_t found;
+	batch *nxt;
+
+	__atomic_store_n(&cc->closed, 1, __ATOMIC_RELEASE);
+	for (int i = 0; i < cc->nthreads; i++)
+		pthread_join(cc->threads[i], NULL);
+	/* the candidates still on the device */
+	if (cc->gpu)
+		gpu_flush(cc->gpu, gpu_found, cc);
+	found = cc->ntargets - cc->left;
+	for (batch *b = cc->pool; b; b = nxt) {
+		nxt = b->next;
+		free(b->buf);
+		free(b->cand);
+		free(b);
+	}
+	if (cc->queue)
+		lfq_destroy(cc->queue);
+	mangle_free(&cc->mb);
+	for (size_t i = 0; i < cc->ntargets; i++)
+		passwords[cc->targets[i].id] = cc->targets[i].password;
+	pthread_mutex_destroy(&cc->lock);
+	free(cc->targets);
+	free(cc->threads);
+	free(cc->mbs);
+	free(cc);
+	return found;
+}
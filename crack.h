@@ -0,0 +1,248 @@
+/**
+ * @file crack.h
+ * @brief Password testing engine fed with batches of candidates
+ *
+ * Candidates are grouped in batches of lines (a few thousand candidates each),
+ * filled by any producer (the dictionary reader of bruteforce, or the harvesting
+ * threads of wordharvest in pipeline mode) and handed to a pool of testing threads
+ * through a bounded lock-free queue (see lfqueue.h), producers waiting when it is
+ * full. Each batch is tested in the order of its lines, so the keys of the prefix
+ * shared by neighbour lines of sorted dictionaries are computed once (see
+ * zc_prefix_keys in zipcrypto.h), and all threads stop as soon as one finds the
+ * password. Several archives can be attacked at once: the keys of each candidate
+ * are computed once and tested on every archive whose password is not found yet,
+ * the threads stopping when all are found. With mangling rules (see rules.h), each candidate is expanded by every
+ * rule into a buffer of the testing thread, so the variants are tested in memory
+ * with no allocation, the variants of a word next to each other. With a GPU (see
+ * gpu.h), the testing threads only hand the candidates to the device, which
+ * returns the ones passing the header checks.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef CRACK_H
+#define CRACK_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "lfqueue.h"
+#include "zipfile.h"
+#include "zipcrypto.h"
+#include "rules.h"
+#include "checkpoint.h"
+#include "gpu.h"
+
+/** Size of the candidate batches (a few thousand candidates each) */
+#define CRACK_BATCH (32 * 1024)
+
+/** Candidates tested between checks of the found flag */
+#define CRACK_GROUP 256
+
+/** Batches queued per testing thread */
+#define CRACK_QUEUE 4
+
+/**
+ * @brief Struct for a batch of candidate lines.
+ */
+typedef struct _batch {
+	char *data;	/* whole lines (the last one may lack the line break) */
+	size_t len;
+	int mapped;	/* data points in a mapped file, else in buf */
+	size_t fixed;	/* length of every candidate, back to back with no line
+	                   breaks (binary dictionaries, see dictfile.h), 0 for lines */
+	char *buf;	/* batch buffer */
+	size_t cap;
+	uint64_t off;	/* dictionary offset of data (checkpoints) */
+	uint64_t seq;	/* sequence number given when submitted with a checkpoint */
+	int tracked;	/* submitted with a checkpoint, recorded when released */
+	zc_cand *cand;	/* lines of the batch */
+	size_t cand_cap;
+	struct _batch *next;
+} batch;
+
+/**
+ * @brief Struct for the buffers of a testing thread used to apply the rules.
+ */
+typedef struct _mangle_buf {
+	char *buf;	/* CRACK_GROUP candidates of RULE_MAX bytes */
+	zc_cand *cand;	/* variants of a group */
+	struct _crack_ctx *cc;	/* engine of the thread */
+	int id;	/* index of the testing thread (0 for the submitting thread) */
+} mangle_buf;
+
+/**
+ * @brief Struct for an archive attacked.
+ */
+typedef struct _crack_target {
+	const zip_archive *za;
+	size_t id;	/* index given to crack_create */
+	int found;	/* set once by the thread finding the password */
+	char *password;
+} crack_target;
+
+/**
+ * @brief Struct for the testing engine.
+ */
+typedef struct _crack_ctx {
+	crack_target *targets;
+	size_t ntargets;
+	size_t left;	/* targets whose password is not found yet */
+	int found;	/* set once every password is found, cancels the rest */
+	pthread_mutex_t lock;	/* passwords and pool */
+	batch *pool;	/* empty batches */
+	lfqueue *queue;	/* batches waiting to be tested */
+	int nthreads;
+	pthread_t *threads;
+	mangle_buf *mbs;	/* buffers of the testing threads */
+	int closed;	/* no more batches */
+	const rule_set *rules;	/* mangling rules, NULL to test the candidates as they are */
+	mangle_buf mb;	/* buffers of the submitting thread (no testing threads) */
+	checkpoint *ck;	/* progress of the attack, NULL without checkpoints */
+	uint64_t *tested;	/* candidates tested are added to it, NULL for none */
+	uint64_t *thread_tested;	/* candidates tested by each thread, NULL for none */
+	gpu_ctx *gpu;	/* device testing the candidates, NULL to test on the CPU */
+} crack_ctx;
+
+/**
+ * Creates the engine and starts the testing threads. Exits on error.
+ *
+ * @param zas  array of archives (with encrypted entries), NULL ones are left out
+ * @param nzas  number of archives
+ * @param nthreads  number of testing threads, 0 to test in the submitting thread
+ * @param rules  mangling rules applied to each candidate, NULL for none
+ *
+ * @return pointer to new engine
+ */
+crack_ctx* crack_create(zip_archive *const *zas, size_t nzas, int nthreads,
+                        const rule_set *rules);
+
+/**
+ * Records the progress of the batches submitted from now on in the
+ * checkpoint, skipping the ones it has as finished, and the passwords
+ * found (by archive index). Must be called before the first batch is
+ * submitted.
+ *
+ * @param cc  pointer to engine
+ * @param ck  pointer to checkpoint
+ */
+void crack_checkpoint(crack_ctx *cc, checkpoint *ck);
+
+/**
+ * Adds the number of candidates tested from now on (rule variants included)
+ * to a counter, atomically, so another thread can read it while testing.
+ *
+ * @param cc  pointer to engine
+ * @param tested  pointer to counter
+ */
+void crack_count(crack_ctx *cc, uint64_t *tested);
+
+/**
+ * Adds the number of candidates tested from now on by each testing thread
+ * to its entry of an array (like crack_count), to measure the threads apart.
+ * Must be called before the first batch is submitted.
+ *
+ * @param cc  pointer to engine
+ * @param tested  array of counters, one per testing thread (one entry
+ *                without testing threads)
+ */
+void crack_count_threads(crack_ctx *cc, uint64_t *tested);
+
+/**
+ * Tests the candidates on the device from now on, flushed by crack_finish.
+ * Must be called before the first batch is submitted.
+ *
+ * @param cc  pointer to engine
+ * @param g  pointer to GPU context, created with the same archives
+ */
+void crack_gpu(crack_ctx *cc, gpu_ctx *g);
+
+/**
+ * Gets an empty batch (with no buffer if new, see crack_reserve).
+ *
+ * @param cc  pointer to engine
+ *
+ * @return pointer to batch
+ */
+batch* crack_batch(crack_ctx *cc);
+
+/**
+ * Grows the batch buffer to hold at least cap bytes, keeping its contents.
+ *
+ * @param b  pointer to batch
+ * @param cap  buffer size needed
+ */
+void crack_reserve(batch *b, size_t cap);
+
+/**
+ * Queues the batch for testing, waiting while the queue is full (or tests
+ * it right away without testing threads). Dropped if the password was found,
+ * or if the checkpoint has it as finished.
+ *
+ * @param cc  pointer to engine
+ * @param b  pointer to batch
+ */
+void crack_submit(crack_ctx *cc, batch *b);
+
+/**
+ * Puts a batch back in the pool, recording it as finished in the checkpoint.
+ * The pages of a mapped batch are dropped, so only a bounded window of a
+ * mapped file is ever resident.
+ *
+ * @param cc  pointer to engine
+ * @param b  pointer to batch
+ */
+void crack_release(crack_ctx *cc, batch *b);
+
+/**
+ * Waits for the batches queued, stops the testing threads
+ * and deallocates the engine.
+ *
+ * @param cc  pointer to engine
+ * @param passwords  array with one entry per archive given to crack_create, set
+ *                   to the password found (to be freed) or NULL (the entries
+ *                   of the NULL archives are left as they are)
+ *
+ * @return number of passwords found
+ */
+size_t crack_finish(crack_ctx *cc, char **passwords);
+
+/**
+ * Checks if every password was already found.
+ *
+ * @param cc  pointer to engine
+ *
+ * @return 1 if found, 0 otherwise
+ */
+static inline int crack_found(crack_ctx *cc)
+{
+	return __atomic_load_n(&cc->found, __ATOMIC_RELAXED);
+}
+
+/**
+ * Appends a candidate and a line break to the batch, submitting it when full.
+ *
+ * @param cc  pointer to engine
+ * @param b  pointer to the caller batch
+ * @param word  candidate chars (not NUL-terminated)
+ * @param len  candidate length
+ */
+static inline void crack_word(crack_ctx *cc, batch **b, const char *word, size_t len)
+{
+	batch *o = *b;
+
+	if (o->cap - o->len < len + 1) {
+		if (o->len) {
+			crack_submit(cc, o);
+			*b = o = crack_batch(cc);
+		}
+		crack_reserve(o, len + 1 > CRACK_BATCH ? len + 1 : CRACK_BATCH);
+	}
+	memcpy(o->buf + o->len, word, len);
+	o->buf[o->len + len] = '\n';
+	o->len += len + 1;
+	o->data = o->buf;
+}
+
+#endif
@@ -0,0 +1,165 @@
+/**
+ * @file dictfile.c
+ * @brief Binary dictionary format, words grouped by length
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dictfile.h"
+#include "arena.h"
+
+/** Rounds up to the section alignment */
+#define DICT_ROUND(x) (((x) + DICT_ALIGN - 1) & ~(uint64_t)(DICT_ALIGN - 1))
+
+/**
+ * Writes zeros up to the next section boundary.
+ */
+static void pad(FILE *f, uint64_t *off);
+
+static void pad(FILE *f, uint64_t *off)
+{
+	static const char zeros[DICT_ALIGN];
+
+	fwrite(zeros, 1, DICT_ROUND(*off) - *off, f);
+	*off = DICT_ROUND(*off);
+}
+
+void dict_write(const char *path, const char *const *words, const uint32_t *freqs, size_t n)
+{
+	FILE *f = fopen(path, "w");
+	dict_header hdr = { .version = DICT_VERSION };
+	dict_bucket *buckets;
+	size_t max = 0, len, nb = 0, *start, *order;
+	uint64_t off;
+
+	if (!f) {
+		perror("can't open write file");
+		exit(1);
+	}
+	for (size_t i = 0; i < n; i++) {
+		len = ARENA_LEN(words[i]);
+		max = len > max ? len : max;
+	}
+	/* counting sort by length, stable so each bucket keeps the order received */
+	start = calloc(max + 2, sizeof(size_t));
+	order = malloc((n ? n : 1) * sizeof(size_t));
+	if (!start || !order) {
+		perror("can't allocate dictionary index");
+		exit(1);
+	}
+	for (size_t i = 0; i < n; i++)
+		start[ARENA_LEN(words[i]) + 1]++;
+	for (size_t l = 1; l <= max; l++)
+		nb += start[l + 1] != 0;
+	if (!(buckets = calloc(nb ? nb : 1, sizeof(dict_bucket)))) {
+		perror("can't allocate dictionary index");
+		exit(1);
+	}
+	/* sections: header, index, word blocks, frequency blocks */
+	off = DICT_ROUND(sizeof(dict_header) + nb * sizeof(dict_bucket));
+	nb = 0;
+	for (size_t l = 1; l <= max; l++) {
+		if (!start[l + 1])
+			continue;
+		buckets[nb].len = l;
+		buckets[nb].count = start[l + 1];
+		buckets[nb].words_off = off;
+		off = DICT_ROUND(off + (uint64_t)l * start[l + 1]);
+		nb++;
+	}
+	for (size_t b = 0; freqs && b < nb; b++) {
+		buckets[b].freq_off = off;
+		off = DICT_ROUND(off + buckets[b].count * sizeof(uint32_t));
+	}
+	for (size_t l = 1; l <= max + 1; l++)
+		start[l] += start[l - 1];
+	for (size_t i = 0; i < n; i++)
+		order[start[ARENA_LEN(words[i])]++] = i;
+
+	memcpy(hdr.magic, DICT_MAGIC, sizeof(hdr.magic));
+	hdr.flags = freqs ? DICT_FREQ : 0;
+	hdr.nwords = n;
+	hdr.nbuckets = nb;
+	hdr.index_off = sizeof(dict_header);
+	hdr.size = off;
+	fwrite(&hdr, sizeof(hdr), 1, f);
+	fwrite(buckets, sizeof(dict_bucket), nb, f);
+	off = sizeof(dict_header) + nb * sizeof(dict_bucket);
+	pad(f, &off);
+	/* buckets and order are both sorted by length */
+	for (size_t b = 0, i = 0; b < nb; b++) {
+		for (uint64_t k = 0; k < buckets[b].count; k++, i++)
+			fwrite(words[order[i]], 1, buckets[b].len, f);
+		off += (uint64_t)buckets[b].len * buckets[b].count;
+		pad(f, &off);
+	}
+	for (size_t b = 0, i = 0; freqs && b < nb; b++) {
+		for (uint64_t k = 0; k < buckets[b].count; k++, i++)
+			fwrite(&freqs[order[i]], sizeof(uint32_t), 1, f);
+		off += buckets[b].count * sizeof(uint32_t);
+		pad(f, &off);
+	}
+	if (ferror(f) | fclose(f)) {
+		perror("can't write output file");
+		exit(1);
+	}
+	free(buckets);
+	free(order);
+	free(start);
+}
+
+int dict_is_binary(const void *buf, size_t len)
+{
+	return len >= sizeof(dict_header) && memcmp(buf, DICT_MAGIC, 8) == 0;
+}
+
+int dict_open(int fd, dict_file *df)
+{
+	struct stat st;
+	const dict_bucket *b;
+
+	memset(df, 0, sizeof(*df));
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(dict_header))
+		goto invalid;
+	df->size = st.st_size;
+	df->map = mmap(NULL, df->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (df->map == MAP_FAILED) {
+		df->map = NULL;
+		goto invalid;
+	}
+	df->hdr = (const dict_header *)df->map;
+	if (!dict_is_binary(df->map, df->size) || df->hdr->version != DICT_VERSION ||
+	    df->hdr->size != df->size || df->hdr->index_off > df->size ||
+	    df->hdr->nbuckets > (df->size - df->hdr->index_off) / sizeof(dict_bucket))
+		goto invalid;
+	df->buckets = (const dict_bucket *)(df->map + df->hdr->index_off);
+	/* every block must be inside the file */
+	for (uint32_t i = 0; i < df->hdr->nbuckets; i++) {
+		b = &df->buckets[i];
+		if (!b->len || b->words_off > df->size || b->count > (df->size - b->words_off) / b->len)
+			goto invalid;
+		if ((df->hdr->flags & DICT_FREQ) &&
+		    (b->freq_off > df->size || b->count > (df->size - b->freq_off) / sizeof(uint32_t)))
+			goto invalid;
+	}
+	return 0;
+
+invalid:
+	fprintf(stderr, "invalid binary dictionary\n");
+	dict_close(df);
+	return -1;
+}
+
+void dict_close(dict_file *df)
+{
+	if (df->map)
+		munmap((void *)df->map, df->size);
+	df->map = NULL;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file dictfile.h
+ * @brief Binary dictionary format, words grouped by length
+ *
+ * Layout (little endian, every section aligned to DICT_ALIGN bytes):
+ *   header     magic, version, flags, number of words and of length buckets
+ *   index      one entry per length: word length, word count, offset of its
+ *              words block and of its frequencies (if DICT_FREQ is set)
+ *   words      per length, the words back to back with no separators, so the
+ *              word i of a block of length L starts at i * L
+ *   freqs      per length, 32 bit occurrence counts in the same order
+ * The file is meant to be memory mapped: a tester takes runs of words of exactly
+ * the same length straight from the blocks, with no line breaks to look for.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef DICTFILE_H
+#define DICTFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** File magic (8 bytes) and format version */
+#define DICT_MAGIC "WHDICT\r\n"
+#define DICT_VERSION 1
+
+/** Header flags */
+#define DICT_FREQ 0x1	/* frequency section present */
+
+/** Alignment of the sections */
+#define DICT_ALIGN 64
+
+/**
+ * @brief Struct for the file header.
+ */
+typedef struct _dict_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint64_t nwords;
+	uint32_t nbuckets;
+	uint32_t reserved;
+	uint64_t index_off;	/* offset of the bucket index */
+	uint64_t size;	/* file size */
+	uint8_t pad[16];
+} dict_header;
+
+/**
+ * @brief Struct for an index entry (one per word length present).
+ */
+typedef struct _dict_bucket {
+	uint32_t len;	/* length of every word of the bucket */
+	uint32_t reserved;
+	uint64_t count;	/* number of words */
+	uint64_t words_off;	/* offset of count * len bytes of words */
+	uint64_t freq_off;	/* offset of count 32 bit frequencies, 0 if none */
+} dict_bucket;
+
+/**
+ * @brief Struct for a mapped binary dictionary.
+ */
+typedef struct _dict_file {
+	const unsigned char *map;
+	size_t size;
+	const dict_header *hdr;
+	const dict_bucket *buckets;	/* ordered by word length */
+} dict_file;
+
+/**
+ * Writes the words in a binary dictionary, each length bucket keeping
+ * the order of the words received. Exits on error.
+ *
+ * @param path  string with output file name
+ * @param words  words (arena strings, see arena.h)
+ * @param freqs  occurrence count of each word, NULL for no frequency section
+ * @param n  number of words
+ */
+void dict_write(const char *path, const char *const *words, const uint32_t *freqs, size_t n);
+
+/**
+ * Checks for the binary dictionary magic.
+ *
+ * @param buf  first bytes of a file
+ * @param len  number of bytes
+ *
+ * @return 1 if it is a binary dictionary, 0 otherwise
+ */
+int dict_is_binary(const void *buf, size_t len);
+
+/**
+ * Maps a binary dictionary and validates its header and index.
+ * Prints the reason to stderr on error.
+ *
+ * @param fd  file descriptor of the dictionary
+ * @param df  pointer to dictionary filled on success
+ *
+ * @return 0 on success, -1 on error
+ */
+int dict_open(int fd, dict_file *df);
+
+/**
+ * Unmaps the dictionary.
+ *
+ * @param df  pointer to dictionary
+ */
+void dict_close(dict_file *df);
+
+/**
+ * Pointer to the word i of a bucket.
+ */
+static inline const char* dict_word(const dict_file *df, const dict_bucket *b, size_t i)
+{
+	return (const char *)df->map + b->words_off + i * b->len;
+}
+
+#endif
@@ -0,0 +1,596 @@
+/**
+ * @file dist.c
+ * @brief Distributed dictionary attack: a coordinator handing ranges to workers
+ *
+ * @author Victor C. Leal
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "dist.h"
+
+/**
+ * @brief Struct for a worker connected to the coordinator.
+ */
+typedef struct _dist_conn {
+	int fd;	/* -1 once lost */
+	int id;	/* connection number, in the ranges assigned */
+	int threads;
+	time_t seen;	/* time of the last line received */
+	uint64_t tested;	/* candidates tested, as last reported */
+	char buf[DIST_LINE];	/* bytes received */
+	size_t len;
+} dist_conn;
+
+/**
+ * @brief Struct for the state of the coordinator.
+ */
+typedef struct _dist_server {
+	dist_job *job;
+	dist_conn *conns;
+	size_t nconns, conns_cap;
+	int next_id;
+	size_t todo;	/* no range before it is to be tested */
+	size_t done;	/* ranges tested */
+	size_t found;	/* passwords found */
+	uint64_t lost_tested;	/* candidates tested by the workers lost */
+} dist_server;
+
+/**
+ * Formats a line and sends it whole.
+ *
+ * @return 0 on success, -1 on error
+ */
+static int send_line(int fd, int flags, const char *fmt, ...);
+
+/**
+ * Takes the first complete line out of a receive buffer (without the line break).
+ *
+ * @return 1 with a line, 0 if there is none yet, -1 if it is too long
+ */
+static int take_line(char *buf, size_t *len, char *line);
+
+/**
+ * Listens on the port (any address). Exits on error.
+ *
+ * @return listening socket
+ */
+static int listen_on(const char *port);
+
+/**
+ * Sends the description of the attack to a new worker.
+ */
+static void send_job(dist_server *sv, dist_conn *c);
+
+/**
+ * Handles a line received from a worker.
+ */
+static void handle(dist_server *sv, dist_conn *c, char *line);
+
+/**
+ * Closes the connection of a lost worker, its ranges to be tested again.
+ */
+static void lose(dist_server *sv, dist_conn *c, const char *why);
+
+/**
+ * Candidates tested by all the workers.
+ */
+static uint64_t total_tested(const dist_server *sv);
+
+/**
+ * Worker thread receiving the replies and broadcasts of the coordinator.
+ */
+static void* reader(void *arg);
+
+/**
+ * Worker thread sending the heartbeats.
+ */
+static void* heartbeat(void *arg);
+
+/**
+ * Reads the description of the attack, up to the ready line.
+ *
+ * @return 0 on success, -1 on error
+ */
+static int recv_job(dist_worker *w);
+
+static int send_line(int fd, int flags, const char *fmt, ...)
+{
+	char line[DIST_LINE];
+	va_list ap;
+	ssize_t r;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+	if (len < 0 || (size_t)len >= sizeof(line))
+		return -1;
+	for (int off = 0; off < len; off += r) {
+		if ((r = send(fd, line + off, len - off, MSG_NOSIGNAL | flags)) <= 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int take_line(char *buf, size_t *len, char *line)
+{
+	char *nl = memchr(buf, '\n', *len);
+	size_t n;
+
+	if (!nl)
+		return *len == DIST_LINE ? -1 : 0;
+	n = nl - buf;
+	memcpy(line, buf, n);
+	line[n] = '\0';
+	*len -= n + 1;
+	memmove(buf, nl + 1, *len);
+	return 1;
+}
+
+static int listen_on(const char *port)
+{
+	struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM,
+	                          .ai_flags = AI_PASSIVE }, *res, *ai;
+	int fd = -1, one = 1, err;
+
+	if ((err = getaddrinfo(NULL, port, &hints, &res)) != 0) {
+		fprintf(stderr, "can't listen on port %s: %s\n", port, gai_strerror(err));
+		exit(1);
+	}
+	for (ai = res; ai; ai = ai->ai_next) {
+		if ((fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol)) < 0)
+			continue;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 64) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	if (fd < 0) {
+		perror("can't listen for workers");
+		exit(1);
+	}
+	return fd;
+}
+
+static void send_job(dist_server *sv, dist_conn *c)
+{
+	dist_job *job = sv->job;
+	int err;
+
+	err = send_line(c->fd, MSG_DONTWAIT, "dictionary %s\ndictsize %" PRIu64 "\n",
+	                job->dictionary, job->dict_size);
+	if (job->rules)
+		err |= send_line(c->fd, MSG_DONTWAIT, "rules %s\n", job->rules);
+	for (size_t i = 0; i < job->nzip; i++)
+		err |= send_line(c->fd, MSG_DONTWAIT, "zipfile %s\n", job->zipnames[i]);
+	for (size_t i = 0; i < job->nzip; i++)
+		if (job->passwords[i])
+			err |= send_line(c->fd, MSG_DONTWAIT, "found %zu %s\n", i, job->passwords[i]);
+	err |= send_line(c->fd, MSG_DONTWAIT, "ready\n");
+	if (err)
+		lose(sv, c, "can't send the attack");
+}
+
+static void handle(dist_server *sv, dist_conn *c, char *line)
+{
+	dist_job *job = sv->job;
+	char *pw;
+	size_t i, zip;
+	uint64_t id, n;
+
+	if (sscanf(line, "hello %d", &c->threads) == 1) {
+		fprintf(stderr, "worker %d connected (%d threads)\n", c->id, c->threads);
+		send_job(sv, c);
+	}
+	else if (strcmp(line, "next") == 0) {
+		for (i = sv->todo; i < job->nranges && job->ranges[i].state != RANGE_TODO; i++)
+			;
+		sv->todo = i;
+		if (i < job->nranges) {
+			job->ranges[i].state = RANGE_ASSIGNED;
+			job->ranges[i].worker = c->id;
+			if (send_line(c->fd, MSG_DONTWAIT, "range %zu %" PRIu64 " %" PRIu64 "\n",
+			              i, job->ranges[i].off, job->ranges[i].end) < 0)
+				lose(sv, c, "can't send a range");
+		}
+		/* the ranges of a worker lost may still come back */
+		else if (send_line(c->fd, MSG_DONTWAIT, sv->done < job->nranges ? "wait\n" : "stop\n") < 0)
+			lose(sv, c, "can't send a reply");
+	}
+	else if (sscanf(line, "done %" SCNu64 " %" SCNu64, &id, &n) == 2) {
+		c->tested = n;
+		/* a range handed again may be reported twice */
+		if (id < job->nranges && job->ranges[id].state != RANGE_DONE) {
+			job->ranges[id].state = RANGE_DONE;
+			sv->done++;
+		}
+	}
+	else if (sscanf(line, "alive %" SCNu64, &n) == 1)
+		c->tested = n;
+	else if (sscanf(line, "found %zu", &zip) == 1 && (pw = strchr(line + 6, ' ')) &&
+	         zip < job->nzip && !job->passwords[zip]) {
+		if (!(job->passwords[zip] = strdup(pw + 1))) {
+			perror("can't allocate password");
+			exit(1);
+		}
+		sv->found++;
+		fprintf(stderr, "password of %s found by worker %d\n", job->zipnames[zip], c->id);
+		/* the other workers leave the archive out of their next ranges */
+		for (i = 0; i < sv->nconns; i++)
+			if (sv->conns[i].fd >= 0 &&
+			    send_line(sv->conns[i].fd, MSG_DONTWAIT, "found %zu %s\n", zip, pw + 1) < 0)
+				lose(sv, &sv->conns[i], "can't send a password");
+	}
+}
+
+static void lose(dist_server *sv, dist_conn *c, const char *why)
+{
+	dist_job *job = sv->job;
+	size_t again = 0;
+
+	if (c->fd < 0)
+		return;
+	close(c->fd);
+	c->fd = -1;
+	sv->lost_tested += c->tested;
+	c->tested = 0;
+	for (size_t i = 0; i < job->nranges; i++) {
+		if (job->ranges[i].state == RANGE_ASSIGNED && job->ranges[i].worker == c->id) {
+			job->ranges[i].state = RANGE_TODO;
+			sv->todo = i < sv->todo ? i : sv->todo;
+			again++;
+		}
+	}
+	fprintf(stderr, "worker %d lost (%s), %zu ranges handed again\n", c->id, why, again);
+}
+
+static uint64_t total_tested(const dist_server *sv)
+{
+	uint64_t n = sv->lost_tested;
+
+	for (size_t i = 0; i < sv->nconns; i++)
+		n += sv->conns[i].tested;
+	return n;
+}
+
+size_t dist_serve(const char *port, dist_job *job, volatile sig_atomic_t *stop)
+{
+	dist_server sv = { .job = job };
+	int lfd = listen_on(port), fd;
+	struct pollfd *pfd = NULL;
+	time_t now, start = time(NULL), last = start;
+	uint64_t total, last_total = 0;
+	size_t n, live;
+	ssize_t r;
+	char line[DIST_LINE];
+
+	for (size_t i = 0; i < job->nzip; i++)
+		sv.found += job->passwords[i] != NULL;
+	fprintf(stderr, "waiting for workers on port %s, %zu ranges\n", port, job->nranges);
+	while (!*stop && sv.done < job->nranges && sv.found < job->nzip) {
+		/* lost workers are dropped before polling */
+		for (size_t i = n = 0; i < sv.nconns; i++)
+			if (sv.conns[i].fd >= 0)
+				sv.conns[n++] = sv.conns[i];
+		sv.nconns = n;
+		if (!(pfd = realloc(pfd, (sv.nconns + 1) * sizeof(struct pollfd)))) {
+			perror("can't allocate connections");
+			exit(1);
+		}
+		pfd[0] = (struct pollfd){ .fd = lfd, .events = POLLIN };
+		for (size_t i = 0; i < sv.nconns; i++)
+			pfd[i + 1] = (struct pollfd){ .fd = sv.conns[i].fd, .events = POLLIN };
+		if (poll(pfd, sv.nconns + 1, 1000) < 0 && errno != EINTR) {
+			perror("can't wait for workers");
+			exit(1);
+		}
+		now = time(NULL);
+		for (size_t i = 0; i < sv.nconns; i++) {
+			dist_conn *c = &sv.conns[i];
+
+			if (c->fd >= 0 && (pfd[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) {
+				if ((r = recv(c->fd, c->buf + c->len, DIST_LINE - c->len, 0)) <= 0) {
+					lose(&sv, c, r < 0 ? strerror(errno) : "disconnected");
+					continue;
+				}
+				c->len += r;
+				c->seen = now;
+				while (c->fd >= 0 && (r = take_line(c->buf, &c->len, line)) == 1)
+					handle(&sv, c, line);
+				if (r < 0)
+					lose(&sv, c, "line too long");
+			}
+			if (c->fd >= 0 && now - c->seen > DIST_TIMEOUT)
+				lose(&sv, c, "no heartbeat");
+		}
+		if ((pfd[0].revents & POLLIN) && (fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+			if (sv.nconns == sv.conns_cap) {
+				sv.conns_cap = sv.conns_cap ? 2 * sv.conns_cap : 16;
+				if (!(sv.conns = realloc(sv.conns, sv.conns_cap * sizeof(dist_conn)))) {
+					perror("can't allocate connections");
+					exit(1);
+				}
+			}
+			sv.conns[sv.nconns++] = (dist_conn){ .fd = fd, .id = sv.next_id++, .seen = now };
+		}
+		if (now - last >= DIST_REPORT) {
+			total = total_tested(&sv);
+			for (size_t i = live = 0; i < sv.nconns; i++)
+				live += sv.conns[i].fd >= 0;
+			fprintf(stderr, "%zu workers, %zu/%zu ranges, %.0f candidates/s\n", live,
+			        sv.done, job->nranges, (double)(total - last_total) / (now - last));
+			last = now;
+			last_total = total;
+		}
+	}
+	/* every worker stops, even the ones busy with a range */
+	for (size_t i = 0; i < sv.nconns; i++) {
+		if (sv.conns[i].fd >= 0) {
+			send_line(sv.conns[i].fd, MSG_DONTWAIT, "stop\n");
+			close(sv.conns[i].fd);
+		}
+	}
+	now = time(NULL);
+	total = total_tested(&sv);
+	fprintf(stderr, "%" PRIu64 " candidates tested in %ld s (%.0f/s)\n", total, (long)(now - start),
+	        now > start ? (double)total / (now - start) : (double)total);
+	close(lfd);
+	free(pfd);
+	free(sv.conns);
+	return sv.found;
+}
+
+static int recv_job(dist_worker *w)
+{
+	dist_job *job = &w->job;
+	char line[DIST_LINE], *val;
+	size_t cap = 0, zip;
+	ssize_t r;
+	int got;
+
+	for (;;) {
+		while ((got = take_line(w->buf, &w->len, line)) == 0) {
+			if ((r = recv(w->fd, w->buf + w->len, DIST_LINE - w->len, 0)) <= 0)
+				return -1;
+			w->len += r;
+		}
+		if (got < 0)
+			return -1;
+		if (strcmp(line, "ready") == 0)
+			return job->dictionary && job->nzip ? 0 : -1;
+		if (!(val = strchr(line, ' ')))
+			continue;
+		*val++ = '\0';
+		if (strcmp(line, "dictionary") == 0)
+			job->dictionary = strdup(val);
+		else if (strcmp(line, "dictsize") == 0)
+			sscanf(val, "%" SCNu64, &job->dict_size);
+		else if (strcmp(line, "rules") == 0)
+			job->rules = strdup(val);
+		else if (strcmp(line, "zipfile") == 0) {
+			if (job->nzip == cap) {
+				cap = cap ? 2 * cap : 8;
+				job->zipnames = realloc(job->zipnames, cap * sizeof(char *));
+				job->passwords = realloc(job->passwords, cap * sizeof(char *));
+				if (!job->zipnames || !job->passwords) {
+					perror("can't allocate attack");
+					exit(1);
+				}
+			}
+			job->passwords[job->nzip] = NULL;
+			job->zipnames[job->nzip++] = strdup(val);
+		}
+		else if (strcmp(line, "found") == 0 && sscanf(val, "%zu", &zip) == 1 && zip < job->nzip &&
+		         strchr(val, ' '))
+			job->passwords[zip] = strdup(strchr(val, ' ') + 1);
+	}
+}
+
+static void* reader(void *arg)
+{
+	dist_worker *w = arg;
+	char line[DIST_LINE], *pw;
+	uint64_t id, off, end;
+	size_t zip;
+	ssize_t r;
+	int got;
+
+	for (;;) {
+		while ((got = take_line(w->buf, &w->len, line)) == 0) {
+			if ((r = recv(w->fd, w->buf + w->len, DIST_LINE - w->len, 0)) <= 0)
+				break;
+			w->len += r;
+		}
+		if (got <= 0)
+			break;
+		pthread_mutex_lock(&w->lock);
+		if (sscanf(line, "range %" SCNu64 " %" SCNu64 " %" SCNu64, &id, &off, &end) == 3) {
+			w->id = id, w->off = off, w->end = end;
+			w->reply = 1;
+		}
+		else if (strcmp(line, "wait") == 0)
+			w->reply = 2;
+		else if (strcmp(line, "stop") == 0) {
+			*w->stop = 1;
+			w->reply = 3;
+		}
+		else if (sscanf(line, "found %zu", &zip) == 1 && (pw = strchr(line + 6, ' ')) &&
+		         zip < w->job.nzip && !w->job.passwords[zip])
+			w->job.passwords[zip] = strdup(pw + 1);
+		pthread_cond_broadcast(&w->cond);
+		pthread_mutex_unlock(&w->lock);
+	}
+	/* coordinator gone (or closing): the attack is over for this worker */
+	pthread_mutex_lock(&w->lock);
+	if (!w->closing && w->reply != 3)
+		fprintf(stderr, "connection to the coordinator lost\n");
+	*w->stop = 1;
+	w->reply = 3;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
+static void* heartbeat(void *arg)
+{
+	dist_worker *w = arg;
+	struct timespec ts;
+	int err = 0;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	pthread_mutex_lock(&w->lock);
+	while (!w->closing && !err) {
+		ts.tv_sec += DIST_HEARTBEAT;
+		/* woken early by the replies, and by dist_close */
+		while (!w->closing && pthread_cond_timedwait(&w->cond, &w->lock, &ts) != ETIMEDOUT)
+			;
+		if (!w->closing)
+			err = send_line(w->fd, 0, "alive %" PRIu64 "\n",
+			                __atomic_load_n(&w->tested, __ATOMIC_RELAXED)) < 0;
+	}
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
+dist_worker* dist_connect(const char *addr, int threads, volatile sig_atomic_t *stop)
+{
+	struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM }, *res, *ai;
+	dist_worker *w = calloc(1, sizeof(dist_worker));
+	char *host, *port;
+	int err;
+
+	if (!w || !(host = strdup(addr))) {
+		perror("can't allocate connection");
+		exit(1);
+	}
+	if (!(port = strrchr(host, ':'))) {
+		fprintf(stderr, "coordinator address %s has no port (host:port)\n", addr);
+		goto fail;
+	}
+	*port++ = '\0';
+	if ((err = getaddrinfo(host, port, &hints, &res)) != 0) {
+		fprintf(stderr, "can't find coordinator %s: %s\n", addr, gai_strerror(err));
+		goto fail;
+	}
+	w->fd = -1;
+	for (ai = res; ai && w->fd < 0; ai = ai->ai_next) {
+		if ((w->fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol)) < 0)
+			continue;
+		if (connect(w->fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+			close(w->fd);
+			w->fd = -1;
+		}
+	}
+	freeaddrinfo(res);
+	if (w->fd < 0) {
+		perror("can't connect to the coordinator");
+		goto fail;
+	}
+	if (send_line(w->fd, 0, "hello %d\n", threads) < 0 || recv_job(w) < 0) {
+		fprintf(stderr, "can't receive the attack from the coordinator\n");
+		close(w->fd);
+		goto fail;
+	}
+	free(host);
+	w->stop = stop;
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	if (pthread_create(&w->reader, NULL, reader, w) != 0 ||
+	    pthread_create(&w->heartbeat, NULL, heartbeat, w) != 0) {
+		perror("can't create connection thread");
+		exit(1);
+	}
+	return w;
+
+fail:
+	free(host);
+	free(w);
+	return NULL;
+}
+
+int dist_next(dist_worker *w, uint64_t *id, uint64_t *off, uint64_t *end)
+{
+	int reply;
+
+	while (!*w->stop) {
+		pthread_mutex_lock(&w->lock);
+		w->reply = 0;
+		if (send_line(w->fd, 0, "next\n") < 0)
+			*w->stop = 1;
+		while (!w->reply && !*w->stop)
+			pthread_cond_wait(&w->cond, &w->lock);
+		reply = w->reply;
+		*id = w->id, *off = w->off, *end = w->end;
+		pthread_mutex_unlock(&w->lock);
+		if (reply == 1)
+			return 1;
+		/* the ranges left are being tested, one may be handed again */
+		if (reply == 2)
+			sleep(1);
+	}
+	return 0;
+}
+
+void dist_done(dist_worker *w, uint64_t id)
+{
+	pthread_mutex_lock(&w->lock);
+	send_line(w->fd, 0, "done %" PRIu64 " %" PRIu64 "\n", id, __atomic_load_n(&w->tested, __ATOMIC_RELAXED));
+	pthread_mutex_unlock(&w->lock);
+}
+
+void dist_found(dist_worker *w, size_t zip, const char *password)
+{
+	pthread_mutex_lock(&w->lock);
+	if (!w->job.passwords[zip])
+		w->job.passwords[zip] = strdup(password);
+	send_line(w->fd, 0, "found %zu %s\n", zip, password);
+	pthread_mutex_unlock(&w->lock);
+}
+
+int dist_solved(dist_worker *w, size_t zip)
+{
+	int solved;
+
+	pthread_mutex_lock(&w->lock);
+	solved = w->job.passwords[zip] != NULL;
+	pthread_mutex_unlock(&w->lock);
+	return solved;
+}
+
+void dist_close(dist_worker *w)
+{
+	pthread_mutex_lock(&w->lock);
+	w->closing = 1;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+	shutdown(w->fd, SHUT_RDWR);
+	pthread_join(w->reader, NULL);
+	pthread_join(w->heartbeat, NULL);
+	close(w->fd);
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->cond);
+	free(w->job.dictionary);
+	free(w->job.rules);
+	for (size_t i = 0; i < w->job.nzip; i++) {
+		free(w->job.zipnames[i]);
+		free(w->job.passwords[i]);
+	}
+	free(w->job.zipnames);
+	free(w->job.passwords);
+	free(w);
+}
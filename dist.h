@@ -0,0 +1,166 @@
+/**
+ * @file dist.h
+ * @brief Distributed dictionary attack: a coordinator handing ranges to workers
+ *
+ * The keyspace of an attack is its dictionary (text or binary) tested with every
+ * rule: the coordinator splits the dictionary in ranges of about DIST_RANGE bytes
+ * (ending at line breaks, or inside a length bucket of a binary dictionary) and
+ * hands them to the workers connecting over TCP, each one testing its range with
+ * the local testing engine (see crack.h). The attack is described to each worker
+ * when it connects (file names, dictionary size, passwords already found), so
+ * workers only need the same files under the same paths.
+ * The protocol is made of text lines:
+ *   worker       hello <threads>, next, done <range> <candidates tested>,
+ *                found <zip> <password>, alive <candidates tested>
+ *   coordinator  the attack, then ready; range <id> <off> <end>, wait, found <zip>
+ *                <password> (broadcast), stop
+ * Workers send a heartbeat every DIST_HEARTBEAT seconds, and the ranges of a
+ * worker lost (disconnected or silent for DIST_TIMEOUT seconds) are handed again.
+ * The coordinator reports the throughput of all the workers every DIST_REPORT
+ * seconds, and stops them when every password is found.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef DIST_H
+#define DIST_H
+
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Size of the dictionary ranges handed to the workers */
+#define DIST_RANGE (16 * 1024 * 1024)
+
+/** Seconds between heartbeats of a worker */
+#define DIST_HEARTBEAT 5
+
+/** Seconds of silence after which a worker is lost */
+#define DIST_TIMEOUT 30
+
+/** Seconds between throughput reports of the coordinator */
+#define DIST_REPORT 10
+
+/** Longest protocol line */
+#define DIST_LINE 8192
+
+/** States of a range */
+enum { RANGE_TODO, RANGE_ASSIGNED, RANGE_DONE };
+
+/**
+ * @brief Struct for a range of the dictionary.
+ */
+typedef struct _dist_range {
+	uint64_t off;	/* dictionary bytes [off, end) */
+	uint64_t end;
+	int state;
+	int worker;	/* connection testing it, while assigned */
+} dist_range;
+
+/**
+ * @brief Struct for the description of an attack.
+ */
+typedef struct _dist_job {
+	char *dictionary;
+	uint64_t dict_size;
+	char *rules;	/* NULL without rules */
+	char **zipnames;
+	size_t nzip;
+	char **passwords;	/* password found of each archive, or NULL */
+	dist_range *ranges;	/* coordinator only */
+	size_t nranges;
+} dist_job;
+
+/**
+ * @brief Struct for the connection of a worker to the coordinator.
+ */
+typedef struct _dist_worker {
+	int fd;
+	dist_job job;	/* received when connecting */
+	uint64_t tested;	/* candidates tested (see crack_count) */
+	volatile sig_atomic_t *stop;	/* set when the coordinator stops the attack */
+	pthread_mutex_t lock;	/* sends, reply and passwords */
+	pthread_cond_t cond;
+	int reply;	/* last reply to next (0 for none yet) */
+	uint64_t id, off, end;	/* range of the last reply */
+	int closing;	/* set by dist_close, ends the heartbeats */
+	pthread_t reader;
+	pthread_t heartbeat;
+	char buf[DIST_LINE];	/* bytes received */
+	size_t len;
+} dist_worker;
+
+/**
+ * Runs the coordinator of the attack until every range is tested, every
+ * password is found, or stop is set (every worker is then stopped). Prints
+ * the passwords received and the throughput to stderr. Exits on error.
+ *
+ * @param port  string with TCP port to listen on
+ * @param job  pointer to attack, its passwords set as they are found
+ * @param stop  set to stop the attack (signal handler)
+ *
+ * @return number of passwords found
+ */
+size_t dist_serve(const char *port, dist_job *job, volatile sig_atomic_t *stop);
+
+/**
+ * Connects to the coordinator and receives the attack description.
+ * Prints the reason to stderr on error.
+ *
+ * @param addr  string with coordinator address (host:port)
+ * @param threads  number of testing threads of the worker
+ * @param stop  set when the coordinator stops the attack or is lost
+ *
+ * @return pointer to new connection, or NULL on error
+ */
+dist_worker* dist_connect(const char *addr, int threads, volatile sig_atomic_t *stop);
+
+/**
+ * Asks the coordinator for a range to test, waiting while every range left is
+ * being tested by other workers.
+ *
+ * @param w  pointer to connection
+ * @param id  pointer to range number
+ * @param off  pointer to dictionary offset of the range
+ * @param end  pointer to dictionary offset past the range
+ *
+ * @return 1 with a range, 0 when the attack is over
+ */
+int dist_next(dist_worker *w, uint64_t *id, uint64_t *off, uint64_t *end);
+
+/**
+ * Reports a range as tested, with the candidates tested so far.
+ *
+ * @param w  pointer to connection
+ * @param id  range number
+ */
+void dist_done(dist_worker *w, uint64_t id);
+
+/**
+ * Reports the password of an archive.
+ *
+ * @param w  pointer to connection
+ * @param zip  index of the archive in the attack
+ * @param password  password found
+ */
+void dist_found(dist_worker *w, size_t zip, const char *password);
+
+/**
+ * Checks if the password of an archive was found (by any worker).
+ *
+ * @param w  pointer to connection
+ * @param zip  index of the archive in the attack
+ *
+ * @return 1 if found, 0 otherwise
+ */
+int dist_solved(dist_worker *w, size_t zip);
+
+/**
+ * Closes the connection and deallocates it.
+ *
+ * @param w  pointer to connection
+ */
+void dist_close(dist_worker *w);
+
+#endif
@@ -0,0 +1,419 @@
+/**
+ * @file gpu.c
+ * @brief OpenCL backend of the password tests (built with make OPENCL=1)
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "gpu.h"
+
+#ifdef HAVE_OPENCL
+
+#define CL_TARGET_OPENCL_VERSION 120
+#include <CL/cl.h>
+
+/** Bytes uploaded per entry: the encryption header, then its check byte */
+#define GPU_HEADER (ZIP_HEADER_SIZE + 1)
+
+/**
+ * @brief Struct for a candidate buffer in flight.
+ */
+typedef struct _gpu_slot {
+	cl_command_queue queue;	/* one per slot, so transfers overlap the other's kernel */
+	cl_mem words;
+	cl_mem hits;	/* count, then pairs of candidate and archive indexes */
+	cl_event done;	/* hits read back */
+	int busy;
+	char *host;	/* candidates uploaded (swapped with the buffer filled) */
+	size_t len;	/* length of every candidate */
+	size_t n;
+	cl_uint *hits_host;
+} gpu_slot;
+
+struct _gpu_ctx {
+	cl_device_id dev;
+	cl_context ctx;
+	cl_program prog;
+	cl_kernel kernel;
+	cl_mem crc;	/* zc_crc_table */
+	cl_mem headers;	/* ZC_MAX_CHECKS entries of GPU_HEADER bytes per archive */
+	cl_mem nchecks;	/* entries checked per archive, 0 for the ones left out */
+	char name[256];
+	zip_archive *const *zas;
+	size_t nzas;
+	pthread_mutex_t lock;	/* everything below */
+	gpu_slot slots[2];
+	int next;	/* slot of the next upload */
+	char *stage[GPU_MAX_LEN + 1];	/* buffers filled, by candidate length */
+	size_t nstage[GPU_MAX_LEN + 1];
+};
+
+/** Testing kernel, one work item per candidate */
+static const char *kernel_src =
+	"void update(uint *k, uint c, __constant uint *crc)\n"
+	"{\n"
+	"	k[0] = (k[0] >> 8) ^ crc[(k[0] ^ c) & 0xff];\n"
+	"	k[1] = (k[1] + (k[0] & 0xff)) * 134775813 + 1;\n"
+	"	k[2] = (k[2] >> 8) ^ crc[(k[2] ^ (k[1] >> 24)) & 0xff];\n"
+	"}\n"
+	"\n"
+	"__kernel void check(__global const uchar *words, uint n, uint len, __constant uint *crc,\n"
+	"                    __global const uchar *headers, __global const uint *nchecks, uint nzas,\n"
+	"                    __global volatile uint *hits)\n"
+	"{\n"
+	"	uint i = get_global_id(0), k[3] = { KEY0, KEY1, KEY2 }, t[3], e, s, x = 0;\n"
+	"	__global const uchar *pw = words + (size_t)i * len, *h;\n"
+	"\n"
+	"	if (i >= n)\n"
+	"		return;\n"
+	"	for (uint j = 0; j < len; j++)\n"
+	"		update(k, pw[j], crc);\n"
+	"	for (uint z = 0; z < nzas; z++) {\n"
+	"		for (e = 0; e < nchecks[z]; e++) {\n"
+	"			h = headers + (z * MAX_CHECKS + e) * (HEADER_SIZE + 1);\n"
+	"			t[0] = k[0], t[1] = k[1], t[2] = k[2];\n"
+	"			for (uint b = 0; b < HEADER_SIZE; b++) {\n"
+	"				s = (t[2] | 2) & 0xffff;\n"
+	"				x = (h[b] ^ ((s * (s ^ 1)) >> 8)) & 0xff;\n"
+	"				update(t, x, crc);\n"
+	"			}\n"
+	"			if (x != h[HEADER_SIZE])\n"
+	"				break;\n"
+	"		}\n"
+	"		if (nchecks[z] && e == nchecks[z] && (s = atomic_inc(hits)) < MAX_HITS) {\n"
+	"			hits[1 + 2 * s] = i;\n"
+	"			hits[2 + 2 * s] = z;\n"
+	"		}\n"
+	"	}\n"
+	"}\n";
+
+/**
+ * Prints the reason of an OpenCL error.
+ *
+ * @return 1 on error, 0 otherwise
+ */
+static int failed(cl_int err, const char *what);
+
+/**
+ * Exits on an OpenCL error (while testing).
+ */
+static void check(cl_int err, const char *what);
+
+/**
+ * Tests a candidate on every archive on the host.
+ */
+static void test_host(gpu_ctx *g, const char *pw, size_t len, gpu_found_fn found, void *arg);
+
+/**
+ * Waits for the buffer of a slot to be tested, and verifies the candidates
+ * passing the header checks on the host.
+ */
+static void collect(gpu_ctx *g, gpu_slot *s, gpu_found_fn found, void *arg);
+
+/**
+ * Uploads the buffer of a length to the next slot (once free) and starts its test.
+ */
+static void launch(gpu_ctx *g, size_t len, gpu_found_fn found, void *arg);
+
+static int failed(cl_int err, const char *what)
+{
+	if (err == CL_SUCCESS)
+		return 0;
+	fprintf(stderr, "%s (OpenCL error %d)\n", what, err);
+	return 1;
+}
+
+static void check(cl_int err, const char *what)
+{
+	if (failed(err, what))
+		exit(1);
+}
+
+static void test_host(gpu_ctx *g, const char *pw, size_t len, gpu_found_fn found, void *arg)
+{
+	for (size_t z = 0; z < g->nzas; z++)
+		if (g->zas[z] && zc_test(g->zas[z], pw, len))
+			found(arg, z, pw, len);
+}
+
+static void collect(gpu_ctx *g, gpu_slot *s, gpu_found_fn found, void *arg)
+{
+	const char *pw;
+	cl_uint nhits;
+	size_t z;
+
+	check(clWaitForEvents(1, &s->done), "can't test on the GPU");
+	clReleaseEvent(s->done);
+	s->busy = 0;
+	nhits = s->hits_host[0];
+	/* more than returned (many archives, or with few entries checked) */
+	if (nhits > GPU_HITS) {
+		for (size_t i = 0; i < s->n; i++)
+			test_host(g, s->host + i * s->len, s->len, found, arg);
+		return;
+	}
+	for (cl_uint h = 0; h < nhits; h++) {
+		pw = s->host + (size_t)s->hits_host[1 + 2 * h] * s->len;
+		z = s->hits_host[2 + 2 * h];
+		if (zc_test(g->zas[z], pw, s->len))
+			found(arg, z, pw, s->len);
+	}
+}
+
+static void launch(gpu_ctx *g, size_t len, gpu_found_fn found, void *arg)
+{
+	static const cl_uint zero = 0;
+	gpu_slot *s = &g->slots[g->next];
+	cl_uint n = g->nstage[len], l = len, nzas = g->nzas;
+	size_t global = n;
+	char *buf;
+
+	g->next ^= 1;
+	if (s->busy)
+		collect(g, s, found, arg);
+	/* the slot keeps the buffer until it is tested, its old one is filled meanwhile */
+	buf = s->host;
+	s->host = g->stage[len];
+	g->stage[len] = buf;
+	g->nstage[len] = 0;
+	s->len = len;
+	s->n = n;
+	check(clEnqueueWriteBuffer(s->queue, s->hits, CL_FALSE, 0, sizeof(zero), &zero, 0, NULL, NULL),
+	      "can't upload to the GPU");
+	check(clEnqueueWriteBuffer(s->queue, s->words, CL_FALSE, 0, len * n, s->host, 0, NULL, NULL),
+	      "can't upload to the GPU");
+	check(clSetKernelArg(g->kernel, 0, sizeof(cl_mem), &s->words) |
+	      clSetKernelArg(g->kernel, 1, sizeof(cl_uint), &n) |
+	      clSetKernelArg(g->kernel, 2, sizeof(cl_uint), &l) |
+	      clSetKernelArg(g->kernel, 3, sizeof(cl_mem), &g->crc) |
+	      clSetKernelArg(g->kernel, 4, sizeof(cl_mem), &g->headers) |
+	      clSetKernelArg(g->kernel, 5, sizeof(cl_mem), &g->nchecks) |
+	      clSetKernelArg(g->kernel, 6, sizeof(cl_uint), &nzas) |
+	      clSetKernelArg(g->kernel, 7, sizeof(cl_mem), &s->hits), "can't set the kernel arguments");
+	check(clEnqueueNDRangeKernel(s->queue, g->kernel, 1, NULL, &global, NULL, 0, NULL, NULL),
+	      "can't test on the GPU");
+	check(clEnqueueReadBuffer(s->queue, s->hits, CL_FALSE, 0, (1 + 2 * GPU_HITS) * sizeof(cl_uint),
+	                          s->hits_host, 0, NULL, &s->done), "can't download from the GPU");
+	check(clFlush(s->queue), "can't test on the GPU");
+	s->busy = 1;
+}
+
+gpu_ctx* gpu_create(zip_archive *const *zas, size_t nzas)
+{
+	gpu_ctx *g = calloc(1, sizeof(gpu_ctx));
+	cl_platform_id plats[16];
+	cl_uint nplats = 0, ndevs = 0, *nchecks;
+	unsigned char *headers;
+	char opts[256], *log;
+	size_t len;
+	cl_int err;
+
+	if (!g) {
+		perror("can't allocate GPU context");
+		exit(1);
+	}
+	pthread_mutex_init(&g->lock, NULL);
+	g->zas = zas;
+	g->nzas = nzas;
+	if (failed(clGetPlatformIDs(16, plats, &nplats), "can't find OpenCL platforms"))
+		goto fail;
+	/* the first GPU, else the first device of any kind */
+	for (cl_uint i = 0; i < nplats && !ndevs; i++)
+		if (clGetDeviceIDs(plats[i], CL_DEVICE_TYPE_GPU, 1, &g->dev, &ndevs) != CL_SUCCESS)
+			ndevs = 0;
+	for (cl_uint i = 0; i < nplats && !ndevs; i++)
+		if (clGetDeviceIDs(plats[i], CL_DEVICE_TYPE_ALL, 1, &g->dev, &ndevs) != CL_SUCCESS)
+			ndevs = 0;
+	if (!ndevs) {
+		fprintf(stderr, "no OpenCL device found\n");
+		goto fail;
+	}
+	clGetDeviceInfo(g->dev, CL_DEVICE_NAME, sizeof(g->name) - 1, g->name, NULL);
+	g->ctx = clCreateContext(NULL, 1, &g->dev, NULL, NULL, &err);
+	if (failed(err, "can't create OpenCL context"))
+		goto fail;
+	g->prog = clCreateProgramWithSource(g->ctx, 1, &kernel_src, NULL, &err);
+	if (failed(err, "can't create OpenCL program"))
+		goto fail;
+	snprintf(opts, sizeof(opts), "-DKEY0=%uu -DKEY1=%uu -DKEY2=%uu -DMAX_CHECKS=%d -DHEADER_SIZE=%d -DMAX_HITS=%d",
+	         ZC_KEY0, ZC_KEY1, ZC_KEY2, ZC_MAX_CHECKS, ZIP_HEADER_SIZE, GPU_HITS);
+	if (clBuildProgram(g->prog, 1, &g->dev, opts, NULL, NULL) != CL_SUCCESS) {
+		/* the compiler log tells why */
+		if (clGetProgramBuildInfo(g->prog, g->dev, CL_PROGRAM_BUILD_LOG, 0, NULL, &len) == CL_SUCCESS &&
+		    (log = calloc(1, len + 1))) {
+			clGetProgramBuildInfo(g->prog, g->dev, CL_PROGRAM_BUILD_LOG, len, log, NULL);
+			fprintf(stderr, "%s\n", log);
+			free(log);
+		}
+		fprintf(stderr, "can't build OpenCL kernel\n");
+		goto fail;
+	}
+	g->kernel = clCreateKernel(g->prog, "check", &err);
+	if (failed(err, "can't create OpenCL kernel"))
+		goto fail;
+
+	/* the entries checked by zc_test, whose verification is left to the host */
+	headers = calloc(nzas ? nzas * ZC_MAX_CHECKS : 1, GPU_HEADER);
+	nchecks = calloc(nzas ? nzas : 1, sizeof(cl_uint));
+	if (!headers || !nchecks) {
+		perror("can't allocate GPU context");
+		exit(1);
+	}
+	for (size_t z = 0; z < nzas; z++) {
+		if (!zas[z])
+			continue;
+		nchecks[z] = zas[z]->n < ZC_MAX_CHECKS ? zas[z]->n : ZC_MAX_CHECKS;
+		for (size_t e = 0; e < nchecks[z]; e++) {
+			memcpy(headers + (z * ZC_MAX_CHECKS + e) * GPU_HEADER, zas[z]->entries[e].header, ZIP_HEADER_SIZE);
+			headers[(z * ZC_MAX_CHECKS + e) * GPU_HEADER + ZIP_HEADER_SIZE] = zas[z]->entries[e].check;
+		}
+	}
+	g->crc = clCreateBuffer(g->ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(zc_crc_table),
+	                        zc_crc_table, &err);
+	if (err == CL_SUCCESS)
+		g->headers = clCreateBuffer(g->ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		                            (nzas ? nzas * ZC_MAX_CHECKS : 1) * GPU_HEADER, headers, &err);
+	if (err == CL_SUCCESS)
+		g->nchecks = clCreateBuffer(g->ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+		                            (nzas ? nzas : 1) * sizeof(cl_uint), nchecks, &err);
+	free(headers);
+	free(nchecks);
+	if (failed(err, "can't allocate GPU buffers"))
+		goto fail;
+	for (int i = 0; i < 2; i++) {
+		gpu_slot *s = &g->slots[i];
+
+		s->queue = clCreateCommandQueue(g->ctx, g->dev, 0, &err);
+		if (failed(err, "can't create OpenCL queue"))
+			goto fail;
+		s->words = clCreateBuffer(g->ctx, CL_MEM_READ_ONLY, GPU_STAGE, NULL, &err);
+		if (err == CL_SUCCESS)
+			s->hits = clCreateBuffer(g->ctx, CL_MEM_READ_WRITE, (1 + 2 * GPU_HITS) * sizeof(cl_uint), NULL, &err);
+		if (failed(err, "can't allocate GPU buffers"))
+			goto fail;
+		s->host = malloc(GPU_STAGE);
+		s->hits_host = malloc((1 + 2 * GPU_HITS) * sizeof(cl_uint));
+		if (!s->host || !s->hits_host) {
+			perror("can't allocate GPU buffers");
+			exit(1);
+		}
+	}
+	return g;
+
+fail:
+	gpu_free(g);
+	return NULL;
+}
+
+const char* gpu_name(const gpu_ctx *g)
+{
+	return g->name;
+}
+
+void gpu_test(gpu_ctx *g, const zc_cand *c, size_t n, gpu_found_fn found, void *arg)
+{
+	size_t len;
+
+	pthread_mutex_lock(&g->lock);
+	for (size_t i = 0; i < n; i++) {
+		len = c[i].len;
+		if (len == 0 || len > GPU_MAX_LEN) {
+			test_host(g, c[i].pw, len, found, arg);
+			continue;
+		}
+		if (!g->stage[len] && !(g->stage[len] = malloc(GPU_STAGE))) {
+			perror("can't allocate GPU buffers");
+			exit(1);
+		}
+		memcpy(g->stage[len] + g->nstage[len] * len, c[i].pw, len);
+		if (++g->nstage[len] == GPU_STAGE / len)
+			launch(g, len, found, arg);
+	}
+	pthread_mutex_unlock(&g->lock);
+}
+
+void gpu_flush(gpu_ctx *g, gpu_found_fn found, void *arg)
+{
+	pthread_mutex_lock(&g->lock);
+	for (size_t len = 1; len <= GPU_MAX_LEN; len++)
+		if (g->nstage[len])
+			launch(g, len, found, arg);
+	for (int i = 0; i < 2; i++)
+		if (g->slots[i].busy)
+			collect(g, &g->slots[i], found, arg);
+	pthread_mutex_unlock(&g->lock);
+}
+
+void gpu_free(gpu_ctx *g)
+{
+	for (int i = 0; i < 2; i++) {
+		gpu_slot *s = &g->slots[i];
+
+		if (s->busy) {
+			clWaitForEvents(1, &s->done);
+			clReleaseEvent(s->done);
+		}
+		if (s->words)
+			clReleaseMemObject(s->words);
+		if (s->hits)
+			clReleaseMemObject(s->hits);
+		if (s->queue)
+			clReleaseCommandQueue(s->queue);
+		free(s->host);
+		free(s->hits_host);
+	}
+	for (size_t len = 0; len <= GPU_MAX_LEN; len++)
+		free(g->stage[len]);
+	if (g->crc)
+		clReleaseMemObject(g->crc);
+	if (g->headers)
+		clReleaseMemObject(g->headers);
+	if (g->nchecks)
+		clReleaseMemObject(g->nchecks);
+	if (g->kernel)
+		clReleaseKernel(g->kernel);
+	if (g->prog)
+		clReleaseProgram(g->prog);
+	if (g->ctx)
+		clReleaseContext(g->ctx);
+	pthread_mutex_destroy(&g->lock);
+	free(g);
+}
+
+#else
+
+/* built without OpenCL, the candidates are only tested on the CPU */
+struct _gpu_ctx {
+	int unused;
+};
+
+gpu_ctx* gpu_create(zip_archive *const *zas, size_t nzas)
+{
+	fprintf(stderr, "built without OpenCL support (make OPENCL=1)\n");
+	return NULL;
+}
+
+const char* gpu_name(const gpu_ctx *g)
+{
+	return "none";
+}
+
+void gpu_test(gpu_ctx *g, const zc_cand *c, size_t n, gpu_found_fn found, void *arg)
+{
+}
+
+void gpu_flush(gpu_ctx *g, gpu_found_fn found, void *arg)
+{
+}
+
+void gpu_free(gpu_ctx *g)
+{
+	free(g);
+}
+
+#endif
@@ -0,0 +1,98 @@
+/**
+ * @file gpu.h
+ * @brief OpenCL backend of the password tests (built with make OPENCL=1)
+ *
+ * The key schedule and the header checks are a few integer operations per byte,
+ * so the candidates are tested on the device by thousands: they are grouped by
+ * length in host buffers of GPU_STAGE bytes (candidates back to back, so each
+ * work item runs the same number of bytes), and a full buffer is uploaded and
+ * checked against the encryption headers of every archive. Only the candidates
+ * passing every header check (about 1 in 256 per entry checked) come back to the
+ * host, where they are verified by inflating the entry (see zc_verify). Two
+ * buffers are in flight on their own command queues, so the device tests one
+ * while the other is transferred and the host fills the next.
+ * Candidates longer than GPU_MAX_LEN (or empty) are tested on the host.
+ * Without OpenCL, gpu_create fails and the program tests on the CPU only.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef GPU_H
+#define GPU_H
+
+#include <stddef.h>
+
+#include "zipfile.h"
+#include "zipcrypto.h"
+
+/** Size of the candidate buffers uploaded to the device */
+#define GPU_STAGE (1024 * 1024)
+
+/** Longest candidate tested on the device */
+#define GPU_MAX_LEN 32
+
+/** Candidates passing the header checks returned per buffer (more are tested on the host) */
+#define GPU_HITS 16384
+
+/**
+ * @brief Struct for the device and its buffers (defined in gpu.c).
+ */
+typedef struct _gpu_ctx gpu_ctx;
+
+/**
+ * Called for each password found, with the index of its archive.
+ */
+typedef void (*gpu_found_fn)(void *arg, size_t zip, const char *pw, size_t len);
+
+/**
+ * Selects the first GPU (or any OpenCL device if there is none), builds the
+ * testing kernel and uploads the encryption headers of the archives (after
+ * zipcrypto_init). Prints the reason to stderr on error.
+ *
+ * @param zas  array of archives (with encrypted entries, kept until gpu_free),
+ *             NULL ones are left out
+ * @param nzas  number of archives
+ *
+ * @return pointer to new context, or NULL on error
+ */
+gpu_ctx* gpu_create(zip_archive *const *zas, size_t nzas);
+
+/**
+ * Name of the device in use.
+ *
+ * @param g  pointer to context
+ *
+ * @return device name
+ */
+const char* gpu_name(const gpu_ctx *g);
+
+/**
+ * Adds a group of candidates to the buffers of their lengths, uploading the
+ * full ones. Passwords of the buffers tested before are reported meanwhile.
+ * Can be called from several threads.
+ *
+ * @param g  pointer to context
+ * @param c  array of candidates (copied)
+ * @param n  number of candidates
+ * @param found  function called for each password found
+ * @param arg  argument of found
+ */
+void gpu_test(gpu_ctx *g, const zc_cand *c, size_t n, gpu_found_fn found, void *arg);
+
+/**
+ * Tests the candidates left in the buffers and waits for every buffer in flight.
+ *
+ * @param g  pointer to context
+ * @param found  function called for each password found
+ * @param arg  argument of found
+ */
+void gpu_flush(gpu_ctx *g, gpu_found_fn found, void *arg);
+
+/**
+ * Releases the device and deallocates the context.
+ *
+ * @param g  pointer to context
+ */
+void gpu_free(gpu_ctx *g);
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * @file hash.h
+ * @brief Word-at-a-time hash function for harvested words
+ *
+ * wyhash-style hash: the word is read 8 bytes per step (short words with a few
+ * overlapping 4 byte reads, no loop), the length is folded in, and bits are mixed
+ * with 64x64->128 bit multiplications, so all output bits are usable and
+ * power-of-two table masks index well even for short and numeric words.
+ * It is inlined in the tokenizer, hashing each word once while still in L1.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/** Mixing constants (odd, with balanced bits) */
+#define HASH_SEED 0xa0761d6478bd642fULL
+#define HASH_K1 0xe7037ed1a0b428dbULL
+#define HASH_K2 0x8ebc6af09c88c6e3ULL
+
+static inline uint64_t hash_read8(const unsigned char *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline uint64_t hash_read4(const unsigned char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+	return v;
+}
+
+/** Multiplies and folds the 128 bit product */
+static inline uint64_t hash_mix(uint64_t a, uint64_t b)
+{
+	__uint128_t r = (__uint128_t)a * b;
+
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+/**
+ * Calculates the hash value for the string (word),
+ * never returning 0 (reserved to mark empty slots).
+ *
+ * @param str  string to be hashed (needs not be NUL-terminated)
+ * @param len  string length
+ *
+ * @return hash value for string received
+ */
+static inline uint64_t hash_function(const char *str, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)str;
+	uint64_t seed = HASH_SEED, a, b;
+	size_t i = len;
+
+	if (len <= 16) {
+		if (len >= 4) {	/* two overlapping pairs of 4 byte reads cover the word */
+			a = hash_read4(p) << 32 | hash_read4(p + ((len >> 3) << 2));
+			b = hash_read4(p + len - 4) << 32 | hash_read4(p + len - 4 - ((len >> 3) << 2));
+		}
+		else if (len > 0) {
+			a = (uint64_t)p[0] << 16 | (uint64_t)p[len >> 1] << 8 | p[len - 1];
+			b = 0;
+		}
+		else
+			a = b = 0;
+	}
+	else {
+		for (; i > 16; i -= 16, p += 16)
+			seed = hash_mix(hash_read8(p) ^ HASH_K1, hash_read8(p + 8) ^ seed);
+		a = hash_read8(p + i - 16);
+		b = hash_read8(p + i - 8);
+	}
+	a = hash_mix(a ^ HASH_K1, b ^ seed);
+	a = hash_mix(a ^ HASH_K2 ^ len, HASH_K1);
+	return a ? a : 1;
+}
+
+#endif
@@ -0,0 +1,227 @@
+/**
+ * @file hashset.c
+ * @brief Growable open-addressing set of unique words (Robin Hood probing)
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hashset.h"
+
+/** Home slot of a hash */
+#define HOME(hs, h) ((size_t)(h) & (hs)->mask)
+
+/** Distance of slot i from the home slot of hash h */
+#define DIST(hs, h, i) (((i) - HOME(hs, h)) & (hs)->mask)
+
+/**
+ * Allocates the slots array with n (power of two) empty slots.
+ *
+ * @param hs  pointer to hash set
+ * @param n  number of slots
+ */
+static void alloc_slots(hashset *hs, size_t n);
+
+/**
+ * Doubles the number of slots, reinserting all stored words.
+ *
+ * @param hs  pointer to hash set
+ */
+static void grow(hashset *hs);
+
+/**
+ * Places a word known to be absent starting the probe at slot i,
+ * at distance dist from its home, displacing richer entries.
+ *
+ * @param hs  pointer to hash set
+ * @param i  slot where the probe stopped
+ * @param dist  distance of slot i from the word home slot
+ * @param hash  word hash
+ * @param word  stored copy of the word
+ */
+static void place(hashset *hs, size_t i, size_t dist, uint64_t hash, char *word);
+
+/**
+ * Probes for the word. On return *pos holds the slot where the word is,
+ * or where the probe stopped (insertion point), and *pdist its distance.
+ *
+ * @return 1 if found, 0 otherwise
+ */
+static int probe(const hashset *hs, uint64_t hash, const char *word, size_t len,
+                 size_t *pos, size_t *pdist);
+
+static void alloc_slots(hashset *hs, size_t n)
+{
+	hs->slots = calloc(n, sizeof(slot_hs));
+	if (!hs->slots) {
+		perror("can't allocate hash set");
+		exit(1);
+	}
+	hs->mask = n - 1;
+	hs->limit = n / 8 * HASHSET_LOAD_NUM;
+}
+
+hashset* hashset_create(size_t expected)
+{
+	hashset *hs = calloc(1, sizeof(hashset));
+	size_t n = HASHSET_MIN_SLOTS;
+
+	if (!hs) {
+		perror("can't allocate hash set");
+		exit(1);
+	}
+	while (n / 8 * HASHSET_LOAD_NUM < expected)
+		n <<= 1;
+	alloc_slots(hs, n);
+	arena_init(&hs->words);
+	return hs;
+}
+
+static int probe(const hashset *hs, uint64_t hash, const char *word, size_t len,
+                 size_t *pos, size_t *pdist)
+{
+	size_t i = HOME(hs, hash), dist = 0;
+	slot_hs *s;
+
+	for (;; i = (i + 1) & hs->mask, dist++) {
+		s = &hs->slots[i];
+		/* empty slot, or an entry closer to home than we are: not present */
+		if (s->hash == 0 || DIST(hs, s->hash, i) < dist)
+			break;
+		if (s->hash == hash && ARENA_LEN(s->word) == len && memcmp(s->word, word, len) == 0)
+			break;
+	}
+	*pos = i;
+	*pdist = dist;
+	return s->hash == hash;
+}
+
+static void place(hashset *hs, size_t i, size_t dist, uint64_t hash, char *word)
+{
+	slot_hs *s, tmp;
+	size_t d;
+
+	for (;; i = (i + 1) & hs->mask, dist++) {
+		s = &hs->slots[i];
+		if (s->hash == 0) {
+			s->hash = hash;
+			s->word = word;
+			return;
+		}
+		/* Robin Hood: take the slot from an entry closer to its home */
+		d = DIST(hs, s->hash, i);
+		if (d < dist) {
+			tmp = *s;
+			s->hash = hash;
+			s->word = word;
+			hash = tmp.hash;
+			word = tmp.word;
+			dist = d;
+		}
+	}
+}
+
+static void grow(hashset *hs)
+{
+	slot_hs *old = hs->slots;
+	size_t n = hs->mask + 1;
+
+	alloc_slots(hs, n << 1);
+	for (size_t i = 0; i < n; i++) {
+		if (old[i].hash)
+			place(hs, HOME(hs, old[i].hash), 0, old[i].hash, old[i].word);
+	}
+	free(old);
+}
+
+void hashset_count_words(hashset *hs)
+{
+	hs->counted = 1;
+}
+
+int hashset_insert(hashset *hs, const char *word, size_t len)
+{
+	return hashset_insert_hash(hs, hash_function(word, len), word, len, NULL);
+}
+
+int hashset_insert_hash(hashset *hs, uint64_t hash, const char *word, size_t len,
+                        const char **stored)
+{
+	size_t i, dist;
+	char *copy;
+
+	if (probe(hs, hash, word, len, &i, &dist)) {
+		if (hs->counted)
+			hashset_hit(hs->slots[i].word);
+		if (stored)
+			*stored = hs->slots[i].word;
+		return 0;
+	}
+	if (hs->count >= hs->limit) {
+		grow(hs);
+		probe(hs, hash, word, len, &i, &dist);
+	}
+	if (hs->counted)
+		copy = arena_strdup_count(&hs->words, word, len);
+	else
+		copy = arena_strdup(&hs->words, word, len);
+	place(hs, i, dist, hash, copy);
+	hs->count++;
+	if (stored)
+		*stored = copy;
+	return 1;
+}
+
+const char* hashset_find(const hashset *hs, const char *word, size_t len)
+{
+	uint64_t hash = hash_function(word, len);
+	size_t i, dist;
+
+	if (probe(hs, hash, word, len, &i, &dist))
+		return hs->slots[i].word;
+	return NULL;
+}
+
+void hashset_clear(hashset *hs)
+{
+	/* back to the initial size, so a set emptied to bound its memory does not
+	   keep (and clear) the slots of all the words it held */
+	free(hs->slots);
+	alloc_slots(hs, HASHSET_MIN_SLOTS);
+	hs->count = 0;
+	arena_free(&hs->words);
+}
+
+size_t hashset_probes(const hashset *hs, size_t *max)
+{
+	size_t total = 0, d;
+
+	*max = 0;
+	for (size_t i = 0; i <= hs->mask; i++) {
+		if (!hs->slots[i].hash)
+			continue;
+		d = DIST(hs, hs->slots[i].hash, i) + 1;
+		total += d;
+		if (d > *max)
+			*max = d;
+	}
+	return total;
+}
+
+void hashset_print(const hashset *hs)
+{
+	for (size_t i = 0; i <= hs->mask; i++) {
+		if (hs->slots[i].hash)
+			printf("(%zu) \"%s\"\n", i, hs->slots[i].word);
+	}
+}
+
+void hashset_destroy(hashset *hs)
+{
+	arena_free(&hs->words);
+	free(hs->slots);
+	free(hs);
+}
@@ -0,0 +1,168 @@
+/**
+ * @file hashset.h
+ * @brief Growable open-addressing set of unique words
+ *
+ * Replaces the fixed size chained hash table previously used by wordharvest.
+ * Slots store the full hash of the word inline so most mismatches are rejected
+ * without touching the word bytes, and collisions are resolved with Robin Hood
+ * linear probing, keeping probe sequences short and in one or two cache lines.
+ * The table doubles its size when the load factor is reached. The words themselves
+ * live in an arena (see arena.h) owned by the set, length-prefixed, so inserting
+ * does not call malloc and equal hashes are confirmed by length before memcmp.
+ * A set can also count the occurrences of its words (see hashset_count_words),
+ * the counter being stored in the arena right before the length prefix.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef HASHSET_H
+#define HASHSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "hash.h"
+
+/** Initial number of slots (power of two) */
+#define HASHSET_MIN_SLOTS 1024
+
+/** Maximum load factor before growing, as a fraction of 8 (7/8) */
+#define HASHSET_LOAD_NUM 7
+
+/**
+ * @brief Struct for hash set slots.
+ */
+typedef struct _slot_hs {
+	uint64_t hash;	/* full word hash, 0 means empty slot */
+	char *word;	/* length-prefixed copy in the set arena */
+} slot_hs;
+
+/**
+ * @brief Struct for the open-addressing hash set.
+ */
+typedef struct _hashset {
+	slot_hs *slots;
+	size_t mask;	/* number of slots - 1 */
+	size_t count;	/* words stored */
+	size_t limit;	/* count that triggers growing */
+	int counted;	/* words carry an occurrence counter (ARENA_COUNT) */
+	arena words;	/* storage of the words */
+} hashset;
+
+/**
+ * Allocates a hash set sized to hold the expected number
+ * of words without growing.
+ *
+ * @param expected  expected number of unique words (0 for default)
+ *
+ * @return pointer to new hash set
+ */
+hashset* hashset_create(size_t expected);
+
+/**
+ * Makes the set count the occurrences of its words, each insertion of a
+ * word already present incrementing its counter. Must be called before
+ * the first insertion.
+ *
+ * @param hs  pointer to hash set
+ */
+void hashset_count_words(hashset *hs);
+
+/**
+ * Inserts the word in the hash set if it is not already there.
+ *
+ * @param hs  pointer to hash set
+ * @param word  string with word
+ * @param len  word length
+ *
+ * @return 1 if the word was new and inserted, 0 if already present
+ */
+int hashset_insert(hashset *hs, const char *word, size_t len);
+
+/**
+ * Inserts the word with an already computed hash_function value
+ * in the hash set if it is not already there.
+ *
+ * @param hs  pointer to hash set
+ * @param hash  word hash
+ * @param word  string with word
+ * @param len  word length
+ * @param stored  receives the stored copy of the word (can be NULL)
+ *
+ * @return 1 if the word was new and inserted, 0 if already present
+ */
+int hashset_insert_hash(hashset *hs, uint64_t hash, const char *word, size_t len,
+                        const char **stored);
+
+/**
+ * Counts one more occurrence of a word stored in a counting set. Safe to be
+ * called by several threads at once, the counter saturates at UINT32_MAX.
+ *
+ * @param stored  copy of the word stored in the set
+ */
+static inline void hashset_hit(const char *stored)
+{
+	uint32_t *c = &ARENA_COUNT(stored);
+
+	if (__atomic_load_n(c, __ATOMIC_RELAXED) != UINT32_MAX)
+		__atomic_fetch_add(c, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Finds the specified word in the hash set.
+ *
+ * @param hs  pointer to hash set
+ * @param word  string to be searched
+ * @param len  word length
+ *
+ * @return stored copy of the word, or NULL if not found
+ */
+const char* hashset_find(const hashset *hs, const char *word, size_t len);
+
+/**
+ * Memory used by the set: its slots and the bytes of its words.
+ *
+ * @param hs  pointer to hash set
+ *
+ * @return number of bytes
+ */
+static inline size_t hashset_memory(const hashset *hs)
+{
+	return (hs->mask + 1) * sizeof(slot_hs) + hs->words.used;
+}
+
+/**
+ * Removes all the words, unmapping their storage and shrinking the slots
+ * to the initial size.
+ *
+ * @param hs  pointer to hash set
+ */
+void hashset_clear(hashset *hs);
+
+/**
+ * Measures the probe lengths of the words stored: the slots read by a lookup
+ * finding each one (its distance from its home slot, plus one).
+ *
+ * @param hs  pointer to hash set
+ * @param max  receives the longest probe length
+ *
+ * @return sum of the probe lengths (divided by count, the mean)
+ */
+size_t hashset_probes(const hashset *hs, size_t *max);
+
+/**
+ * Prints all hash set entries with slot index.
+ *
+ * @param hs  pointer to hash set
+ */
+void hashset_print(const hashset *hs);
+
+/**
+ * Deallocates memory for the hash set and the words inside it.
+ *
+ * @param hs  pointer to hash set
+ */
+void hashset_destroy(hashset *hs);
+
+#endif
@@ -0,0 +1,36 @@
+/**
+ * @file lfqueue.c
+ * @brief Bounded lock-free queue for several producers and consumers
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "lfqueue.h"
+
+lfqueue* lfq_create(size_t cap)
+{
+	lfqueue *q = aligned_alloc(64, sizeof(lfqueue));
+	size_t n = 1;
+
+	while (n < cap)
+		n <<= 1;
+	if (!q || !(q->cells = malloc(n * sizeof(lfq_cell)))) {
+		perror("can't allocate queue");
+		exit(1);
+	}
+	/* cell i is free for the push at position i */
+	for (size_t i = 0; i < n; i++)
+		q->cells[i].seq = i;
+	q->mask = n - 1;
+	q->head = q->tail = 0;
+	return q;
+}
+
+void lfq_destroy(lfqueue *q)
+{
+	free(q->cells);
+	free(q);
+}
@@ -0,0 +1,135 @@
+/**
+ * @file lfqueue.h
+ * @brief Bounded lock-free queue for several producers and consumers
+ *
+ * Ring buffer of cells with sequence numbers (Vyukov's bounded MPMC queue): a
+ * producer claims the next cell by a compare-and-swap on the tail position, writes
+ * the item and publishes it bumping the cell sequence, a consumer does the same on
+ * the head side. No lock is taken, and a full (or empty) queue is reported to the
+ * caller, which decides how to wait (see lfq_backoff).
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef LFQUEUE_H
+#define LFQUEUE_H
+
+#include <stddef.h>
+#include <sched.h>
+#include <time.h>
+
+/**
+ * @brief Struct for a queue cell.
+ */
+typedef struct _lfq_cell {
+	size_t seq;
+	void *item;
+} lfq_cell;
+
+/**
+ * @brief Struct for the queue, positions in their own cache lines.
+ */
+typedef struct _lfqueue {
+	lfq_cell *cells;
+	size_t mask;	/* capacity - 1 (power of two) */
+	size_t head __attribute__((aligned(64)));	/* next cell to pop */
+	size_t tail __attribute__((aligned(64)));	/* next cell to push */
+} lfqueue;
+
+/**
+ * Allocates a queue. Exits on error.
+ *
+ * @param cap  capacity (rounded up to a power of two)
+ *
+ * @return pointer to new queue
+ */
+lfqueue* lfq_create(size_t cap);
+
+/**
+ * Deallocates the queue (items left are not freed).
+ *
+ * @param q  pointer to queue
+ */
+void lfq_destroy(lfqueue *q);
+
+/**
+ * Pushes an item at the tail of the queue.
+ *
+ * @param q  pointer to queue
+ * @param item  item (not NULL)
+ *
+ * @return 1 if pushed, 0 if the queue is full
+ */
+static inline int lfq_push(lfqueue *q, void *item)
+{
+	size_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED), seq;
+	lfq_cell *c;
+
+	for (;;) {
+		c = &q->cells[pos & q->mask];
+		seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1,
+			                                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if (seq < pos)	/* cell not popped yet since the last lap */
+			return 0;
+		else
+			pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	}
+	c->item = item;
+	__atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+/**
+ * Pops the item at the head of the queue.
+ *
+ * @param q  pointer to queue
+ *
+ * @return item, or NULL if the queue is empty
+ */
+static inline void* lfq_pop(lfqueue *q)
+{
+	size_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED), seq;
+	lfq_cell *c;
+	void *item;
+
+	for (;;) {
+		c = &q->cells[pos & q->mask];
+		seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+		if (seq == pos + 1) {
+			if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, 1,
+			                                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if (seq < pos + 1)	/* cell not pushed yet */
+			return NULL;
+		else
+			pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	}
+	item = c->item;
+	__atomic_store_n(&c->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+	return item;
+}
+
+/**
+ * Waits a little after a failed push or pop: yields the first times,
+ * then sleeps for increasing times (up to 1 ms).
+ *
+ * @param spins  pointer to number of failed attempts, reset by the caller on success
+ */
+static inline void lfq_backoff(unsigned *spins)
+{
+	struct timespec ts = { 0, 0 };
+
+	if (++*spins < 16) {
+		sched_yield();
+		return;
+	}
+	ts.tv_nsec = (*spins < 26 ? 1L << (*spins - 6) : 1L << 20);
+	nanosleep(&ts, NULL);
+}
+
+#endif
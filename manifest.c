@@ -0,0 +1,122 @@
+/**
+ * @file manifest.c
+ * @brief Manifest of the files harvested by an incremental run
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "manifest.h"
+
+/** Size of the line buffer kept on the stack (longer lines are allocated) */
+#define LINE_BUF 4096
+
+/**
+ * Inserts each line of the previous manifest in the set.
+ */
+static void load(manifest *m);
+
+static void load(manifest *m)
+{
+	struct stat st;
+	char *map, *p, *end, *nl;
+	int fd;
+
+	if ((fd = open(m->path, O_RDONLY | O_CLOEXEC)) < 0) {
+		if (errno != ENOENT) {
+			perror("can't open manifest file");
+			exit(1);
+		}
+		return;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		close(fd);
+		return;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("can't read manifest file");
+		exit(1);
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	end = map + st.st_size;
+	for (p = map; p < end; p = nl + 1) {
+		if (!(nl = memchr(p, '\n', end - p)))
+			nl = end;
+		if (nl > p)
+			hashset_insert(m->old, p, nl - p);
+	}
+	munmap(map, st.st_size);
+}
+
+manifest* manifest_open(const char *path, int load_old)
+{
+	manifest *m = calloc(1, sizeof(manifest));
+	size_t len = strlen(path);
+
+	if (!m || !(m->path = strdup(path)) || !(m->tmp = malloc(len + 5))) {
+		perror("can't allocate manifest");
+		exit(1);
+	}
+	memcpy(m->tmp, path, len);
+	memcpy(m->tmp + len, ".tmp", 5);
+	m->old = hashset_create(0);
+	if (load_old)
+		load(m);
+	if (!(m->out = fopen(m->tmp, "w"))) {
+		perror("can't open manifest file");
+		exit(1);
+	}
+	pthread_mutex_init(&m->lock, NULL);
+	return m;
+}
+
+int manifest_check(manifest *m, const char *path, const struct stat *st)
+{
+	char buf[LINE_BUF], *line = buf;
+	int len, same;
+
+	/* a path with a line break can't be recorded: always harvested */
+	if (strchr(path, '\n'))
+		return 0;
+	len = snprintf(buf, sizeof(buf), "%ju %jd %jd.%09ld %s", (uintmax_t)st->st_ino,
+	               (intmax_t)st->st_size, (intmax_t)st->st_mtim.tv_sec, st->st_mtim.tv_nsec, path);
+	if (len >= LINE_BUF) {
+		if (!(line = malloc(len + 1))) {
+			perror("can't allocate manifest");
+			exit(1);
+		}
+		snprintf(line, len + 1, "%ju %jd %jd.%09ld %s", (uintmax_t)st->st_ino,
+		         (intmax_t)st->st_size, (intmax_t)st->st_mtim.tv_sec, st->st_mtim.tv_nsec, path);
+	}
+	same = hashset_find(m->old, line, len) != NULL;
+	pthread_mutex_lock(&m->lock);
+	fwrite(line, 1, len, m->out);
+	fputc('\n', m->out);
+	pthread_mutex_unlock(&m->lock);
+	if (line != buf)
+		free(line);
+	return same;
+}
+
+void manifest_close(manifest *m)
+{
+	if (ferror(m->out) | fclose(m->out) || rename(m->tmp, m->path) < 0) {
+		perror("can't write manifest file");
+		exit(1);
+	}
+	pthread_mutex_destroy(&m->lock);
+	hashset_destroy(m->old);
+	free(m->path);
+	free(m->tmp);
+	free(m);
+}
@@ -0,0 +1,65 @@
+/**
+ * @file manifest.h
+ * @brief Manifest of the files harvested by an incremental run
+ *
+ * One line per file: inode, size, modification time (seconds.nanoseconds)
+ * and path. The lines of the previous manifest are kept in a hash set (see
+ * hashset.h), so a file is unchanged when the line built from its current
+ * stat is in the set. The new manifest is written to a temporary file while
+ * harvesting and replaces the previous one when closed.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "hashset.h"
+
+/**
+ * @brief Struct for the manifest.
+ */
+typedef struct _manifest {
+	hashset *old;	/* lines of the previous manifest */
+	FILE *out;	/* new manifest (temporary file) */
+	char *path;
+	char *tmp;
+	pthread_mutex_t lock;	/* out */
+} manifest;
+
+/**
+ * Loads the previous manifest (if asked and present) and creates
+ * the new one. Exits on error.
+ *
+ * @param path  string with manifest file name
+ * @param load_old  1 to load the previous manifest, 0 to start empty
+ *
+ * @return pointer to new manifest
+ */
+manifest* manifest_open(const char *path, int load_old);
+
+/**
+ * Records the file in the new manifest (safe from several threads)
+ * and checks it against the previous one.
+ *
+ * @param m  pointer to manifest
+ * @param path  string with file path
+ * @param st  pointer to file stat
+ *
+ * @return 1 if unchanged since the previous run, 0 otherwise
+ */
+int manifest_check(manifest *m, const char *path, const struct stat *st);
+
+/**
+ * Replaces the previous manifest with the new one and deallocates it.
+ * Exits on error.
+ *
+ * @param m  pointer to manifest
+ */
+void manifest_close(manifest *m);
+
+#endif
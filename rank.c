@@ -0,0 +1,99 @@
+/**
+ * @file rank.c
+ * @brief Ordering of harvested words by descending frequency
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "rank.h"
+#include "arena.h"
+
+/**
+ * @brief Struct for a word being ranked.
+ */
+typedef struct _ranked {
+	const char *word;
+	uint32_t count;
+	size_t seen;	/* position in first-seen order */
+} ranked;
+
+/**
+ * Checks if a ranks before b (more frequent, or as frequent and seen first).
+ */
+static int before(const ranked *a, const ranked *b);
+
+/**
+ * qsort comparison function, most frequent first.
+ */
+static int cmp_ranked(const void *a, const void *b);
+
+/**
+ * Moves the entry i of the min-heap down to its place (the root is the entry
+ * ranking last, the first to be replaced).
+ */
+static void sift_down(ranked *h, size_t n, size_t i);
+
+static int before(const ranked *a, const ranked *b)
+{
+	return a->count > b->count || (a->count == b->count && a->seen < b->seen);
+}
+
+static int cmp_ranked(const void *a, const void *b)
+{
+	return before(a, b) ? -1 : before(b, a);
+}
+
+static void sift_down(ranked *h, size_t n, size_t i)
+{
+	size_t c;
+	ranked tmp;
+
+	for (; (c = 2 * i + 1) < n; i = c) {
+		if (c + 1 < n && before(&h[c], &h[c + 1]))
+			c++;
+		if (!before(&h[i], &h[c]))
+			break;
+		tmp = h[i];
+		h[i] = h[c];
+		h[c] = tmp;
+	}
+}
+
+size_t rank_words(const char **words, size_t n, size_t top)
+{
+	size_t k = (top && top < n) ? top : n;
+	ranked *r = malloc((k ? k : 1) * sizeof(ranked)), e;
+
+	if (!r) {
+		perror("can't allocate word ranking");
+		exit(1);
+	}
+	for (size_t i = 0; i < k; i++) {
+		r[i].word = words[i];
+		r[i].count = ARENA_COUNT(words[i]);
+		r[i].seen = i;
+	}
+	/* the rest of the words only enter the heap if they beat its last entry */
+	if (k < n) {
+		for (size_t i = k / 2; i-- > 0;)
+			sift_down(r, k, i);
+		for (size_t i = k; i < n; i++) {
+			e.word = words[i];
+			e.count = ARENA_COUNT(words[i]);
+			e.seen = i;
+			if (before(&e, &r[0])) {
+				r[0] = e;
+				sift_down(r, k, 0);
+			}
+		}
+	}
+	qsort(r, k, sizeof(ranked), cmp_ranked);
+	for (size_t i = 0; i < k; i++)
+		words[i] = r[i].word;
+	free(r);
+	return k;
+}
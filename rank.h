@@ -0,0 +1,30 @@
+/**
+ * @file rank.h
+ * @brief Ordering of harvested words by descending frequency
+ *
+ * The words are the copies stored in a counting set (see hashset_count_words),
+ * so the occurrence count of each one is read from the arena (ARENA_COUNT).
+ * Words with the same count keep the order they were received in (first seen
+ * first). Keeping only the most frequent words uses a min-heap of that size,
+ * so the whole list is never sorted.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef RANK_H
+#define RANK_H
+
+#include <stddef.h>
+
+/**
+ * Reorders the words by descending occurrence count.
+ *
+ * @param words  words stored in a counting set, in first-seen order
+ * @param n  number of words
+ * @param top  number of most frequent words to keep, 0 to keep all
+ *
+ * @return number of words kept at the start of the array
+ */
+size_t rank_words(const char **words, size_t n, size_t top);
+
+#endif
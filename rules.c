@@ -0,0 +1,395 @@
+/**
+ * @file rules.c
+ * @brief Candidate mangling rules (subset of the hashcat / John the Ripper syntax)
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rules.h"
+
+/** ASCII case helpers (other bytes are left alone) */
+#define IS_LOWER(c) ((c) >= 'a' && (c) <= 'z')
+#define IS_UPPER(c) ((c) >= 'A' && (c) <= 'Z')
+#define LOWER(c) (IS_UPPER(c) ? (c) | 0x20 : (c))
+#define UPPER(c) (IS_LOWER(c) ? (c) & ~0x20 : (c))
+#define TOGGLE(c) ((IS_LOWER(c) || IS_UPPER(c)) ? (c) ^ 0x20 : (c))
+
+/** Swaps two chars of the candidate */
+#define SWAP(s, i, j) do { char t_ = (s)[i]; (s)[i] = (s)[j]; (s)[j] = t_; } while (0)
+
+/**
+ * Operands of a rule function: 'N' for a position, 'X' for a char.
+ *
+ * @param op  function char
+ *
+ * @return operands string, NULL if the function is unknown
+ */
+static const char* operands(char op);
+
+/**
+ * Converts a position char ('0'-'9', 'A'-'Z').
+ *
+ * @return position, or -1 if invalid
+ */
+static int position(char c);
+
+static const char* operands(char op)
+{
+	switch (op) {
+		case ':': case 'l': case 'u': case 'c': case 'C': case 't': case 'E':
+		case 'r': case 'd': case 'f': case '{': case '}': case 'q': case '[':
+		case ']': case 'k': case 'K':
+			return "";
+		case 'T': case 'p': case 'D': case '\'': case 'z': case 'Z': case 'y':
+		case 'Y': case '+': case '-': case 'L': case 'R': case '.': case ',':
+			return "N";
+		case '$': case '^': case '@':
+			return "X";
+		case 'x': case 'O': case '*':
+			return "NN";
+		case 'i': case 'o':
+			return "NX";
+		case 's':
+			return "XX";
+		default:
+			return NULL;
+	}
+}
+
+static int position(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A' + 10;
+	return -1;
+}
+
+int rule_compile(rule *r, const char *s, size_t len)
+{
+	const char *kinds;
+	unsigned char v[2];
+	size_t i = 0, k;
+	int p;
+
+	r->n = 0;
+	if (!(r->ops = malloc((len ? len : 1) * sizeof(rule_op)))) {
+		perror("can't allocate rule");
+		exit(1);
+	}
+	while (i < len) {
+		/* blanks between functions are ignored */
+		if (s[i] == ' ' || s[i] == '\t') {
+			i++;
+			continue;
+		}
+		if (!(kinds = operands(s[i])))
+			goto invalid;
+		r->ops[r->n].op = s[i++];
+		for (k = 0; kinds[k]; k++, i++) {
+			if (i == len)
+				goto invalid;
+			if (kinds[k] == 'N') {
+				if ((p = position(s[i])) < 0)
+					goto invalid;
+				v[k] = p;
+			}
+			else
+				v[k] = s[i];
+		}
+		r->ops[r->n].a = k > 0 ? v[0] : 0;
+		r->ops[r->n].b = k > 1 ? v[1] : 0;
+		r->n++;
+	}
+	return 0;
+
+invalid:
+	free(r->ops);
+	r->ops = NULL;
+	return -1;
+}
+
+size_t rule_apply(const rule *r, const char *word, size_t len, char *out)
+{
+	size_t n = len, N, M;
+	unsigned char c;
+
+	if (len > RULE_MAX)
+		return RULE_REJECT;
+	memcpy(out, word, len);
+	for (const rule_op *o = r->ops; o < r->ops + r->n; o++) {
+		N = o->a;
+		M = o->b;
+		switch (o->op) {
+			case 'l':
+				for (size_t i = 0; i < n; i++)
+					out[i] = LOWER(out[i]);
+				break;
+			case 'u':
+				for (size_t i = 0; i < n; i++)
+					out[i] = UPPER(out[i]);
+				break;
+			case 'c':
+				for (size_t i = 1; i < n; i++)
+					out[i] = LOWER(out[i]);
+				if (n)
+					out[0] = UPPER(out[0]);
+				break;
+			case 'C':
+				for (size_t i = 1; i < n; i++)
+					out[i] = UPPER(out[i]);
+				if (n)
+					out[0] = LOWER(out[0]);
+				break;
+			case 't':
+				for (size_t i = 0; i < n; i++)
+					out[i] = TOGGLE(out[i]);
+				break;
+			case 'T':
+				if (N < n)
+					out[N] = TOGGLE(out[N]);
+				break;
+			case 'E':
+				for (size_t i = 0; i < n; i++)
+					out[i] = (i == 0 || out[i - 1] == ' ') ? UPPER(out[i]) : LOWER(out[i]);
+				break;
+			case 'r':
+				for (size_t i = 0, j = n; i + 1 < j; i++, j--)
+					SWAP(out, i, j - 1);
+				break;
+			case 'd':
+				N = 1;
+				/* fallthrough */
+			case 'p':
+				if (n * (N + 1) > RULE_MAX)
+					return RULE_REJECT;
+				for (size_t k = 1; k <= N; k++)
+					memcpy(out + k * n, out, n);
+				n *= N + 1;
+				break;
+			case 'f':
+				if (2 * n > RULE_MAX)
+					return RULE_REJECT;
+				for (size_t i = 0; i < n; i++)
+					out[n + i] = out[n - 1 - i];
+				n *= 2;
+				break;
+			case '{':
+				if (n > 1) {
+					c = out[0];
+					memmove(out, out + 1, n - 1);
+					out[n - 1] = c;
+				}
+				break;
+			case '}':
+				if (n > 1) {
+					c = out[n - 1];
+					memmove(out + 1, out, n - 1);
+					out[0] = c;
+				}
+				break;
+			case 'q':
+				if (2 * n > RULE_MAX)
+					return RULE_REJECT;
+				for (size_t i = n; i-- > 0;)
+					out[2 * i] = out[2 * i + 1] = out[i];
+				n *= 2;
+				break;
+			case '$':
+				if (n == RULE_MAX)
+					return RULE_REJECT;
+				out[n++] = N;
+				break;
+			case '^':
+				if (n == RULE_MAX)
+					return RULE_REJECT;
+				memmove(out + 1, out, n++);
+				out[0] = N;
+				break;
+			case '[':
+				if (n)
+					memmove(out, out + 1, --n);
+				break;
+			case ']':
+				if (n)
+					n--;
+				break;
+			case 'D':
+				if (N < n) {
+					memmove(out + N, out + N + 1, n - N - 1);
+					n--;
+				}
+				break;
+			case '\'':
+				if (N < n)
+					n = N;
+				break;
+			case 'x':
+				if (N < n) {
+					M = M < n - N ? M : n - N;
+					memmove(out, out + N, M);
+					n = M;
+				}
+				break;
+			case 'O':
+				if (N < n) {
+					M = M < n - N ? M : n - N;
+					memmove(out + N, out + N + M, n - N - M);
+					n -= M;
+				}
+				break;
+			case 'i':
+				if (N <= n) {
+					if (n == RULE_MAX)
+						return RULE_REJECT;
+					memmove(out + N + 1, out + N, n - N);
+					out[N] = M;
+					n++;
+				}
+				break;
+			case 'o':
+				if (N < n)
+					out[N] = M;
+				break;
+			case 's':
+				for (size_t i = 0; i < n; i++)
+					if ((unsigned char)out[i] == N)
+						out[i] = M;
+				break;
+			case '@':
+				M = 0;
+				for (size_t i = 0; i < n; i++)
+					if ((unsigned char)out[i] != N)
+						out[M++] = out[i];
+				n = M;
+				break;
+			case 'z':
+				if (n) {
+					if (n + N > RULE_MAX)
+						return RULE_REJECT;
+					memmove(out + N, out, n);
+					memset(out, out[N], N);
+					n += N;
+				}
+				break;
+			case 'Z':
+				if (n) {
+					if (n + N > RULE_MAX)
+						return RULE_REJECT;
+					memset(out + n, out[n - 1], N);
+					n += N;
+				}
+				break;
+			case 'y':
+				if (N <= n) {
+					if (n + N > RULE_MAX)
+						return RULE_REJECT;
+					memmove(out + N, out, n);
+					n += N;
+				}
+				break;
+			case 'Y':
+				if (N <= n) {
+					if (n + N > RULE_MAX)
+						return RULE_REJECT;
+					memcpy(out + n, out + n - N, N);
+					n += N;
+				}
+				break;
+			case 'k':
+				if (n > 1)
+					SWAP(out, 0, 1);
+				break;
+			case 'K':
+				if (n > 1)
+					SWAP(out, n - 2, n - 1);
+				break;
+			case '*':
+				if (N < n && M < n)
+					SWAP(out, N, M);
+				break;
+			case '+':
+				if (N < n)
+					out[N]++;
+				break;
+			case '-':
+				if (N < n)
+					out[N]--;
+				break;
+			case 'L':
+				if (N < n)
+					out[N] = (unsigned char)out[N] << 1;
+				break;
+			case 'R':
+				if (N < n)
+					out[N] = (unsigned char)out[N] >> 1;
+				break;
+			case '.':
+				if (N + 1 < n)
+					out[N] = out[N + 1];
+				break;
+			case ',':
+				if (N >= 1 && N < n)
+					out[N] = out[N - 1];
+				break;
+			default:	/* ':' */
+				break;
+		}
+	}
+	return n;
+}
+
+rule_set* rules_load(const char *path)
+{
+	rule_set *rs = calloc(1, sizeof(rule_set));
+	FILE *f = fopen(path, "r");
+	char *line = NULL;
+	size_t cap = 0, nline = 0, alloc = 0;
+	ssize_t len;
+
+	if (!f) {
+		perror("can't open rules file");
+		exit(1);
+	}
+	if (!rs) {
+		perror("can't allocate rules");
+		exit(1);
+	}
+	while ((len = getline(&line, &cap, f)) >= 0) {
+		nline++;
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			len--;
+		if (len == 0 || line[0] == '#')
+			continue;
+		if (rs->n == alloc) {
+			alloc = alloc ? 2 * alloc : 64;
+			if (!(rs->rules = realloc(rs->rules, alloc * sizeof(rule)))) {
+				perror("can't allocate rules");
+				exit(1);
+			}
+		}
+		if (rule_compile(&rs->rules[rs->n], line, len) < 0)
+			fprintf(stderr, "skipping invalid rule at line %zu of %s\n", nline, path);
+		else
+			rs->n++;
+	}
+	free(line);
+	fclose(f);
+	if (rs->n == 0) {
+		fprintf(stderr, "no valid rules in %s\n", path);
+		exit(1);
+	}
+	return rs;
+}
+
+void rules_free(rule_set *rs)
+{
+	for (size_t i = 0; i < rs->n; i++)
+		free(rs->rules[i].ops);
+	free(rs->rules);
+	free(rs);
+}
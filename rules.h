@@ -0,0 +1,106 @@
+/**
+ * @file rules.h
+ * @brief Candidate mangling rules (subset of the hashcat / John the Ripper syntax)
+ *
+ * A rules file has one rule per line (empty lines and lines starting with '#'
+ * are skipped), each rule a sequence of functions applied in order to the base
+ * word, ':' being the word unchanged. Positions N and M are '0'-'9' then 'A'-'Z'
+ * (10 to 35), X and Y are chars.
+ *   :  nothing             l  lowercase           u  uppercase
+ *   c  capitalize          C  invert capitalize   t  toggle case
+ *   TN toggle at N         E  title case          r  reverse
+ *   d  duplicate           pN append N copies     f  reflect
+ *   {  rotate left         }  rotate right        q  duplicate every char
+ *   $X append X            ^X prepend X           [  delete first
+ *   ]  delete last         DN delete at N         'N truncate at N
+ *   xNM extract M from N   ONM omit M from N      iNX insert X at N
+ *   oNX overwrite at N     sXY replace X by Y     @X purge X
+ *   zN duplicate first N times                    ZN duplicate last N times
+ *   yN duplicate first N chars                    YN duplicate last N chars
+ *   k  swap first two      K  swap last two       *NM swap at N and M
+ *   +N increment at N      -N decrement at N      LN shift left at N
+ *   RN shift right at N    .N replace N by N+1    ,N replace N by N-1
+ * Functions out of the word bounds leave it unchanged (like hashcat), and
+ * candidates longer than RULE_MAX are rejected. Rules are compiled once, so
+ * applying one is a loop over a few opcodes writing into a caller buffer.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef RULES_H
+#define RULES_H
+
+#include <stddef.h>
+
+/** Maximum candidate length produced by a rule */
+#define RULE_MAX 256
+
+/** rule_apply result for rejected candidates */
+#define RULE_REJECT ((size_t)-1)
+
+/**
+ * @brief Struct for a rule function with its operands.
+ */
+typedef struct _rule_op {
+	char op;
+	unsigned char a;
+	unsigned char b;
+} rule_op;
+
+/**
+ * @brief Struct for a compiled rule.
+ */
+typedef struct _rule {
+	rule_op *ops;
+	size_t n;
+} rule;
+
+/**
+ * @brief Struct for the rules of a rules file.
+ */
+typedef struct _rule_set {
+	rule *rules;
+	size_t n;
+} rule_set;
+
+/**
+ * Reads and compiles the rules file, skipping invalid rules with
+ * a message. Exits on error.
+ *
+ * @param path  string with rules file name
+ *
+ * @return pointer to new rule set
+ */
+rule_set* rules_load(const char *path);
+
+/**
+ * Compiles one rule.
+ *
+ * @param r  pointer to rule filled on success
+ * @param s  rule text
+ * @param len  rule text length
+ *
+ * @return 0 on success, -1 if invalid
+ */
+int rule_compile(rule *r, const char *s, size_t len);
+
+/**
+ * Applies the rule to a word.
+ *
+ * @param r  pointer to rule
+ * @param word  base word chars (not NUL-terminated)
+ * @param len  word length
+ * @param out  buffer of RULE_MAX bytes receiving the candidate
+ *
+ * @return candidate length, or RULE_REJECT
+ */
+size_t rule_apply(const rule *r, const char *word, size_t len, char *out);
+
+/**
+ * Deallocates memory for the rule set.
+ *
+ * @param rs  pointer to rule set
+ */
+void rules_free(rule_set *rs);
+
+#endif
@@ -0,0 +1,216 @@
+/**
+ * @file setfile.c
+ * @brief Serialized set of unique words, mapped read-only
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "setfile.h"
+
+/** Rounds up to the section alignment */
+#define SET_ROUND(x) (((x) + SET_ALIGN - 1) & ~(uint64_t)(SET_ALIGN - 1))
+
+/** Size of a word in the words section (prefix, chars and NUL, 4 byte aligned) */
+#define WORD_SIZE(len) (((sizeof(uint32_t) + (len) + 1) + 3) & ~(size_t)3)
+
+/**
+ * @brief Struct for the table being built by setfile_write.
+ */
+typedef struct _set_build {
+	set_slot *slots;
+	size_t mask;
+	uint64_t off;	/* offset of the next word prefix */
+	bloom_block *filter;
+	size_t filter_mask;
+} set_build;
+
+/**
+ * Places the word in the table (Robin Hood, like hashset.c)
+ * and gives it the next offset of the words section.
+ */
+static void place(set_build *sb, uint64_t hash, size_t len);
+
+/**
+ * Writes the word with its prefix and padding.
+ */
+static void put_word(FILE *f, const char *word, size_t len);
+
+static void place(set_build *sb, uint64_t hash, size_t len)
+{
+	set_slot e = { hash, sb->off + sizeof(uint32_t) }, tmp;
+	size_t i = hash & sb->mask, dist = 0, d;
+
+	sb->off += WORD_SIZE(len);
+	bloom_add(sb->filter, sb->filter_mask, hash);
+	for (;; i = (i + 1) & sb->mask, dist++) {
+		if (sb->slots[i].hash == 0) {
+			sb->slots[i] = e;
+			return;
+		}
+		d = (i - sb->slots[i].hash) & sb->mask;
+		if (d < dist) {
+			tmp = sb->slots[i];
+			sb->slots[i] = e;
+			e = tmp;
+			dist = d;
+		}
+	}
+}
+
+static void put_word(FILE *f, const char *word, size_t len)
+{
+	static const char zeros[4];
+	uint32_t l = len;
+
+	fwrite(&l, sizeof(l), 1, f);
+	fwrite(word, 1, len, f);
+	fwrite(zeros, 1, WORD_SIZE(len) - sizeof(uint32_t) - len, f);
+}
+
+int setfile_open(const char *path, setfile *sf)
+{
+	const set_header *hdr;
+	size_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t lo;
+	struct stat st;
+	int fd;
+
+	memset(sf, 0, sizeof(*sf));
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+		if (errno == ENOENT)
+			return 0;
+		perror("can't open set file");
+		return -1;
+	}
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(set_header))
+		goto invalid;
+	sf->size = st.st_size;
+	sf->map = mmap(NULL, sf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (sf->map == MAP_FAILED) {
+		sf->map = NULL;
+		goto invalid;
+	}
+	hdr = (const set_header *)sf->map;
+	if (memcmp(hdr->magic, SET_MAGIC, 8) || hdr->version < 1 || hdr->version > SET_VERSION ||
+	    hdr->size != sf->size || !hdr->nslots || (hdr->nslots & (hdr->nslots - 1)) ||
+	    hdr->nwords > hdr->nslots || hdr->slots_off > sf->size ||
+	    hdr->nslots > (sf->size - hdr->slots_off) / sizeof(set_slot) || hdr->words_off > sf->size)
+		goto invalid;
+	if (hdr->version > 1 && hdr->filter_off &&
+	    (hdr->filter_log > 40 || hdr->filter_off > sf->size ||
+	     (1ULL << hdr->filter_log) > (sf->size - hdr->filter_off) / sizeof(bloom_block)))
+		goto invalid;
+	/* the words are only touched when probed */
+	madvise((void *)sf->map, sf->size, MADV_RANDOM);
+	/* unlike the filter, probed by every lookup */
+	if (hdr->version > 1 && hdr->filter_off) {
+		sf->filter = (const bloom_block *)(sf->map + hdr->filter_off);
+		sf->filter_mask = (1ULL << hdr->filter_log) - 1;
+		lo = (uintptr_t)sf->filter & ~(page - 1);
+		madvise((void *)lo, (uintptr_t)(sf->filter + sf->filter_mask + 1) - lo, MADV_WILLNEED);
+	}
+	sf->slots = (const set_slot *)(sf->map + hdr->slots_off);
+	sf->mask = hdr->nslots - 1;
+	sf->nwords = hdr->nwords;
+	sf->words = (const char *)sf->map + hdr->words_off;
+	sf->words_size = sf->size - hdr->words_off;
+	close(fd);
+	return 0;
+
+invalid:
+	fprintf(stderr, "invalid set file %s\n", path);
+	close(fd);
+	setfile_close(sf);
+	return -1;
+}
+
+void setfile_close(setfile *sf)
+{
+	if (sf->map)
+		munmap((void *)sf->map, sf->size);
+	memset(sf, 0, sizeof(*sf));
+}
+
+void setfile_write(const char *path, const setfile *old, hashset *const *sets, size_t nsets)
+{
+	static const char zeros[SET_ALIGN];
+	size_t total = old->nwords, n = HASHSET_MIN_SLOTS, len = strlen(path), blocks;
+	set_header hdr = { .version = SET_VERSION };
+	set_build sb = { 0 };
+	char *tmp = malloc(len + 5);
+	const char *w;
+	FILE *f;
+
+	for (size_t k = 0; k < nsets; k++)
+		total += sets[k]->count;
+	while (n / 8 * HASHSET_LOAD_NUM < total)
+		n <<= 1;
+	blocks = bloom_blocks(total);
+	if (!tmp || !(sb.slots = calloc(n, sizeof(set_slot))) || !(sb.filter = calloc(blocks, sizeof(bloom_block)))) {
+		perror("can't allocate set file");
+		exit(1);
+	}
+	sb.mask = n - 1;
+	sb.filter_mask = blocks - 1;
+	/* first pass places the words, the second one writes them in the same order */
+	for (size_t i = 0; old->nwords && i <= old->mask; i++)
+		if (old->slots[i].hash)
+			place(&sb, old->slots[i].hash, ARENA_LEN(old->words + old->slots[i].off));
+	for (size_t k = 0; k < nsets; k++)
+		for (size_t i = 0; i <= sets[k]->mask; i++)
+			if (sets[k]->slots[i].hash)
+				place(&sb, sets[k]->slots[i].hash, ARENA_LEN(sets[k]->slots[i].word));
+
+	memcpy(hdr.magic, SET_MAGIC, sizeof(hdr.magic));
+	hdr.nwords = total;
+	hdr.nslots = n;
+	hdr.slots_off = SET_ROUND(sizeof(set_header));
+	hdr.filter_off = SET_ROUND(hdr.slots_off + n * sizeof(set_slot));
+	while ((1ULL << hdr.filter_log) < blocks)
+		hdr.filter_log++;
+	hdr.words_off = SET_ROUND(hdr.filter_off + blocks * sizeof(bloom_block));
+	hdr.size = SET_ROUND(hdr.words_off + sb.off);
+	memcpy(tmp, path, len);
+	memcpy(tmp + len, ".tmp", 5);
+	if (!(f = fopen(tmp, "w"))) {
+		perror("can't open set file");
+		exit(1);
+	}
+	fwrite(&hdr, sizeof(hdr), 1, f);
+	fwrite(sb.slots, sizeof(set_slot), n, f);
+	fwrite(zeros, 1, hdr.filter_off - hdr.slots_off - n * sizeof(set_slot), f);
+	fwrite(sb.filter, sizeof(bloom_block), blocks, f);
+	fwrite(zeros, 1, hdr.words_off - hdr.filter_off - blocks * sizeof(bloom_block), f);
+	for (size_t i = 0; old->nwords && i <= old->mask; i++) {
+		if (old->slots[i].hash) {
+			w = old->words + old->slots[i].off;
+			put_word(f, w, ARENA_LEN(w));
+		}
+	}
+	for (size_t k = 0; k < nsets; k++) {
+		for (size_t i = 0; i <= sets[k]->mask; i++) {
+			if (sets[k]->slots[i].hash) {
+				w = sets[k]->slots[i].word;
+				put_word(f, w, ARENA_LEN(w));
+			}
+		}
+	}
+	/* pad the words section, so the file size is the one in the header */
+	fwrite(zeros, 1, hdr.size - hdr.words_off - sb.off, f);
+	if (ferror(f) | fclose(f) || rename(tmp, path) < 0) {
+		perror("can't write set file");
+		exit(1);
+	}
+	free(sb.slots);
+	free(sb.filter);
+	free(tmp);
+}
@@ -0,0 +1,137 @@
+/**
+ * @file setfile.h
+ * @brief Serialized set of unique words, mapped read-only
+ *
+ * Layout (little endian, every section aligned to SET_ALIGN bytes):
+ *   header     magic, version, number of words and of slots
+ *   slots      open-addressing table (Robin Hood, like hashset.h) of
+ *              (hash, offset) pairs, hash 0 marking empty slots
+ *   filter     blocked Bloom filter of the hashes (see bloom.h, since version 2)
+ *   words      the words with the arena layout (32 bit length prefix, chars,
+ *              NUL, 4 byte aligned, see arena.h), offsets pointing at the chars
+ * The whole file is loaded with one mmap and probed in place, so the words of
+ * the previous runs are never rehashed or copied, and the stored copies can be
+ * used anywhere a set word is expected (ARENA_LEN works on them).
+ * Most words looked up by an incremental run are either repeats, found in the
+ * sets of the run before reaching this one, or new words: the filter, a small
+ * fraction of the file kept resident, rejects almost all of the new ones before
+ * their probe faults in a page of the table.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef SETFILE_H
+#define SETFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+#include "hashset.h"
+#include "bloom.h"
+
+/** File magic (8 bytes) and format version */
+#define SET_MAGIC "WHSET\r\n\032"
+#define SET_VERSION 2
+
+/** Alignment of the sections */
+#define SET_ALIGN 64
+
+/**
+ * @brief Struct for the file header.
+ */
+typedef struct _set_header {
+	char magic[8];
+	uint32_t version;	/* 1 for files with no filter */
+	uint32_t filter_log;	/* number of filter blocks, log2 */
+	uint64_t nwords;
+	uint64_t nslots;	/* power of two */
+	uint64_t slots_off;
+	uint64_t words_off;
+	uint64_t size;	/* file size */
+	uint64_t filter_off;	/* 0 for files with no filter */
+} set_header;
+
+/**
+ * @brief Struct for a table slot.
+ */
+typedef struct _set_slot {
+	uint64_t hash;	/* full word hash, 0 means empty slot */
+	uint64_t off;	/* offset of the word chars in the words section */
+} set_slot;
+
+/**
+ * @brief Struct for a mapped set (empty when the file does not exist).
+ */
+typedef struct _setfile {
+	const unsigned char *map;
+	size_t size;
+	const set_slot *slots;
+	const char *words;
+	size_t mask;	/* number of slots - 1 */
+	size_t nwords;
+	size_t words_size;
+	const bloom_block *filter;	/* NULL for files with no filter */
+	size_t filter_mask;	/* number of filter blocks - 1 */
+} setfile;
+
+/**
+ * Maps the set file. A missing file gives an empty set. Prints the reason to
+ * stderr on error.
+ *
+ * @param path  string with set file name
+ * @param sf  pointer to set filled on success
+ *
+ * @return 0 on success, -1 on error
+ */
+int setfile_open(const char *path, setfile *sf);
+
+/**
+ * Unmaps the set.
+ *
+ * @param sf  pointer to set
+ */
+void setfile_close(setfile *sf);
+
+/**
+ * Writes the union of the mapped set and of the hash sets in a new set file,
+ * replacing the previous one only once it is complete. Exits on error.
+ *
+ * @param path  string with set file name
+ * @param old  pointer to mapped set (its words are not in the hash sets)
+ * @param sets  hash sets with the new words
+ * @param nsets  number of hash sets
+ */
+void setfile_write(const char *path, const setfile *old, hashset *const *sets, size_t nsets);
+
+/**
+ * Finds the word in the mapped set (safe from several threads).
+ *
+ * @param sf  pointer to set
+ * @param hash  word hash (hash_function)
+ * @param word  string with word
+ * @param len  word length
+ *
+ * @return stored copy of the word, or NULL if not found
+ */
+static inline const char* setfile_find(const setfile *sf, uint64_t hash, const char *word, size_t len)
+{
+	size_t i, dist;
+	const set_slot *s;
+	const char *w;
+
+	if (!sf->nwords || (sf->filter && !bloom_find(sf->filter, sf->filter_mask, hash)))
+		return NULL;
+	for (i = hash & sf->mask, dist = 0;; i = (i + 1) & sf->mask, dist++) {
+		s = &sf->slots[i];
+		/* empty slot, or an entry closer to home than we are: not present */
+		if (s->hash == 0 || ((i - s->hash) & sf->mask) < dist)
+			return NULL;
+		w = sf->words + s->off;
+		if (s->hash == hash && ARENA_LEN(w) == len && memcmp(w, word, len) == 0)
+			return w;
+	}
+}
+
+#endif
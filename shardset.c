@@ -0,0 +1,78 @@
+/**
+ * @file shardset.c
+ * @brief Concurrent set of unique words, sharded by hash prefix
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "shardset.h"
+
+/** Shards per thread, and bounds on the number of shards (log2) */
+#define SHARDS_PER_THREAD 8
+#define MIN_SHARD_BITS 4
+#define MAX_SHARD_BITS 10
+
+shardset* shardset_create(int nthreads)
+{
+	shardset *ss = calloc(1, sizeof(shardset));
+	size_t n;
+
+	if (!ss) {
+		perror("can't allocate hash set");
+		exit(1);
+	}
+	ss->bits = MIN_SHARD_BITS;
+	while (ss->bits < MAX_SHARD_BITS && (1UL << ss->bits) < (size_t)nthreads * SHARDS_PER_THREAD)
+		ss->bits++;
+	n = 1UL << ss->bits;
+	if (posix_memalign((void **)&ss->shards, 64, n * sizeof(shard_ss)) != 0) {
+		perror("can't allocate hash set");
+		exit(1);
+	}
+	for (size_t i = 0; i < n; i++) {
+		pthread_mutex_init(&ss->shards[i].lock, NULL);
+		ss->shards[i].hs = hashset_create(0);
+	}
+	return ss;
+}
+
+int shardset_insert(shardset *ss, uint64_t hash, const char *word, size_t len,
+                    const char **stored)
+{
+	shard_ss *sh = &ss->shards[hash >> (64 - ss->bits)];
+	int new;
+
+	pthread_mutex_lock(&sh->lock);
+	new = hashset_insert_hash(sh->hs, hash, word, len, stored);
+	pthread_mutex_unlock(&sh->lock);
+	return new;
+}
+
+size_t shardset_count(const shardset *ss)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < (1UL << ss->bits); i++)
+		count += ss->shards[i].hs->count;
+	return count;
+}
+
+void shardset_count_words(shardset *ss)
+{
+	for (size_t i = 0; i < (1UL << ss->bits); i++)
+		hashset_count_words(ss->shards[i].hs);
+}
+
+void shardset_destroy(shardset *ss)
+{
+	for (size_t i = 0; i < (1UL << ss->bits); i++) {
+		pthread_mutex_destroy(&ss->shards[i].lock);
+		hashset_destroy(ss->shards[i].hs);
+	}
+	free(ss->shards);
+	free(ss);
+}
@@ -0,0 +1,143 @@
+/**
+ * @file shardset.h
+ * @brief Concurrent set of unique words, sharded by hash prefix
+ *
+ * The set is split in shards, each one a hash set (see hashset.h) with its own
+ * lock, chosen by the high bits of the word hash (the shard tables use the low
+ * bits), so threads inserting different words rarely wait on each other. Only
+ * the thread whose insertion finds the word absent gets a "new word" result,
+ * so each word is emitted exactly once.
+ *
+ * Each thread also keeps a small cache of recently seen words pointing to the
+ * copies stored in the set, so frequent words are rejected without taking any
+ * shard lock.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef SHARDSET_H
+#define SHARDSET_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "hashset.h"
+
+/** Number of entries of the per-thread recent words cache (power of two) */
+#define RECENT_SLOTS 4096
+
+/**
+ * @brief Struct for a shard, aligned so locks don't share cache lines.
+ */
+typedef struct _shard_ss {
+	pthread_mutex_t lock;
+	hashset *hs;
+} __attribute__((aligned(64))) shard_ss;
+
+/**
+ * @brief Struct for the sharded set.
+ */
+typedef struct _shardset {
+	shard_ss *shards;
+	unsigned bits;	/* log2 of the number of shards */
+} shardset;
+
+/**
+ * @brief Struct for recent words cache entries.
+ */
+typedef struct _recent_rc {
+	uint64_t hash;
+	const char *word;	/* copy stored in the set (length-prefixed) */
+} recent_rc;
+
+/**
+ * @brief Struct for the per-thread recent words cache (direct-mapped).
+ */
+typedef struct _recent_cache {
+	recent_rc slots[RECENT_SLOTS];
+} recent_cache;
+
+/**
+ * Allocates a sharded set with enough shards for the number of threads.
+ *
+ * @param nthreads  number of threads using the set
+ *
+ * @return pointer to new sharded set
+ */
+shardset* shardset_create(int nthreads);
+
+/**
+ * Inserts the word in its shard if it is not already there.
+ *
+ * @param ss  pointer to sharded set
+ * @param hash  word hash (hash_function)
+ * @param word  string with word
+ * @param len  word length
+ * @param stored  receives the stored copy of the word
+ *
+ * @return 1 if the word was new and inserted by this call, 0 if already present
+ */
+int shardset_insert(shardset *ss, uint64_t hash, const char *word, size_t len,
+                    const char **stored);
+
+/**
+ * Number of words in the set (not synchronized, call when threads are done).
+ *
+ * @param ss  pointer to sharded set
+ *
+ * @return number of words
+ */
+size_t shardset_count(const shardset *ss);
+
+/**
+ * Makes every shard count the occurrences of its words (see
+ * hashset_count_words). Must be called before the first insertion.
+ *
+ * @param ss  pointer to sharded set
+ */
+void shardset_count_words(shardset *ss);
+
+/**
+ * Deallocates memory for the sharded set and the words inside it.
+ *
+ * @param ss  pointer to sharded set
+ */
+void shardset_destroy(shardset *ss);
+
+/**
+ * Checks if the word is in the recent words cache.
+ *
+ * @param rc  pointer to recent words cache
+ * @param hash  word hash
+ * @param word  string with word
+ * @param len  word length
+ *
+ * @return copy of the word stored in the set if found, NULL otherwise
+ */
+static inline const char* recent_find(const recent_cache *rc, uint64_t hash, const char *word, size_t len)
+{
+	const recent_rc *e = &rc->slots[hash & (RECENT_SLOTS - 1)];
+
+	if (e->hash == hash && ARENA_LEN(e->word) == len && memcmp(e->word, word, len) == 0)
+		return e->word;
+	return NULL;
+}
+
+/**
+ * Stores a word known to be in the set in the recent words cache.
+ *
+ * @param rc  pointer to recent words cache
+ * @param hash  word hash
+ * @param stored  copy of the word stored in the set
+ */
+static inline void recent_add(recent_cache *rc, uint64_t hash, const char *stored)
+{
+	recent_rc *e = &rc->slots[hash & (RECENT_SLOTS - 1)];
+
+	e->hash = hash;
+	e->word = stored;
+}
+
+#endif
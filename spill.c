@@ -0,0 +1,276 @@
+/**
+ * @file spill.c
+ * @brief External-memory dedup: runs partitioned by hash, dedup'd in parallel
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "spill.h"
+#include "hashset.h"
+#include "workqueue.h"
+#include "writer.h"
+
+/**
+ * @brief Struct for the work queue items of spill_finish: a run.
+ */
+typedef struct _run {
+	char *path;
+	int bits;	/* top hash bits shared by the words of the run */
+} run;
+
+/**
+ * @brief Struct for the context of the threads of spill_finish.
+ */
+typedef struct _finish_ctx {
+	writer *w;
+	outbuf **out;	/* batch of each thread */
+	size_t budget;	/* memory of each thread */
+} finish_ctx;
+
+/**
+ * Allocates a run item.
+ *
+ * @param path  string with run file name (copied)
+ * @param bits  top hash bits shared by the words of the run
+ *
+ * @return pointer to new item
+ */
+static run* new_run(const char *path, int bits);
+
+/**
+ * Splits a run by the next bits of the word hashes, in as many runs (up to
+ * SPILL_PARTS) as needed to fit in the memory of a thread, queueing the non
+ * empty ones.
+ *
+ * @param wq  pointer to work queue
+ * @param id  worker index
+ * @param r  pointer to run
+ * @param map  run contents
+ * @param size  run size
+ * @param budget  memory of a thread
+ */
+static void split_run(workqueue *wq, int id, const run *r, const char *map, size_t size,
+                      size_t budget);
+
+/**
+ * Writes the unique words of a run to the output file.
+ *
+ * @param fc  pointer to threads context
+ * @param id  worker index
+ * @param map  run contents
+ * @param size  run size
+ */
+static void dedup_run(finish_ctx *fc, int id, const char *map, size_t size);
+
+/**
+ * Work queue callback: dedups a run, or splits it if too big for the
+ * memory of a thread, then removes it.
+ */
+static void finish_run(workqueue *wq, int id, void *item, void *ctx);
+
+static run* new_run(const char *path, int bits)
+{
+	run *r = malloc(sizeof(run));
+
+	if (!r || !(r->path = strdup(path))) {
+		perror("can't allocate spill run");
+		exit(1);
+	}
+	r->bits = bits;
+	return r;
+}
+
+static void split_run(workqueue *wq, int id, const run *r, const char *map, size_t size,
+                      size_t budget)
+{
+	char path[strlen(r->path) + 4];
+	FILE *parts[SPILL_PARTS];
+	const char *p = map, *end = map + size, *nl;
+	int bits = 1, shift;
+	size_t i;
+
+	/* splitting in two runs a little too big writes 2 files, not SPILL_PARTS */
+	while (bits < SPILL_BITS && (size * SPILL_RATIO >> bits) > budget)
+		bits++;
+	shift = 64 - r->bits - bits;
+
+	/* the runs are created on their first word */
+	memset(parts, 0, sizeof(parts));
+	for (; p < end; p = nl + 1) {
+		nl = memchr(p, '\n', end - p);
+		i = (hash_function(p, nl - p) >> shift) & ((1UL << bits) - 1);
+		if (!parts[i]) {
+			sprintf(path, "%s.%02zx", r->path, i);
+			if (!(parts[i] = fopen(path, "w"))) {
+				perror("can't create spill run");
+				exit(1);
+			}
+		}
+		fwrite(p, 1, nl - p + 1, parts[i]);
+	}
+	for (i = 0; i < (1UL << bits); i++) {
+		if (!parts[i])
+			continue;
+		if (ferror(parts[i]) | fclose(parts[i])) {
+			perror("can't write spill run");
+			exit(1);
+		}
+		sprintf(path, "%s.%02zx", r->path, i);
+		wq_push(wq, id, new_run(path, r->bits + bits));
+	}
+}
+
+static void dedup_run(finish_ctx *fc, int id, const char *map, size_t size)
+{
+	/* about 8 bytes per word, most of them repeated */
+	hashset *hs = hashset_create(size / 16);
+	const char *p = map, *end = map + size, *nl, *stored;
+
+	for (; p < end; p = nl + 1) {
+		nl = memchr(p, '\n', end - p);
+		if (hashset_insert_hash(hs, hash_function(p, nl - p), p, nl - p, &stored))
+			writer_word(fc->w, &fc->out[id], p, nl - p);
+	}
+	hashset_destroy(hs);
+}
+
+static void finish_run(workqueue *wq, int id, void *item, void *ctx)
+{
+	finish_ctx *fc = ctx;
+	run *r = item;
+	struct stat st;
+	char *map;
+	int fd;
+
+	if ((fd = open(r->path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+		perror("can't open spill run");
+		exit(1);
+	}
+	if (st.st_size) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			perror("can't map spill run");
+			exit(1);
+		}
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+		/* a run with every hash bit fixed holds copies of a few words */
+		if ((size_t)st.st_size * SPILL_RATIO > fc->budget && r->bits <= 64 - SPILL_BITS)
+			split_run(wq, id, r, map, st.st_size, fc->budget);
+		else
+			dedup_run(fc, id, map, st.st_size);
+		munmap(map, st.st_size);
+	}
+	close(fd);
+	unlink(r->path);
+	free(r->path);
+	free(r);
+}
+
+spill* spill_create(const char *outfile, size_t limit, int jobs)
+{
+	spill *sp = calloc(1, sizeof(spill));
+	char path[strlen(outfile) + sizeof(".spill.XXXXXX/00")];
+
+	if (!sp) {
+		perror("can't allocate spill runs");
+		exit(1);
+	}
+	sprintf(path, "%s.spill.XXXXXX", outfile);
+	if (!mkdtemp(path) || !(sp->dir = strdup(path))) {
+		perror("can't create spill directory");
+		exit(1);
+	}
+	for (size_t i = 0; i < SPILL_PARTS; i++) {
+		sprintf(path, "%s/%02zx", sp->dir, i);
+		if ((sp->fds[i] = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0) {
+			perror("can't create spill run");
+			exit(1);
+		}
+		pthread_mutex_init(&sp->locks[i], NULL);
+	}
+	sp->limit = limit;
+	sp->jobs = jobs;
+	return sp;
+}
+
+spill_buf* spill_buffer(spill *sp)
+{
+	spill_buf *b = calloc(1, sizeof(spill_buf));
+
+	if (!b || !(b->data = malloc(SPILL_PARTS * SPILL_BUF))) {
+		perror("can't allocate spill buffers");
+		exit(1);
+	}
+	b->sp = sp;
+	return b;
+}
+
+void spill_write(spill_buf *b, size_t part)
+{
+	const char *d = b->data + part * SPILL_BUF;
+	size_t len = b->len[part];
+	ssize_t n;
+
+	pthread_mutex_lock(&b->sp->locks[part]);
+	while (len) {
+		if ((n = write(b->sp->fds[part], d, len)) < 0) {
+			perror("can't write spill run");
+			exit(1);
+		}
+		d += n;
+		len -= n;
+	}
+	pthread_mutex_unlock(&b->sp->locks[part]);
+	b->len[part] = 0;
+}
+
+void spill_flush(spill_buf *b)
+{
+	for (size_t i = 0; i < SPILL_PARTS; i++)
+		if (b->len[i])
+			spill_write(b, i);
+	free(b->data);
+	free(b);
+}
+
+void spill_finish(spill *sp, const char *outfile)
+{
+	char path[strlen(sp->dir) + 4];
+	finish_ctx fc;
+	workqueue *wq;
+
+	fc.w = writer_open(outfile, 0, sp->jobs > 1, sp->jobs);
+	fc.budget = sp->limit / sp->jobs;
+	if (!(fc.out = malloc(sp->jobs * sizeof(outbuf *)))) {
+		perror("can't allocate spill batches");
+		exit(1);
+	}
+	for (int i = 0; i < sp->jobs; i++)
+		fc.out[i] = writer_batch(fc.w);
+	wq = wq_create(sp->jobs, finish_run, &fc);
+	for (size_t i = 0; i < SPILL_PARTS; i++) {
+		if (close(sp->fds[i]) < 0) {
+			perror("can't write spill run");
+			exit(1);
+		}
+		pthread_mutex_destroy(&sp->locks[i]);
+		sprintf(path, "%s/%02zx", sp->dir, i);
+		wq_push(wq, -1, new_run(path, SPILL_BITS));
+	}
+	wq_finish(wq);
+	for (int i = 0; i < sp->jobs; i++)
+		writer_put(fc.w, fc.out[i]);
+	writer_close(fc.w);
+	free(fc.out);
+	rmdir(sp->dir);
+	free(sp->dir);
+	free(sp);
+}
@@ -0,0 +1,140 @@
+/**
+ * @file spill.h
+ * @brief External-memory dedup: new words partitioned by hash in runs on disk
+ *
+ * For unique word sets bigger than memory (wordharvest --mem-limit), each
+ * harvesting thread dedups the words in a set of its own, appending the new ones
+ * to one of SPILL_PARTS runs picked by the top bits of their hash (buffered per
+ * thread and per run). When its set outgrows its share of the memory limit, it
+ * is emptied, its words being already in the runs, so only the words repeated
+ * across these epochs (or threads) reach the runs again. Once every file is
+ * harvested, each run holds every copy of its words: the runs are dedup'd
+ * independently by a pool of threads, each one loading a run in a set of its
+ * own and writing its unique words to the output, so the output is the
+ * concatenation of the runs (first-seen order within each run). A run too big
+ * for its share of the limit is first split by the next bits of the hashes, in
+ * as many smaller runs as needed.
+ * The runs are kept in a temporary directory next to the output file.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** Number of runs (power of two), and hash bits picking them */
+#define SPILL_BITS 6
+#define SPILL_PARTS (1 << SPILL_BITS)
+
+/** Buffer of a thread for each run */
+#define SPILL_BUF (16 * 1024)
+
+/** Memory of a set per byte of run dedup'd (slots, prefixes and padding of short words) */
+#define SPILL_RATIO 4
+
+/**
+ * @brief Struct for the runs.
+ */
+typedef struct _spill {
+	char *dir;	/* temporary directory of the runs */
+	int fds[SPILL_PARTS];
+	pthread_mutex_t locks[SPILL_PARTS];	/* appends to each run */
+	size_t limit;	/* memory limit of all the threads */
+	int jobs;
+} spill;
+
+/**
+ * @brief Struct for the run buffers of a thread.
+ */
+typedef struct _spill_buf {
+	spill *sp;
+	char *data;	/* SPILL_PARTS buffers of SPILL_BUF bytes */
+	size_t len[SPILL_PARTS];
+} spill_buf;
+
+/**
+ * Creates the temporary directory and the runs next to the output file.
+ * Exits on error.
+ *
+ * @param outfile  string with output file name
+ * @param limit  memory limit of all the threads, in bytes
+ * @param jobs  number of threads
+ *
+ * @return pointer to new runs
+ */
+spill* spill_create(const char *outfile, size_t limit, int jobs);
+
+/**
+ * Allocates the run buffers of a thread.
+ *
+ * @param sp  pointer to runs
+ *
+ * @return pointer to new buffers
+ */
+spill_buf* spill_buffer(spill *sp);
+
+/**
+ * Appends the buffer of a run to the run (when full).
+ *
+ * @param b  pointer to buffers
+ * @param part  run index
+ */
+void spill_write(spill_buf *b, size_t part);
+
+/**
+ * Appends the buffers of a thread to their runs and deallocates them.
+ *
+ * @param b  pointer to buffers
+ */
+void spill_flush(spill_buf *b);
+
+/**
+ * Dedups every run into the output file (truncated), with a pool of threads,
+ * then removes the runs and deallocates them. Exits on error.
+ *
+ * @param sp  pointer to runs
+ * @param outfile  string with output file name
+ */
+void spill_finish(spill *sp, const char *outfile);
+
+/**
+ * Appends a new word of the thread set to its run.
+ *
+ * @param b  pointer to buffers of the thread
+ * @param word  word chars (not NUL-terminated)
+ * @param len  word length
+ * @param hash  word hash (hash_function)
+ */
+static inline void spill_word(spill_buf *b, const char *word, size_t len, uint64_t hash)
+{
+	size_t p = hash >> (64 - SPILL_BITS);
+	char *d;
+
+	/* words longer than a buffer are written after it */
+	if (SPILL_BUF - b->len[p] < len + 1) {
+		spill_write(b, p);
+		if (len + 1 > SPILL_BUF) {
+			pthread_mutex_lock(&b->sp->locks[p]);
+			if (write(b->sp->fds[p], word, len) != (ssize_t)len || write(b->sp->fds[p], "\n", 1) != 1) {
+				perror("can't write spill run");
+				exit(1);
+			}
+			pthread_mutex_unlock(&b->sp->locks[p]);
+			return;
+		}
+	}
+	d = b->data + p * SPILL_BUF + b->len[p];
+	memcpy(d, word, len);
+	d[len] = '\n';
+	b->len[p] += len + 1;
+}
+
+#endif
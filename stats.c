@@ -0,0 +1,120 @@
+/**
+ * @file stats.c
+ * @brief Throughput reports of a run (option --stats of both programs)
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "stats.h"
+
+/**
+ * Prints a report line: elapsed time, program counters and peak memory.
+ */
+static void report(stats *st, int final);
+
+/**
+ * Reporting thread main loop.
+ */
+static void* reporter(void *arg);
+
+double stats_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+size_t stats_peak_rss(void)
+{
+	struct rusage ru;
+
+	/* ru_maxrss is in kilobytes on linux */
+	if (getrusage(RUSAGE_SELF, &ru) < 0)
+		return 0;
+	return (size_t)ru.ru_maxrss * 1024;
+}
+
+void stats_rate(FILE *f, double n, double elapsed)
+{
+	if (elapsed > 0)
+		n /= elapsed;
+	if (n >= 1e9)
+		fprintf(f, "%.2fG", n / 1e9);
+	else if (n >= 1e6)
+		fprintf(f, "%.2fM", n / 1e6);
+	else if (n >= 1e4)
+		fprintf(f, "%.1fK", n / 1e3);
+	else
+		fprintf(f, "%.0f", n);
+}
+
+static void report(stats *st, int final)
+{
+	double elapsed = stats_clock() - st->start;
+
+	/* the line is not interleaved with the messages of other threads */
+	flockfile(stderr);
+	fprintf(stderr, "stats %s%.1f s: ", final ? "total " : "", elapsed);
+	st->fn(stderr, elapsed, final, st->ctx);
+	fprintf(stderr, ", peak RSS %.1f MB\n", stats_peak_rss() / 1e6);
+	funlockfile(stderr);
+}
+
+static void* reporter(void *arg)
+{
+	stats *st = arg;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	pthread_mutex_lock(&st->lock);
+	while (!st->stop) {
+		ts.tv_sec += st->interval;
+		/* woken early by stats_finish */
+		while (!st->stop && pthread_cond_timedwait(&st->cond, &st->lock, &ts) != ETIMEDOUT)
+			;
+		if (!st->stop)
+			report(st, 0);
+	}
+	pthread_mutex_unlock(&st->lock);
+	return NULL;
+}
+
+stats* stats_start(unsigned interval, stats_fn fn, void *ctx)
+{
+	stats *st = calloc(1, sizeof(stats));
+
+	if (!st) {
+		perror("can't allocate stats");
+		exit(1);
+	}
+	st->fn = fn;
+	st->ctx = ctx;
+	st->interval = interval ? interval : STATS_INTERVAL;
+	st->start = stats_clock();
+	pthread_mutex_init(&st->lock, NULL);
+	pthread_cond_init(&st->cond, NULL);
+	if (pthread_create(&st->thread, NULL, reporter, st) != 0) {
+		perror("can't create stats thread");
+		exit(1);
+	}
+	return st;
+}
+
+void stats_finish(stats *st)
+{
+	pthread_mutex_lock(&st->lock);
+	st->stop = 1;
+	pthread_cond_broadcast(&st->cond);
+	pthread_mutex_unlock(&st->lock);
+	pthread_join(st->thread, NULL);
+	report(st, 1);
+	pthread_mutex_destroy(&st->lock);
+	pthread_cond_destroy(&st->cond);
+	free(st);
+}
@@ -0,0 +1,114 @@
+/**
+ * @file stats.h
+ * @brief Throughput reports of a run (option --stats of both programs)
+ *
+ * A reporting thread wakes up every few seconds and prints one line to stderr
+ * with the time elapsed, the counters of the program (printed by its callback,
+ * which reads the counters the working threads update with relaxed atomic
+ * stores, so they are never slowed by locks) and the peak resident memory.
+ * A last report is printed when the run ends, when the callback can also
+ * print what is only known then (e.g. the probe lengths of the word set).
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** Default seconds between reports */
+#define STATS_INTERVAL 5
+
+/**
+ * Callback printing the counters of the program, as ", "-separated fields.
+ *
+ * @param f  stream written
+ * @param elapsed  seconds since stats_start
+ * @param final  1 for the report at the end of the run, 0 for a periodic one
+ * @param ctx  context pointer passed to stats_start
+ */
+typedef void (*stats_fn)(FILE *f, double elapsed, int final, void *ctx);
+
+/**
+ * @brief Struct for the reports of a run.
+ */
+typedef struct _stats {
+	stats_fn fn;
+	void *ctx;
+	double start;	/* stats_clock at the start */
+	unsigned interval;	/* seconds between reports */
+	int stop;	/* set by stats_finish */
+	pthread_mutex_t lock;	/* stop */
+	pthread_cond_t cond;	/* wakes the reporter up early to stop */
+	pthread_t thread;
+} stats;
+
+/**
+ * Adds to a counter updated by a single thread, readable by the reporter
+ * at any time (a plain increment, with no lock prefix).
+ *
+ * @param c  pointer to counter
+ * @param n  value added
+ */
+static inline void stats_add(uint64_t *c, uint64_t n)
+{
+	__atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+/**
+ * Reads a counter updated by another thread.
+ *
+ * @param c  pointer to counter
+ *
+ * @return counter value
+ */
+static inline uint64_t stats_get(const uint64_t *c)
+{
+	return __atomic_load_n(c, __ATOMIC_RELAXED);
+}
+
+/**
+ * Seconds of a monotonic clock.
+ *
+ * @return seconds, with nanosecond resolution
+ */
+double stats_clock(void);
+
+/**
+ * Peak resident memory of the process.
+ *
+ * @return size in bytes
+ */
+size_t stats_peak_rss(void);
+
+/**
+ * Prints a rate with a K, M or G suffix, e.g. "1.25M".
+ *
+ * @param f  stream written
+ * @param n  count
+ * @param elapsed  seconds, the count itself being printed when 0
+ */
+void stats_rate(FILE *f, double n, double elapsed);
+
+/**
+ * Starts the clock and the reporting thread. Exits on error.
+ *
+ * @param interval  seconds between reports
+ * @param fn  callback printing the counters
+ * @param ctx  context pointer passed to fn
+ *
+ * @return pointer to new reports
+ */
+stats* stats_start(unsigned interval, stats_fn fn, void *ctx);
+
+/**
+ * Stops the reporting thread, prints the final report and deallocates it.
+ *
+ * @param st  pointer to reports
+ */
+void stats_finish(stats *st);
+
+#endif
@@ -0,0 +1,508 @@
+/**
+ * @file tokenizer.c
+ * @brief Block tokenizer for alphanumeric words (LUT, SSE2, AVX2, AVX-512 and NEON), UTF-8 aware
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "tokenizer.h"
+#include "hash.h"
+#include "utf8.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TOK_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define TOK_NEON
+#endif
+
+/** Scan routine type (one per instruction set) */
+typedef size_t (*scan_fn)(const unsigned char *p, size_t n, tok_emit emit, void *ctx);
+
+const unsigned char tok_class[256] = {
+	['0' ... '9'] = 1,
+	['A' ... 'Z'] = 1,
+	['a' ... 'z'] = 1,
+};
+
+size_t tok_min_len = 1, tok_max_len = SIZE_MAX;
+int tok_unicode;
+
+static scan_fn scan_block;
+static const char *scan_name;
+
+/**
+ * Adds the non ASCII word chars of a group of 64 bytes to its mask, decoding
+ * the UTF-8 sequences starting at its high bytes (invalid ones are separators).
+ * A sequence cut by the end of the block is taken as part of an unfinished
+ * word, so it is carried over with it (and left out by tokenize_word if
+ * the input ends there).
+ *
+ * @param p  block
+ * @param i  group offset in the block
+ * @param n  block size
+ * @param m  mask of the ASCII word chars of the group
+ * @param hi  mask of the high bytes of the group
+ * @param carry  bytes of the next group ending a sequence of this one (bits 0-1),
+ *               bit 2 set if it is a word char (updated)
+ *
+ * @return mask of the word chars of the group
+ */
+static uint64_t mask_utf8(const unsigned char *p, size_t i, size_t n, uint64_t m, uint64_t hi,
+                          unsigned *carry);
+
+/**
+ * Emits a word in UTF-8 mode: the length limits count chars, not bytes, the
+ * word is composed (TOK_NFC) and its case folded variant emitted too (TOK_FOLD).
+ * Words longer than TOK_SCRATCH bytes are emitted as found.
+ *
+ * @param w  word chars
+ * @param len  word length in bytes
+ * @param high  1 if the word has non ASCII bytes
+ * @param emit  callback for words found
+ * @param ctx  context pointer passed to emit
+ */
+static void emit_unicode(const char *w, size_t len, int high, tok_emit emit, void *ctx);
+
+/**
+ * Checks if a word ending in the current group of 64 bytes has a high byte.
+ *
+ * @param hi  mask of the high bytes of the group
+ * @param hi_end  offset after the last high byte of the previous groups, 0 if none
+ * @param i  group offset
+ * @param start  word offset
+ * @param end  offset after the word (in the group)
+ *
+ * @return 1 if it has one, 0 otherwise
+ */
+static inline int word_high(uint64_t hi, size_t hi_end, size_t i, size_t start, size_t end)
+{
+	if (hi_end > start)
+		return 1;
+	if (start > i)
+		hi &= ~0ULL << (start - i);
+	if (end - i < 64)
+		hi &= (1ULL << (end - i)) - 1;
+	return hi != 0;
+}
+
+/**
+ * Finds words in the block from the masks of 64 bytes computed by mask64
+ * (bit k set if byte k is alphanumeric). Inlined in each scan routine
+ * so mask64 is inlined too. In UTF-8 mode, the mask of high bytes hi64
+ * tells the groups of ASCII bytes, tokenized as in ASCII mode, from the
+ * other ones, where the UTF-8 sequences are decoded.
+ */
+static inline __attribute__((always_inline))
+size_t scan(const unsigned char *p, size_t n, tok_emit emit, void *ctx,
+            uint64_t (*mask64)(const unsigned char *), uint64_t (*hi64)(const unsigned char *),
+            int utf8)
+{
+	unsigned char tail[64];
+	const unsigned char *q;
+	size_t start = 0, len, hi_end = 0;
+	uint64_t m, prev = 0, lim, shifted, starts, ends, hi = 0;
+	unsigned carry = 0;
+	int in_word = 0, high;
+
+	for (size_t i = 0; i < n; i += 64) {
+		if (n - i >= 64) {
+			q = p + i;
+			lim = ~0ULL;
+		}
+		else {	/* last partial group, padded with separators */
+			memset(tail, 0, sizeof(tail));
+			memcpy(tail, p + i, n - i);
+			q = tail;
+			lim = (1ULL << (n - i)) - 1;	/* a word ending at n is unfinished */
+		}
+		m = mask64(q);
+		if (utf8 && (hi = hi64(q)))
+			m = mask_utf8(p, i, n, m, hi, &carry);
+		shifted = (m << 1) | prev;
+		starts = m & ~shifted;
+		ends = ~m & shifted & lim;
+		prev = m >> 63;
+		/* word starts and ends alternate */
+		while (starts | ends) {
+			if (in_word) {
+				if (!ends)
+					break;
+				len = i + __builtin_ctzll(ends) - start;
+				high = utf8 && word_high(hi, hi_end, i, start, start + len);
+				if (high || (utf8 && (tok_unicode & TOK_FOLD)))
+					emit_unicode((const char *)p + start, len, high, emit, ctx);
+				else if (len >= tok_min_len && len <= tok_max_len)
+					emit((const char *)p + start, len, hash_function((const char *)p + start, len), ctx);
+				ends &= ends - 1;
+				in_word = 0;
+			}
+			else {
+				start = i + __builtin_ctzll(starts);
+				starts &= starts - 1;
+				in_word = 1;
+			}
+		}
+		if (hi)
+			hi_end = i + 64 - __builtin_clzll(hi);
+	}
+	return in_word ? start : n;
+}
+
+static uint64_t mask_utf8(const unsigned char *p, size_t i, size_t n, uint64_t m, uint64_t hi,
+                          unsigned *carry)
+{
+	size_t avail = n - i, k, len;
+	uint64_t bits;
+	uint32_t cp = 0;
+	int word;
+
+	/* end of a sequence started in the previous group */
+	if (*carry) {
+		bits = (1ULL << (*carry & 3)) - 1;
+		if (*carry & 4)
+			m |= bits;
+		hi &= ~bits;
+		*carry = 0;
+	}
+	while (hi) {
+		k = __builtin_ctzll(hi);
+		if (!(len = utf8_decode(p + i + k, avail - k, &cp))) {
+			hi &= hi - 1;
+			continue;
+		}
+		word = len > avail - k || utf8_word(cp);
+		if (len > avail - k)
+			len = avail - k;
+		if (k + len > 64) {
+			*carry = (k + len - 64) | (word ? 4 : 0);
+			bits = ~0ULL << k;
+		}
+		else
+			bits = ((1ULL << len) - 1) << k;
+		if (word)
+			m |= bits;
+		hi &= ~bits;
+	}
+	return m;
+}
+
+static void emit_unicode(const char *w, size_t len, int high, tok_emit emit, void *ctx)
+{
+	unsigned char buf[3 * TOK_SCRATCH], *out;
+	size_t chars = 0, o = 0, last = 0, l;
+	uint32_t cp, prev = 0, c;
+
+	if (len < tok_min_len)
+		return;
+	/* compose each char with the previous one, e.g. a base and its mark */
+	if (high && (tok_unicode & TOK_NFC) && len <= TOK_SCRATCH) {
+		for (size_t k = 0; k < len; k += l) {
+			l = utf8_decode((const unsigned char *)w + k, len - k, &cp);
+			/* not reached, the words are valid UTF-8 (see tokenize_word) */
+			if (l == 0 || l > len - k)
+				return;
+			if (o && (c = utf8_compose(prev, cp))) {
+				o = last + utf8_encode(c, buf + last);
+				prev = c;
+				continue;
+			}
+			last = o;
+			o += utf8_encode(cp, buf + o);
+			prev = cp;
+		}
+		w = (const char *)buf;
+		len = o;
+	}
+	/* continuation bytes are not chars */
+	for (size_t k = 0; k < len; k++)
+		chars += ((unsigned char)w[k] & 0xc0) != 0x80;
+	if (chars < tok_min_len || chars > tok_max_len)
+		return;
+	emit(w, len, hash_function(w, len), ctx);
+	if (!(tok_unicode & TOK_FOLD) || len > TOK_SCRATCH)
+		return;
+	/* folding can make a char 1 byte longer (2 to 3 byte sequences) */
+	out = buf + TOK_SCRATCH;
+	o = 0;
+	for (size_t k = 0; k < len; k += l) {
+		l = utf8_decode((const unsigned char *)w + k, len - k, &cp);
+		if (l == 0 || l > len - k)
+			return;
+		o += utf8_encode(utf8_fold(cp), out + o);
+	}
+	if (o != len || memcmp(out, w, len) != 0)
+		emit((const char *)out, o, hash_function((const char *)out, o), ctx);
+}
+
+#if !defined(TOK_X86) && !defined(TOK_NEON)
+
+/*** Lookup table routine ***/
+
+static inline __attribute__((always_inline))
+uint64_t mask64_lut(const unsigned char *p)
+{
+	uint64_t m = 0;
+	for (int k = 0; k < 64; k++)
+		m |= (uint64_t)tok_class[p[k]] << k;
+	return m;
+}
+
+static inline __attribute__((always_inline))
+uint64_t hi64_lut(const unsigned char *p)
+{
+	uint64_t m = 0;
+	for (int k = 0; k < 64; k++)
+		m |= (uint64_t)(p[k] >> 7) << k;
+	return m;
+}
+
+static size_t scan_lut(const unsigned char *p, size_t n, tok_emit emit, void *ctx)
+{
+	return scan(p, n, emit, ctx, mask64_lut, hi64_lut, 0);
+}
+
+static size_t scan_lut_utf8(const unsigned char *p, size_t n, tok_emit emit, void *ctx)
+{
+	return scan(p, n, emit, ctx, mask64_lut, hi64_lut, 1);
+}
+
+#endif
+
+#ifdef TOK_X86
+
+/*** SSE2, AVX2 and AVX-512 routines ***/
+
+static inline __attribute__((always_inline))
+uint64_t mask16_sse2(const unsigned char *p)
+{
+	__m128i x = _mm_loadu_si128((const __m128i *)p);
+	/* digits: x - '0' <= 9, letters: (x | 0x20) - 'a' <= 25 (unsigned) */
+	__m128i d = _mm_sub_epi8(x, _mm_set1_epi8('0'));
+	__m128i l = _mm_sub_epi8(_mm_or_si128(x, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	__m128i isd = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+	__m128i isl = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(25)), l);
+	return (uint32_t)_mm_movemask_epi8(_mm_or_si128(isd, isl));
+}
+
+static inline __attribute__((always_inline))
+uint64_t mask64_sse2(const unsigned char *p)
+{
+	return mask16_sse2(p) | mask16_sse2(p + 16) << 16 |
+	       mask16_sse2(p + 32) << 32 | mask16_sse2(p + 48) << 48;
+}
+
+/* the sign bits are the high bytes */
+static inline __attribute__((always_inline))
+uint64_t hi64_sse2(const unsigned char *p)
+{
+	return (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)p)) |
+	       (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(p + 16))) << 16 |
+	       (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(p + 32))) << 32 |
+	       (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(p + 48))) << 48;
+}
+
+static size_t scan_sse2(const unsigned char *p, size_t n, tok_emit emit, void *ctx)
+{
+	return scan(p, n, emit, ctx, mask64_sse2, hi64_sse2, 0);
+}
+
+static size_t scan_sse2_utf8(const unsigned char *p, size_t n, tok_emit emit, void *ctx)
+{
+	return scan(p, n, emit, ctx, mask64_sse2, hi64_sse2, 1);
+}
+
+static inline __attribute__((always_inline, target("avx2")))
+uint64_t mask32_avx2(const unsigned char *p)
+{
+	__m256i x = _mm256_loadu_si256((const __m256i *)p);
+	__m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8('0'));
+	__m256i l = _mm256_sub_epi8(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+	__m256i isd = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+	__m256i isl = _mm256_cmpeq_epi8(_mm256_min_epu8(l, _mm256_set1_epi8(25)), l);
+	return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(isd, isl));
+}
+
+static inline __attribute__((always_inline, target("avx2")))
+uint64_t mask64_avx2(const unsigned char *p)
+{
+	return mask32_avx2(p) | mask32_avx2(p + 32) << 32;
+}
+
+static inline __attribute__((always_inline, target("avx2")))
+uint64_t hi64_avx2(const unsigned char *p)
+{
+	return (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)p)) |
+	       (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(p + 32))) << 32;
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const unsigned char *p, size_t n, tok_emit emit, void *ctx)
+{
+	return scan(p, n, emit, ctx, mask64_avx2, hi64_avx2, 0);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2_utf8(const unsigned char *p, size_t n, tok_emit emit, void *ctx)
+{
+	return scan(p, n, emit, ctx, mask64_avx2, hi64_avx2, 1);
+}
+
+/* the compares give the mask of the whole group, with no movemask */
+static inline __attribute__((always_inline, target("avx512bw")))
+uint64_t mask64_avx512(const unsigned char *p)
+{
+	__m512i x = _mm512_loadu_si512(p);
+	__m512i d = _mm512_sub_epi8(x, _mm512_set1_epi8('0'));
+	__m512i l = _mm512_sub_epi8(_mm512_or_si512(x, _mm512_set1_epi8(0x20)), _mm512_set1_epi8('a'));
+	return _mm512_cmple_epu8_mask(d, _mm512_set1_epi8(9)) | _mm512_cmple_epu8_mask(l, _mm512_set1_epi8(25));
+}
+
+static inline __attribute__((always_inline, target("avx512bw")))
+uint64_t hi64_avx512(const unsigned char *p)
+{
+	return _mm512_movepi8_mask(_mm512_loadu_si512(p));
+}
+
+__attribute__((target("avx512bw")))
+static size_t scan_avx512(const unsigned char *p, size_t n, tok_emit emit, void *ctx)
+{
+	return scan(p, n, emit, ctx, mask64_avx512, hi64_avx512, 0);
+}
+
+__attribute__((target("avx512bw")))
+static size_t scan_avx512_utf8(const unsigned char *p, size_t n, tok_emit emit, void *ctx)
+{
+	return scan(p, n, emit, ctx, mask64_avx512, hi64_avx512, 1);
+}
+
+#endif
+
+#ifdef TOK_NEON
+
+/*** NEON routine ***/
+
+static inline __attribute__((always_inline))
+uint8x16_t class16_neon(const unsigned char *p)
+{
+	uint8x16_t x = vld1q_u8(p);
+	uint8x16_t d = vsubq_u8(x, vdupq_n_u8('0'));
+	uint8x16_t l = vsubq_u8(vorrq_u8(x, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+	return vorrq_u8(vcleq_u8(d, vdupq_n_u8(9)), vcleq_u8(l, vdupq_n_u8(25)));
+}
+
+static inline __attribute__((always_inline))
+uint64_t movemask64_neon(uint8x16_t a, uint8x16_t b, uint8x16_t c, uint8x16_t d)
+{
+	static const uint8_t w[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+	uint8x16_t bits = vld1q_u8(w);
+	/* pairwise adds fold each 8 bytes in one byte of the mask */
+	uint8x16_t s = vpaddq_u8(vpaddq_u8(vandq_u8(a, bits), vandq_u8(b, bits)),
+	                         vpaddq_u8(vandq_u8(c, bits), vandq_u8(d, bits)));
+	s = vpaddq_u8(s, s);
+	return vgetq_lane_u64(vreinterpretq_u64_u8(s), 0);
+}
+
+static inline __attribute__((always_inline))
+uint64_t mask64_neon(const unsigned char *p)
+{
+	return movemask64_neon(class16_neon(p), class16_neon(p + 16), class16_neon(p + 32), class16_neon(p + 48));
+}
+
+static inline __attribute__((always_inline))
+uint64_t hi64_neon(const unsigned char *p)
+{
+	uint8x16_t h = vdupq_n_u8(0x80);
+
+	return movemask64_neon(vtstq_u8(vld1q_u8(p), h), vtstq_u8(vld1q_u8(p + 16), h),
+	                       vtstq_u8(vld1q_u8(p + 32), h), vtstq_u8(vld1q_u8(p + 48), h));
+}
+
+static size_t scan_neon(const unsigned char *p, size_t n, tok_emit emit, void *ctx)
+{
+	return scan(p, n, emit, ctx, mask64_neon, hi64_neon, 0);
+}
+
+static size_t scan_neon_utf8(const unsigned char *p, size_t n, tok_emit emit, void *ctx)
+{
+	return scan(p, n, emit, ctx, mask64_neon, hi64_neon, 1);
+}
+
+#endif
+
+void tokenizer_init(void)
+{
+	int utf8 = tok_unicode != 0;
+
+#if defined(TOK_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512bw")) {
+		scan_block = utf8 ? scan_avx512_utf8 : scan_avx512;
+		scan_name = "avx512";
+	}
+	else if (__builtin_cpu_supports("avx2")) {
+		scan_block = utf8 ? scan_avx2_utf8 : scan_avx2;
+		scan_name = "avx2";
+	}
+	else {
+		scan_block = utf8 ? scan_sse2_utf8 : scan_sse2;
+		scan_name = "sse2";
+	}
+#elif defined(TOK_NEON)
+	scan_block = utf8 ? scan_neon_utf8 : scan_neon;
+	scan_name = "neon";
+#else
+	scan_block = utf8 ? scan_lut_utf8 : scan_lut;
+	scan_name = "lut";
+#endif
+}
+
+void tokenizer_unicode(int flags)
+{
+	tok_unicode = flags;
+	/* the routine is selected again by the next tokenize_block */
+	scan_block = NULL;
+}
+
+const char* tokenizer_name(void)
+{
+	if (!scan_block)
+		tokenizer_init();
+	return scan_name;
+}
+
+void tokenizer_limits(size_t min_len, size_t max_len)
+{
+	tok_min_len = min_len ? min_len : 1;
+	tok_max_len = max_len ? max_len : SIZE_MAX;
+}
+
+size_t tokenize_block(const char *buf, size_t n, tok_emit emit, void *ctx)
+{
+	if (!scan_block)
+		tokenizer_init();
+	return scan_block((const unsigned char *)buf, n, emit, ctx);
+}
+
+void tokenize_word(const char *word, size_t len, tok_emit emit, void *ctx)
+{
+	int high = 0;
+
+	if (tok_unicode) {
+		/* a sequence cut by the end of the input is a separator */
+		if (!(len = utf8_complete((const unsigned char *)word, len)))
+			return;
+		for (size_t k = 0; k < len && !high; k++)
+			high = (unsigned char)word[k] >= 0x80;
+		if (high || (tok_unicode & TOK_FOLD)) {
+			emit_unicode(word, len, high, emit, ctx);
+			return;
+		}
+	}
+	if (len >= tok_min_len && len <= tok_max_len)
+		emit(word, len, hash_function(word, len), ctx);
+}
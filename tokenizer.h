@@ -0,0 +1,126 @@
+/**
+ * @file tokenizer.h
+ * @brief Block tokenizer for alphanumeric words
+ *
+ * Splits a memory block in runs of alphanumeric chars ([a-zA-Z0-9]), any other
+ * byte being a word separator. Bytes are classified 64 at a time into a bit mask,
+ * using SSE2, AVX2 or AVX-512 on x86 and NEON on ARM (chosen at runtime by tokenizer_init),
+ * or a 256-entry lookup table otherwise, and word boundaries are then found with
+ * bit scans on the mask. Words of any length are found in place (never copied), and
+ * only those within the length limits are hashed (see hash.h) and emitted.
+ * In UTF-8 mode (tokenizer_unicode), the letters, marks and digits of every
+ * script are word chars too: the high bytes of each group of 64 bytes are found
+ * with the same instructions, groups of ASCII bytes are tokenized as before and
+ * only the UTF-8 sequences of the other groups are decoded and classified (see
+ * utf8.h). Words can then be composed (NFC) and emitted with a case folded variant.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Size of the blocks read from the input files */
+#define TOK_BLOCK (1UL << 20)
+
+/**
+ * Callback receiving each word found.
+ *
+ * @param word  pointer to first char of the word (not NUL-terminated)
+ * @param len  word length
+ * @param hash  word hash (hash_function)
+ * @param ctx  context pointer passed to tokenize_block
+ */
+typedef void (*tok_emit)(const char *word, size_t len, uint64_t hash, void *ctx);
+
+/** Byte classes lookup table, 1 for alphanumeric chars */
+extern const unsigned char tok_class[256];
+
+/** Length limits of the words emitted (defaults 1 and no limit) */
+extern size_t tok_min_len, tok_max_len;
+
+/** Unicode options of the tokenizer (see tokenizer_unicode) */
+#define TOK_UTF8 1	/* UTF-8 letters, marks and digits are word chars */
+#define TOK_NFC 2	/* words composed (canonical composition) before being emitted */
+#define TOK_FOLD 4	/* case folded variant of the words with upper case emitted too */
+
+/** Longest word composed or case folded, in bytes (longer ones are emitted as found) */
+#define TOK_SCRATCH 256
+
+extern int tok_unicode;
+
+/**
+ * Checks if a byte can be part of a word, e.g. to find word boundaries
+ * (in UTF-8 mode, any byte of a multibyte sequence can be).
+ *
+ * @param c  byte
+ *
+ * @return 1 if it can, 0 otherwise
+ */
+static inline int tok_inword(unsigned char c)
+{
+	return tok_class[c] || (tok_unicode && c >= 0x80);
+}
+
+/**
+ * Sets the length limits of the words emitted, words out of
+ * the limits are skipped (not cut).
+ *
+ * @param min_len  minimum word length
+ * @param max_len  maximum word length, 0 for no limit
+ */
+void tokenizer_limits(size_t min_len, size_t max_len);
+
+/**
+ * Sets the Unicode options. In UTF-8 mode the length limits count chars
+ * instead of bytes, and invalid sequences are separators.
+ *
+ * @param flags  TOK_UTF8, TOK_NFC and/or TOK_FOLD (TOK_NFC and TOK_FOLD
+ *               imply TOK_UTF8), 0 for ASCII words only
+ */
+void tokenizer_unicode(int flags);
+
+/**
+ * Selects the fastest classification routine supported by the CPU.
+ * Called once before tokenizing (tokenize_block calls it if needed).
+ */
+void tokenizer_init(void);
+
+/**
+ * Name of the classification routine in use ("avx512", "avx2", "sse2", "neon", "lut").
+ *
+ * @return routine name
+ */
+const char* tokenizer_name(void);
+
+/**
+ * Calls emit for each complete word inside the block. A word running up
+ * to the end of the block is not emitted, as it may continue in the next
+ * block, and its offset is returned so the caller can carry it over.
+ *
+ * @param buf  block to be tokenized
+ * @param n  block size
+ * @param emit  callback for words found
+ * @param ctx  context pointer passed to emit
+ *
+ * @return offset of the trailing unfinished word, or n if the block ends in a separator
+ */
+size_t tokenize_block(const char *buf, size_t n, tok_emit emit, void *ctx);
+
+/**
+ * Emits a complete word, e.g. the unfinished word returned by tokenize_block
+ * when there is nothing more to read, if it is within the length limits.
+ * In UTF-8 mode a sequence cut by the end of the word is left out (the
+ * word dropped if nothing else is left), as the input ends inside it.
+ *
+ * @param word  pointer to word chars
+ * @param len  word length
+ * @param emit  callback for words found
+ * @param ctx  context pointer passed to emit
+ */
+void tokenize_word(const char *word, size_t len, tok_emit emit, void *ctx);
+
+#endif
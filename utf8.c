@@ -0,0 +1,79 @@
+/**
+ * @file utf8.c
+ * @brief Unicode properties of the tokenizer (binary searches in the generated tables)
+ *
+ * @author Victor C. Leal
+ */
+
+#include "utf8.h"
+#include "utf8_tables.h"
+
+/** Number of rows of a table */
+#define ROWS(t) (sizeof(t) / sizeof(t[0]))
+
+/** Hangul syllables, composed algorithmically: leading consonant (L), vowel (V)
+    and optional trailing consonant (T) jamos */
+#define HANGUL_S 0xac00
+#define HANGUL_L 0x1100
+#define HANGUL_V 0x1161
+#define HANGUL_T 0x11a7
+#define HANGUL_LCOUNT 19
+#define HANGUL_VCOUNT 21
+#define HANGUL_TCOUNT 28
+#define HANGUL_SCOUNT (HANGUL_LCOUNT * HANGUL_VCOUNT * HANGUL_TCOUNT)
+
+int utf8_word(uint32_t cp)
+{
+	size_t lo = 0, hi = ROWS(utf8_word_ranges), mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (cp < utf8_word_ranges[mid][0])
+			hi = mid;
+		else if (cp > utf8_word_ranges[mid][1])
+			lo = mid + 1;
+		else
+			return 1;
+	}
+	return 0;
+}
+
+uint32_t utf8_fold(uint32_t cp)
+{
+	size_t lo = 0, hi = ROWS(utf8_folds), mid;
+
+	if (cp < 0x80)
+		return (cp >= 'A' && cp <= 'Z') ? cp + ('a' - 'A') : cp;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (cp < utf8_folds[mid][0])
+			hi = mid;
+		else if (cp > utf8_folds[mid][0])
+			lo = mid + 1;
+		else
+			return utf8_folds[mid][1];
+	}
+	return cp;
+}
+
+uint32_t utf8_compose(uint32_t a, uint32_t b)
+{
+	size_t lo = 0, hi = ROWS(utf8_compositions), mid;
+
+	/* L + V, and LV + T */
+	if (a >= HANGUL_L && a < HANGUL_L + HANGUL_LCOUNT && b >= HANGUL_V && b < HANGUL_V + HANGUL_VCOUNT)
+		return HANGUL_S + ((a - HANGUL_L) * HANGUL_VCOUNT + (b - HANGUL_V)) * HANGUL_TCOUNT;
+	if (a >= HANGUL_S && a < HANGUL_S + HANGUL_SCOUNT && (a - HANGUL_S) % HANGUL_TCOUNT == 0 &&
+	    b > HANGUL_T && b < HANGUL_T + HANGUL_TCOUNT)
+		return a + (b - HANGUL_T);
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (a < utf8_compositions[mid][0] || (a == utf8_compositions[mid][0] && b < utf8_compositions[mid][1]))
+			hi = mid;
+		else if (a > utf8_compositions[mid][0] || b > utf8_compositions[mid][1])
+			lo = mid + 1;
+		else
+			return utf8_compositions[mid][2];
+	}
+	return 0;
+}
@@ -0,0 +1,153 @@
+/**
+ * @file utf8.h
+ * @brief UTF-8 decoding and the Unicode properties of the tokenizer
+ *
+ * Code points of words (letters, marks and decimal digits), simple case folding
+ * and canonical composition, looked up with binary searches in tables generated
+ * from the Unicode database (see utf8_tables.py). Only the words with non ASCII
+ * bytes reach them, the ASCII ones are classified by the block tokenizer.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Decodes the UTF-8 sequence starting a buffer. Overlong sequences,
+ * surrogates and code points over U+10FFFF are invalid.
+ *
+ * @param p  pointer to first byte
+ * @param n  bytes available (at least 1)
+ * @param cp  pointer to code point decoded
+ *
+ * @return sequence length, 0 if invalid, or its full length (greater than n)
+ *         if it is valid but cut by the end of the buffer (cp not set)
+ */
+static inline size_t utf8_decode(const unsigned char *p, size_t n, uint32_t *cp)
+{
+	uint32_t v, min;
+	size_t len;
+
+	if (p[0] < 0x80) {
+		*cp = p[0];
+		return 1;
+	}
+	if (p[0] < 0xc2)	/* continuation byte, or overlong 2 byte sequence */
+		return 0;
+	if (p[0] < 0xe0) {
+		len = 2;
+		v = p[0] & 0x1f;
+		min = 0x80;
+	}
+	else if (p[0] < 0xf0) {
+		len = 3;
+		v = p[0] & 0x0f;
+		min = 0x800;
+	}
+	else if (p[0] < 0xf5) {
+		len = 4;
+		v = p[0] & 0x07;
+		min = 0x10000;
+	}
+	else
+		return 0;
+	for (size_t k = 1; k < len; k++) {
+		if (k == n)
+			return len;
+		if ((p[k] & 0xc0) != 0x80)
+			return 0;
+		v = v << 6 | (p[k] & 0x3f);
+	}
+	if (v < min || v > 0x10ffff || (v >= 0xd800 && v <= 0xdfff))
+		return 0;
+	*cp = v;
+	return len;
+}
+
+/**
+ * Encodes a code point in UTF-8.
+ *
+ * @param cp  code point
+ * @param out  destination (at least 4 bytes)
+ *
+ * @return sequence length
+ */
+static inline size_t utf8_encode(uint32_t cp, unsigned char *out)
+{
+	if (cp < 0x80) {
+		out[0] = cp;
+		return 1;
+	}
+	if (cp < 0x800) {
+		out[0] = 0xc0 | cp >> 6;
+		out[1] = 0x80 | (cp & 0x3f);
+		return 2;
+	}
+	if (cp < 0x10000) {
+		out[0] = 0xe0 | cp >> 12;
+		out[1] = 0x80 | (cp >> 6 & 0x3f);
+		out[2] = 0x80 | (cp & 0x3f);
+		return 3;
+	}
+	out[0] = 0xf0 | cp >> 18;
+	out[1] = 0x80 | (cp >> 12 & 0x3f);
+	out[2] = 0x80 | (cp >> 6 & 0x3f);
+	out[3] = 0x80 | (cp & 0x3f);
+	return 4;
+}
+
+/**
+ * Length of a buffer without the sequence cut by its end, if any.
+ *
+ * @param p  pointer to first byte
+ * @param n  buffer size
+ *
+ * @return length of the buffer up to its last complete sequence
+ */
+static inline size_t utf8_complete(const unsigned char *p, size_t n)
+{
+	size_t k = n;
+	uint32_t cp;
+
+	/* lead byte of the last sequence, at most 3 continuation bytes after it */
+	while (k > 0 && n - k < 4 && (p[k - 1] & 0xc0) == 0x80)
+		k--;
+	if (k > 0 && p[k - 1] >= 0xc0 && utf8_decode(p + k - 1, n - k + 1, &cp) > n - k + 1)
+		return k - 1;
+	return n;
+}
+
+/**
+ * Checks if a non ASCII code point is a word char (letter, mark or digit).
+ *
+ * @param cp  code point
+ *
+ * @return 1 if it is, 0 otherwise
+ */
+int utf8_word(uint32_t cp);
+
+/**
+ * Simple case folding of a code point (ASCII included).
+ *
+ * @param cp  code point
+ *
+ * @return folded code point (cp itself if it has no folding)
+ */
+uint32_t utf8_fold(uint32_t cp);
+
+/**
+ * Canonical composition of a pair of code points, e.g. 'u' and U+0308
+ * (combining diaeresis) compose U+00FC.
+ *
+ * @param a  first code point
+ * @param b  second code point
+ *
+ * @return composed code point, 0 if the pair does not compose
+ */
+uint32_t utf8_compose(uint32_t a, uint32_t b);
+
+#endif
@@ -0,0 +1,93 @@
+#!/usr/bin/python3
+
+# Generates utf8_tables.h, the Unicode tables of the UTF-8 tokenizer (see utf8.h),
+# from the Unicode database of the Python running it:
+# 	python3 utf8_tables.py > utf8_tables.h
+
+# Author: Victor C. Leal
+
+import sys
+import unicodedata
+
+# letters, marks (so decomposed words are not split) and decimal/letter digits
+WORD_CATEGORIES = ('Lu', 'Ll', 'Lt', 'Lm', 'Lo', 'Mn', 'Mc', 'Me', 'Nd', 'Nl')
+
+# Hangul syllables are composed algorithmically (see utf8.c)
+HANGUL = range(0xAC00, 0xD7A4)
+
+def word_ranges():
+	"""
+	Ranges (first, last) of the non ASCII code points of words
+	"""
+	ranges = []
+	for cp in range(0x80, sys.maxunicode + 1):
+		if unicodedata.category(chr(cp)) not in WORD_CATEGORIES:
+			continue
+		if ranges and ranges[-1][1] == cp - 1:
+			ranges[-1][1] = cp
+		else:
+			ranges.append([cp, cp])
+	return ranges
+
+def folds():
+	"""
+	Simple case folding (one code point to one code point) of the non ASCII
+	code points, approximated by Python lowercase
+	"""
+	pairs = []
+	for cp in range(0x80, sys.maxunicode + 1):
+		low = chr(cp).lower()
+		if len(low) == 1 and ord(low) != cp:
+			pairs.append((cp, ord(low)))
+	return pairs
+
+def compositions():
+	"""
+	Canonical compositions of a pair of code points (exclusions left out)
+	"""
+	triples = []
+	for cp in range(0x80, sys.maxunicode + 1):
+		if cp in HANGUL:
+			continue
+		d = unicodedata.decomposition(chr(cp))
+		if not d or d.startswith('<'):
+			continue
+		parts = [int(x, 16) for x in d.split()]
+		if len(parts) != 2:
+			continue
+		if unicodedata.normalize('NFC', chr(parts[0]) + chr(parts[1])) != chr(cp):
+			continue
+		triples.append((parts[0], parts[1], cp))
+	triples.sort()
+	return triples
+
+def table(name, ctype, rows):
+	print('static const %s %s[][%d] = {' % (ctype, name, len(rows[0])))
+	for i in range(0, len(rows), 4):
+		print('\t' + ', '.join('{ ' + ', '.join('0x%x' % v for v in r) + ' }' for r in rows[i:i + 4]) + ',')
+	print('};')
+	print()
+
+def main():
+	print('/**')
+	print(' * @file utf8_tables.h')
+	print(' * @brief Unicode %s tables of the UTF-8 tokenizer (generated by utf8_tables.py)' % unicodedata.unidata_version)
+	print(' *')
+	print(' * @author Victor C. Leal')
+	print(' */')
+	print()
+	print('#ifndef UTF8_TABLES_H')
+	print('#define UTF8_TABLES_H')
+	print()
+	print('#include <stdint.h>')
+	print()
+	print('/** Ranges of the non ASCII code points of words (letters, marks, digits) */')
+	table('utf8_word_ranges', 'uint32_t', word_ranges())
+	print('/** Simple case folding of the non ASCII code points */')
+	table('utf8_folds', 'uint32_t', folds())
+	print('/** Canonical compositions: first, second, composed */')
+	table('utf8_compositions', 'uint32_t', compositions())
+	print('#endif')
+
+if __name__ == '__main__':
+	main()
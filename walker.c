@@ -0,0 +1,390 @@
+/**
+ * @file walker.c
+ * @brief In-process directory walker matching file extensions
+ *
+ * @author Victor C. Leal
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+
+#include "walker.h"
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(SYS_io_uring_setup)
+#include <linux/io_uring.h>
+#define WALK_URING
+#endif
+#endif
+
+/** Size of the getdents64 buffer */
+#define DENTS_BUF (64 * 1024)
+
+/** io_uring queue size, and minimum unknown entries worth a batch */
+#define URING_ENTRIES 64
+#define URING_MIN_BATCH 4
+
+/**
+ * @brief Struct for directory entries returned by getdents64.
+ */
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+#ifdef WALK_URING
+/**
+ * @brief Struct for the io_uring rings used to batch statx calls.
+ */
+typedef struct _uring {
+	int fd;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+} uring;
+#endif
+
+/**
+ * @brief Struct for walker state.
+ */
+typedef struct _walker {
+	const ext_set *es;
+	walk_fn fn;
+	void *ctx;
+	char **stack;	/* directories still to be read */
+	size_t depth, cap;
+	char *path;	/* buffer for file paths */
+	size_t path_cap;
+	char *dents;	/* getdents64 buffer */
+	int stop;	/* set when the callback stops the walk */
+#ifdef WALK_URING
+	uring ring;
+	int ring_state;	/* 0 not tried yet, 1 ready, -1 unavailable */
+#endif
+} walker;
+
+/**
+ * Pushes a directory path (dir/name) in the walker stack.
+ */
+static void push_dir(walker *w, const char *dir, const char *name, size_t nlen);
+
+/**
+ * Handles a directory entry with known type: directories are pushed
+ * in the stack and matching regular files passed to the callback.
+ */
+static void visit(walker *w, const char *dir, const char *name, unsigned char type);
+
+/**
+ * Fetches the types of entries not reported by getdents64,
+ * with a batch of statx through io_uring or one fstatat each.
+ *
+ * @param w  pointer to walker
+ * @param dirfd  directory file descriptor
+ * @param names  entry names
+ * @param types  array receiving DT_* types
+ * @param n  number of entries
+ */
+static void resolve_types(walker *w, int dirfd, char **names, unsigned char *types, size_t n);
+
+/**
+ * Reads all entries of a directory.
+ */
+static void read_dir(walker *w, const char *dir);
+
+/*** Extension set functions ***/
+
+void ext_set_add(ext_set *es, const char *ext)
+{
+	size_t len = strlen(ext);
+	ext_es *e;
+	unsigned char c;
+
+	if (len == 0)
+		return;
+	es->exts = realloc(es->exts, (es->n + 1) * sizeof(ext_es));
+	e = &es->exts[es->n++];
+	e->len = len + 1;
+	e->ext = malloc(len + 2);
+	e->ext[0] = '.';
+	memcpy(e->ext + 1, ext, len + 1);
+	c = ext[len - 1];
+	es->last[c >> 3] |= 1 << (c & 7);
+}
+
+int ext_set_match(const ext_set *es, const char *name, size_t len)
+{
+	unsigned char c;
+
+	if (len == 0)
+		return 0;
+	/* most names are rejected by their last char */
+	c = name[len - 1];
+	if (!(es->last[c >> 3] & (1 << (c & 7))))
+		return 0;
+	for (size_t i = 0; i < es->n; i++) {
+		if (len >= es->exts[i].len &&
+		    memcmp(name + len - es->exts[i].len, es->exts[i].ext, es->exts[i].len) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+void ext_set_free(ext_set *es)
+{
+	for (size_t i = 0; i < es->n; i++)
+		free(es->exts[i].ext);
+	free(es->exts);
+	memset(es, 0, sizeof(*es));
+}
+
+/*** io_uring statx batching ***/
+
+#ifdef WALK_URING
+
+/**
+ * Sets up the rings, returns 0 on success or -1 if io_uring is not available.
+ */
+static int uring_init(uring *r)
+{
+	struct io_uring_params p;
+	size_t sq_sz, cq_sz;
+	char *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	r->fd = syscall(SYS_io_uring_setup, URING_ENTRIES, &p);
+	if (r->fd < 0)
+		return -1;
+	sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (cq_sz > sq_sz)
+			sq_sz = cq_sz;
+	}
+	sq = mmap(NULL, sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+	          r->fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		goto fail;
+	cq = sq;
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+		cq = mmap(NULL, cq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		          r->fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED)
+			goto fail;
+	}
+	r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+	               PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+	               r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		goto fail;
+	r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned *)(sq + p.sq_off.array);
+	r->cq_head = (unsigned *)(cq + p.cq_off.head);
+	r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return 0;
+fail:
+	/* the mappings go away with the process, the ring is just not used */
+	close(r->fd);
+	return -1;
+}
+
+/**
+ * Runs statx (type only) on n <= URING_ENTRIES names relative to dirfd,
+ * returns 0 on success or -1 if the batch could not be submitted.
+ */
+static int uring_statx(uring *r, int dirfd, char **names, unsigned char *types, size_t n)
+{
+	struct statx stx[URING_ENTRIES];
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	unsigned tail = *r->sq_tail, head, idx;
+	size_t done = 0;
+	long submitted;
+
+	for (size_t i = 0; i < n; i++, tail++) {
+		idx = tail & *r->sq_mask;
+		sqe = &r->sqes[idx];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = dirfd;
+		sqe->addr = (uintptr_t)names[i];
+		sqe->len = STATX_TYPE;
+		sqe->off = (uintptr_t)&stx[i];
+		sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+		sqe->user_data = i;
+		r->sq_array[idx] = idx;
+		types[i] = DT_UNKNOWN;
+	}
+	__atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+	submitted = syscall(SYS_io_uring_enter, r->fd, n, 0, 0, NULL, 0);
+	if (submitted < 0)
+		return -1;
+	head = *r->cq_head;
+	/* wait for everything submitted, stx lives in this stack frame */
+	while (done < (size_t)submitted) {
+		if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+			__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+			syscall(SYS_io_uring_enter, r->fd, 0, submitted - done, IORING_ENTER_GETEVENTS, NULL, 0);
+			continue;
+		}
+		cqe = &r->cqes[head & *r->cq_mask];
+		if (cqe->res == 0)
+			types[cqe->user_data] = IFTODT(stx[cqe->user_data].stx_mode);
+		head++;
+		done++;
+	}
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+	return (size_t)submitted == n ? 0 : -1;
+}
+
+#endif
+
+/*** Walker functions ***/
+
+static void push_dir(walker *w, const char *dir, const char *name, size_t nlen)
+{
+	size_t dlen = strlen(dir);
+	int slash = dlen && dir[dlen - 1] != '/';
+	char *p;
+
+	if (w->depth == w->cap) {
+		w->cap = w->cap ? w->cap * 2 : 64;
+		w->stack = realloc(w->stack, w->cap * sizeof(char *));
+	}
+	p = malloc(dlen + slash + nlen + 1);
+	memcpy(p, dir, dlen);
+	if (slash)
+		p[dlen] = '/';
+	memcpy(p + dlen + slash, name, nlen + 1);
+	w->stack[w->depth++] = p;
+}
+
+static void visit(walker *w, const char *dir, const char *name, unsigned char type)
+{
+	size_t nlen = strlen(name), dlen;
+	int slash;
+
+	if (type == DT_DIR) {
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+			return;
+		push_dir(w, dir, name, nlen);
+	}
+	else if (type == DT_REG && ext_set_match(w->es, name, nlen)) {
+		dlen = strlen(dir);
+		slash = dlen && dir[dlen - 1] != '/';
+		if (dlen + slash + nlen + 1 > w->path_cap) {
+			w->path_cap = (dlen + slash + nlen + 1) * 2;
+			w->path = realloc(w->path, w->path_cap);
+		}
+		memcpy(w->path, dir, dlen);
+		if (slash)
+			w->path[dlen] = '/';
+		memcpy(w->path + dlen + slash, name, nlen + 1);
+		if (w->fn(w->path, w->ctx))
+			w->stop = 1;
+	}
+	/* symbolic links and special files are not followed */
+}
+
+static void resolve_types(walker *w, int dirfd, char **names, unsigned char *types, size_t n)
+{
+	struct stat st;
+	size_t i = 0, b;
+
+#ifdef WALK_URING
+	if (n >= URING_MIN_BATCH && w->ring_state == 0)
+		w->ring_state = uring_init(&w->ring) == 0 ? 1 : -1;
+	if (n >= URING_MIN_BATCH && w->ring_state == 1) {
+		for (; i < n; i += b) {
+			b = n - i < URING_ENTRIES ? n - i : URING_ENTRIES;
+			if (uring_statx(&w->ring, dirfd, names + i, types + i, b) < 0) {
+				w->ring_state = -1;
+				break;
+			}
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		if (fstatat(dirfd, names[i], &st, AT_SYMLINK_NOFOLLOW) == 0)
+			types[i] = IFTODT(st.st_mode);
+		else
+			types[i] = DT_UNKNOWN;
+	}
+}
+
+static void read_dir(walker *w, const char *dir)
+{
+	struct linux_dirent64 *d;
+	char *names[DENTS_BUF / 24];	/* entries have at least 24 bytes */
+	unsigned char types[DENTS_BUF / 24];
+	size_t unknown;
+	long n;
+	int fd;
+
+	if ((fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+		return;
+	while (!w->stop && (n = syscall(SYS_getdents64, fd, w->dents, DENTS_BUF)) > 0) {
+		unknown = 0;
+		for (long off = 0; off < n && !w->stop; off += d->d_reclen) {
+			d = (struct linux_dirent64 *)(w->dents + off);
+			if (d->d_type == DT_UNKNOWN)
+				names[unknown++] = d->d_name;
+			else
+				visit(w, dir, d->d_name, d->d_type);
+		}
+		if (unknown) {
+			resolve_types(w, fd, names, types, unknown);
+			for (size_t i = 0; i < unknown && !w->stop; i++)
+				visit(w, dir, names[i], types[i]);
+		}
+	}
+	close(fd);
+}
+
+void walk_tree(const char *dir, const ext_set *es, walk_fn fn, void *ctx)
+{
+	walker w;
+	char *cur;
+
+	memset(&w, 0, sizeof(w));
+	w.es = es;
+	w.fn = fn;
+	w.ctx = ctx;
+	w.dents = malloc(DENTS_BUF);
+	if (!w.dents) {
+		perror("can't allocate directory buffer");
+		exit(1);
+	}
+	w.cap = 64;
+	w.stack = malloc(w.cap * sizeof(char *));
+	w.stack[w.depth++] = strdup(dir);
+	/* after a stop, the directories left are only freed */
+	while (w.depth) {
+		cur = w.stack[--w.depth];
+		if (!w.stop)
+			read_dir(&w, cur);
+		free(cur);
+	}
+#ifdef WALK_URING
+	if (w.ring_state == 1)
+		close(w.ring.fd);
+#endif
+	free(w.stack);
+	free(w.path);
+	free(w.dents);
+}
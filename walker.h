@@ -0,0 +1,85 @@
+/**
+ * @file walker.h
+ * @brief In-process directory walker matching file extensions
+ *
+ * Traverses a directory tree once with openat/getdents64, reporting the regular
+ * files whose names end with any extension of a set, without following symbolic
+ * links (the same files 'find <dir> -name "*.<ext>" -type f' lists). Entry types
+ * come from getdents, and when the filesystem does not report them (some network
+ * filesystems) they are fetched with statx, batched through io_uring when the
+ * kernel supports it.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef WALKER_H
+#define WALKER_H
+
+#include <stddef.h>
+
+/**
+ * @brief Struct for a file extension in the extension set.
+ */
+typedef struct _ext_es {
+	char *ext;	/* extension with the leading '.' */
+	size_t len;
+} ext_es;
+
+/**
+ * @brief Struct for the set of extensions matched by the walker.
+ */
+typedef struct _ext_set {
+	ext_es *exts;
+	size_t n;
+	unsigned char last[32];	/* bitmap of the last char of each extension */
+} ext_set;
+
+/**
+ * Callback receiving each file found.
+ *
+ * @param path  string with file path
+ * @param ctx  context pointer passed to walk_tree
+ *
+ * @return 0 to continue, nonzero to stop the walk
+ */
+typedef int (*walk_fn)(char *path, void *ctx);
+
+/**
+ * Inserts an extension (without the '.') in the set.
+ *
+ * @param es  pointer to extension set
+ * @param ext  extension string
+ */
+void ext_set_add(ext_set *es, const char *ext);
+
+/**
+ * Checks if a file name ends with one of the extensions in the set.
+ *
+ * @param es  pointer to extension set
+ * @param name  file name
+ * @param len  file name length
+ *
+ * @return 1 if it matches, 0 otherwise
+ */
+int ext_set_match(const ext_set *es, const char *name, size_t len);
+
+/**
+ * Deallocates memory for the extensions inside the set.
+ *
+ * @param es  pointer to extension set
+ */
+void ext_set_free(ext_set *es);
+
+/**
+ * Walks the directory tree calling fn for each regular file with an
+ * extension in the set, until fn asks to stop. Unreadable directories
+ * are skipped.
+ *
+ * @param dir  string with search directory
+ * @param es  pointer to extension set
+ * @param fn  callback for files found
+ * @param ctx  context pointer passed to fn
+ */
+void walk_tree(const char *dir, const ext_set *es, walk_fn fn, void *ctx);
+
+#endif
@@ -2,13 +2,49 @@
  * @file wordharvest.c
  * @brief Program which searches the filesystem for files and extract words from them
  * 
- * The program search for files in the directory passed as an option (-d), with extensions
+ * The program search for files in the directory passed as an option (-d), traversing
+ * it once with an in-process walker (see walker.h), with extensions
  * specified by another option (-e), extract alphanumeric words from them and save unique
  * occurences of these words in the output file specified by an option (-o). To ensure
- * no repeated words, they are stored in a hash table and each word found is checked if
- * already in the table prior to file write.
- * Implemented to be used in linux systems and with limitations of 4 char extensions and
- * 29 char words for common sense (but that can be easily increased).
+ * no repeated words, they are stored in a growable hash set (see hashset.h) and each
+ * word found is checked if already in the set prior to file write.
+ * Big regular files are memory mapped and tokenized in place, other files are read in
+ * large blocks, and split in words by the block tokenizer (see tokenizer.h).
+ * With the option -j, files are harvested by a pool of threads fed by the walker
+ * through work-stealing deques (see workqueue.h), very big files being split in
+ * chunks at word boundaries so they are harvested by several threads, and the unique
+ * words kept in a sharded concurrent set (see shardset.h). New words are written in
+ * large batches (see writer.h), from a writer thread in parallel mode.
+ * With the option --format binary, the output file is a binary dictionary with
+ * the words grouped by length (see dictfile.h), written once all files are harvested.
+ * With the option --order freq, the occurrences of each word are counted in the set
+ * and the output file is written once all files are harvested, most frequent words
+ * first (see rank.h), --top keeping only the most frequent ones.
+ * With the option --incremental, a manifest of the files harvested (see manifest.h)
+ * and the set of unique words (see setfile.h) are saved next to the output file, so
+ * the next run skips the unchanged files, loads the set with one mmap and appends
+ * only the new words to the dictionary.
+ * With the option --mem-limit, the unique words do not have to fit in memory:
+ * each thread dedups in a set of its own, emptied when it outgrows its share of
+ * the limit, the new words being spilled to runs partitioned by hash on disk,
+ * and the output is written once all files are harvested, deduplicating each
+ * run independently (see spill.h).
+ * With the option -z, new words are also tested as the password of a ZipCrypto
+ * encrypted ZIP file while harvesting (see crack.h), and the walk stops as soon
+ * as it is found (the output file is then optional), the option -r mangling each
+ * new word with the rules of a rules file (see rules.h).
+ * Files are sniffed before being tokenized, binaries being skipped, and with the
+ * option --decompress compressed files (gzip, xz, zstd) are decompressed and the
+ * text of docx and odt documents extracted while being tokenized (see content.h).
+ * Words are ASCII letters and digits, unless the option --utf8 is given: the
+ * words of any script are then harvested whole (Zürich, contraseña), --nfc
+ * composing them and --fold emitting a case folded variant too (see tokenizer.h).
+ * With the option --stats, the throughput (files, bytes, words and candidates
+ * per second) and the peak memory are reported to stderr every few seconds and
+ * at the end, with the load and probe lengths of the set (see stats.h).
+ * Words and extensions can have any length, the options --min-len and --max-len
+ * skip words out of the limits (longer words are skipped, not cut).
+ * Implemented to be used in linux systems.
  *
  * @author Victor C. Leal
  *
@@ -18,30 +54,50 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <inttypes.h>
 
-/** Hash table size */
-#define MAXTABLE 100000
+#include "hashset.h"
+#include "shardset.h"
+#include "tokenizer.h"
+#include "walker.h"
+#include "workqueue.h"
+#include "spill.h"
+#include "writer.h"
+#include "zipfile.h"
+#include "crack.h"
+#include "dictfile.h"
+#include "content.h"
+#include "rank.h"
+#include "setfile.h"
+#include "manifest.h"
+#include "stats.h"
+
+/** Long-only command-line options */
+enum { OPT_MIN_LEN = 256, OPT_MAX_LEN, OPT_FORMAT, OPT_ORDER, OPT_TOP, OPT_INCREMENTAL, OPT_MEM_LIMIT, OPT_DECOMPRESS,
+       OPT_UTF8, OPT_NFC, OPT_FOLD, OPT_STATS };
+
+/** Regular files at least this big are memory mapped instead of read */
+#define MMAP_MIN (64 * 1024)
+
+/** In parallel mode, files of two chunks or more are split in chunks of this size */
+#define CHUNK_SIZE (16UL << 20)
 
 /**
  * @brief Struct for extensions linked list nodes.
  */
 typedef struct _node_ext {
-	char ext[5];	/* file extension (4 char max) */
+	char *ext;	/* file extension */
 	struct _node_ext *next;
 } node_ext;
 
-/**
- * @brief Struct for hash table linked list nodes.
- */
-typedef struct _node_tab {
-	char *word;
-	struct _node_tab *next;
-} node_tab;
-
 /**
  * @brief Struct for extensions linked list.
  */
@@ -50,14 +106,6 @@ typedef struct _list {
 	node_ext *tail;
 } list;
 
-/**
- * @brief Struct for hash table of linked lists.
- */
-typedef struct _list_ht {
-	node_tab *head;
-	node_tab *tail;
-} list_ht;
-
 /**
  * Inserts a extension string in the end of the linked list.
  * 
@@ -67,95 +115,258 @@ typedef struct _list_ht {
 void insert_list(list *l, char *e);
 
 /**
- * Inserts a word in the appropriate index in the hash table,
- * if there is index collision,
- * insert in the end of the linked list for that index.
+ * Deallocates memory for extensions linked list.
  * 
- * @param l  pointer to hash table
- * @param n  word string
+ * @param l  pointer to extensions linked list 
  */
-void insert_list_ht(list_ht *l, char *n);
+void free_list(list *l);
 
 /**
- * Finds the specified word in the hash table,
- * used to check for duplicates and avoid insertion,
- * verifiying on the index (word hash) of the table.
+ * Breaks the string with extensions separated with ':'
+ * and insert each one in the passed linked list.
  * 
- * @param l  pointer to linked list in hash table
- * @param word  string to be searched
+ * @param str  string with extension
+ * @param list  pointer to extensions linked list
+ */
+void break_ext(char *str, list *list);
+
+/**
+ * @brief Struct for output file options.
+ */
+typedef struct _out_opts {
+	int binary;	/* binary dictionary (see dictfile.h) instead of text */
+	int freq;	/* most frequent words first */
+	size_t top;	/* number of most frequent words kept, 0 for all */
+	int incremental;	/* append to the output, skipping files unchanged */
+	size_t mem_limit;	/* memory of the sets before spilling to disk, 0 for no limit */
+} out_opts;
+
+/**
+ * @brief Struct for the counters of a harvesting thread (option --stats),
+ * aligned so threads don't share cache lines.
+ */
+typedef struct _harvest_count {
+	uint64_t files;	/* files opened */
+	uint64_t bytes;	/* bytes tokenized (decompressed, for compressed files) */
+	uint64_t words;	/* words emitted by the tokenizer */
+	uint64_t added;	/* new words */
+} __attribute__((aligned(64))) harvest_count;
+
+/**
+ * @brief Struct for the --stats reports of a harvest.
+ */
+typedef struct _harvest_stats {
+	const harvest_count *counts;	/* one per harvesting thread */
+	int jobs;
+	const uint64_t *tested;	/* candidates tested by each testing thread, NULL without -z */
+	int testers;
+	const hashset *ht;	/* sets measured in the final report */
+	const shardset *ss;
+	int spilled;	/* the sets were emptied to spill runs, not measured */
+} harvest_stats;
+
+/**
+ * @brief Struct for harvest context passed to the tokenizer callback
+ * (one per harvesting thread).
+ */
+typedef struct _harvest_ctx {
+	hashset *ht;	/* single-threaded set */
+	shardset *ss;	/* set shared by threads, NULL when single-threaded */
+	recent_cache *recent;	/* thread recent words, in front of ss */
+	const setfile *base;	/* words of the previous runs, NULL if none */
+	manifest *man;	/* files of the incremental run, NULL if not incremental */
+	writer *w;	/* output file writer, NULL without output file */
+	outbuf *out;	/* thread batch of new words */
+	crack_ctx *cc;	/* pipeline testing engine, NULL without -z */
+	batch *cand;	/* thread batch of new words to be tested */
+	spill_buf *sb;	/* thread buffers of the spill runs, NULL without --mem-limit */
+	size_t budget;	/* memory of the thread set before it is emptied (spill mode) */
+	int keep;	/* new words are kept for the output written at the end */
+	int counted;	/* the sets count occurrences (frequency order) */
+	int decompress;	/* compressed files and documents are harvested (see content.h) */
+	harvest_count *count;	/* counters of the thread */
+	const char **saved;	/* stored copies of the new words of the thread */
+	size_t nsaved, saved_cap;
+	char *buf;	/* read buffer (grows for words longer than TOK_BLOCK) */
+	size_t buf_cap;
+} harvest_ctx;
+
+/**
+ * @brief Struct for a file mapping shared by its chunks.
+ */
+typedef struct _mapped_file {
+	char *map;
+	size_t size;
+	int refs;	/* chunks not harvested yet */
+} mapped_file;
+
+/**
+ * @brief Struct for work queue items: a file to be harvested, or a file chunk.
+ */
+typedef struct _task {
+	char *path;	/* file task */
+	mapped_file *mf;	/* chunk task */
+	size_t off;
+	size_t len;
+} task;
+
+/**
+ * Writes a new word to the output file (or keeps it for the output
+ * written at the end) and/or queues it for testing.
  *
- * @return pointer to node with searched word, or NULL if not found
+ * @param hc  pointer to harvest context
+ * @param word  pointer to word chars (not NUL-terminated)
+ * @param len  word length
+ * @param stored  copy of the word stored in the set
  */
-node_tab* list_find(list_ht *l, char *word);
+void save_word(harvest_ctx *hc, const char *word, size_t len, const char *stored);
 
 /**
- * Deallocates memory for extensions linked list.
- * 
- * @param l  pointer to extensions linked list 
+ * Writes the words kept by the threads (all the words of a thread after
+ * the ones of the previous thread) in the output file, ordered by
+ * frequency and/or in a binary dictionary.
+ *
+ * @param hc  array of harvest contexts
+ * @param jobs  number of harvest contexts
+ * @param outfile  string with output file name
+ * @param opts  pointer to output options
  */
-void free_list(list *l);
+void write_kept(harvest_ctx *hc, int jobs, const char *outfile, const out_opts *opts);
 
 /**
- * Deallocates memory for linked list in hash table.
- * 
- * @param l  pointer to hash table linked list
+ * Queues the new words of the thread for testing, so the words of each
+ * file are tested right after it is harvested (not when the batch is full).
+ *
+ * @param hc  pointer to harvest context
  */
-void free_list_ht(list_ht *l);
+void flush_words(harvest_ctx *hc);
 
 /**
- * Calculates the hash value for the string (word)
- * using XOR version of djb2 algorithm.
+ * Save unique words in the hash set,
+ * and writes these words to the output file.
  * 
- * @param str  string to be hashed
+ * @param hc  pointer to harvest context
+ * @param word  pointer to word chars (not NUL-terminated)
+ * @param len  word length
+ * @param hash  word hash
+ */
+void write_file(harvest_ctx *hc, const char *word, size_t len, uint64_t hash);
+
+/**
+ * Save unique words in the set shared by the harvesting threads, checking
+ * the thread recent words first, and writes the words this thread
+ * inserted to the output file.
  *
- * @return hash value for string received 
+ * @param hc  pointer to harvest context
+ * @param word  pointer to word chars (not NUL-terminated)
+ * @param len  word length
+ * @param hash  word hash
  */
-unsigned long hash_function(char *str);
+void write_shared(harvest_ctx *hc, const char *word, size_t len, uint64_t hash);
 
 /**
- * Prints all hash table entries with index.
- * 
- * @param hash  pointer to hash table 
+ * Tokenizer callback calling write_file (or write_shared) on words found.
+ *
+ * @param word  pointer to word chars
+ * @param len  word length
+ * @param hash  word hash
+ * @param ctx  pointer to harvest context
  */
-void print_hashtable(list_ht *hash);
+void emit_word(const char *word, size_t len, uint64_t hash, void *ctx);
 
 /**
- * Deallocates memory for the hash table
- * "freeing" all the linked list inside it.
- * 
- * @param hash  pointer to hash table
+ * Tokenizes the chunk [off, off + len) of a mapped file. A word crossing the
+ * start of the chunk belongs to the previous chunk, and a word crossing its end
+ * is harvested with this chunk, so chunk boundaries never cut words.
+ *
+ * @param mf  pointer to mapped file
+ * @param off  chunk offset
+ * @param len  chunk length
+ * @param hc  pointer to harvest context
  */
-void destroy_hash(list_ht *hash);
+void harvest_chunk(mapped_file *mf, size_t off, size_t len, harvest_ctx *hc);
 
 /**
- * Breaks the string with extensions separated with ':'
- * and insert each one in the passed linked list.
- * 
- * @param str  string with extension
- * @param list  pointer to extensions linked list
+ * Maps a big file and pushes its chunks in the work queue,
+ * harvesting the first one in the calling worker.
+ *
+ * @param fd  file descriptor of a regular file
+ * @param size  file size
+ * @param hc  pointer to harvest context
+ * @param wq  pointer to work queue
+ * @param id  index of the calling worker
+ *
+ * @return 0 on success, -1 if the file can't be mapped
  */
-void break_ext(char *str, list *list);
+int harvest_split(int fd, size_t size, harvest_ctx *hc, workqueue *wq, int id);
 
 /**
- * Save unique words in the hash table,
- * and writes these words to the output file.
- * 
- * @param hash  pointer to hash table
- * @param word  string with word
- * @param fp  file pointer to output file
+ * Tokenizes a memory mapping of the whole file, so words are
+ * hashed and compared in place and only copied when new.
+ *
+ * @param fd  file descriptor of a regular file
+ * @param size  file size
+ * @param hc  pointer to harvest context
+ *
+ * @return 0 on success, -1 if the file can't be mapped
+ */
+int harvest_mapped(int fd, size_t size, harvest_ctx *hc);
+
+/**
+ * Tokenizes the file reading it in blocks of TOK_BLOCK bytes,
+ * for small files, pipes and other special files, or reading its
+ * decompressed content. A word longer than the buffer grows it,
+ * unless it is over the max length (then skipped).
+ *
+ * @param fd  file descriptor
+ * @param filename  string with file path (for error messages)
+ * @param hc  pointer to harvest context
+ * @param cr  pointer to reader of the decompressed content, NULL to read the file
+ * @param pre  bytes of the file already read at the start of the buffer
  */
-void write_file(list_ht *ht, char *word, FILE *fp);
+void harvest_read(int fd, char *filename, harvest_ctx *hc, content_reader *cr, size_t pre);
 
 /**
  * Opens the file with the specified path, searching for words
  * and calling the write_file function for words found
- * to save them in the hash table and file passed by the pointer.
+ * to save them in the hash set and file of the harvest context.
  * 
  * @param filename  string with file path to be harvested
- * @param ht  pointer to hash table
- * @param ofp  file pointer to output file 
+ * @param hc  pointer to harvest context
+ * @param wq  pointer to work queue to split big files, NULL when single-threaded
+ * @param id  index of the calling worker
  */
-void harvest_words(char *filename, list_ht *ht, FILE *ofp);
+void harvest_words(char *filename, harvest_ctx *hc, workqueue *wq, int id);
+
+/**
+ * Walker callback calling harvest_words on the file found.
+ *
+ * @param path  string with file path
+ * @param ctx  pointer to harvest context
+ *
+ * @return 1 to stop the walk (password found), 0 otherwise
+ */
+int harvest_file(char *path, void *ctx);
+
+/**
+ * Walker callback pushing the file found in the work queue.
+ *
+ * @param path  string with file path
+ * @param ctx  pointer to work queue
+ *
+ * @return 1 to stop the walk (password found), 0 otherwise
+ */
+int queue_file(char *path, void *ctx);
+
+/**
+ * Work queue callback harvesting a file or a file chunk.
+ *
+ * @param wq  pointer to work queue
+ * @param id  worker index
+ * @param item  pointer to task
+ * @param ctx  array of harvest contexts, one per worker
+ */
+void run_task(workqueue *wq, int id, void *item, void *ctx);
 
 /**
  * Finds all files in the search directory 
@@ -163,11 +374,43 @@ void harvest_words(char *filename, list_ht *ht, FILE *ofp);
  * calling the harvest_words the function on these files.
  * 
  * @param l  pointer to extensions linked list
- * @param ht  pointer to hash table
+ * @param ht  pointer to hash set
  * @param dir  string with search directory
- * @param outfile  string with output file name
+ * @param outfile  string with output file name, NULL for no output file
+ * @param jobs  number of harvesting threads (and of testing threads)
+ * @param za  pointer to archive to test the words on, NULL for no pipeline
+ * @param opts  pointer to output options
+ * @param rules  mangling rules for the pipeline, NULL for none
+ * @param decompress  1 to harvest compressed files and documents, 0 to skip them
+ * @param interval  seconds between the --stats reports, 0 for none
+ *
+ * @return password found (to be freed), or NULL
  */
-void find_and_harvest(list *l, list_ht *ht, char *dir, char *outfile);
+char* find_and_harvest(list *l, hashset *ht, char *dir, char *outfile, int jobs,
+                       zip_archive *za, const out_opts *opts, const rule_set *rules,
+                       int decompress, unsigned interval);
+
+/**
+ * Prints the counters of a harvest for the --stats reports (see stats.h): files,
+ * bytes and words per second, new words, candidates per second of each testing
+ * thread in pipeline mode, and in the final report the load and probe lengths
+ * of the set of unique words.
+ *
+ * @param f  stream written
+ * @param elapsed  seconds since the start
+ * @param final  1 for the final report
+ * @param ctx  pointer to harvest stats
+ */
+void print_stats(FILE *f, double elapsed, int final, void *ctx);
+
+/**
+ * Parses a size in bytes, with an optional K, M or G suffix.
+ *
+ * @param str  string with size
+ *
+ * @return size in bytes, 0 if invalid
+ */
+size_t parse_size(const char *str);
 
 /**
  * Prints program help message with proper usage options
@@ -179,25 +422,7 @@ void usage(void);
 void insert_list(list *l, char *e)
 {
 	node_ext *new = malloc(sizeof(node_ext));
-	strncpy(new->ext,e,4);	/* 4 char extension */
-	new->next = NULL;
-	/* first element */
-	if (l->head == NULL) {
-		l->head = new;
-		l->tail = l->head;
-	}
-	/* insert at the end */
-	else {
-		l->tail->next = new;
-		l->tail = new;
-	}
-}
-
-void insert_list_ht(list_ht *l, char *n)
-{
-	node_tab *new = malloc(sizeof(node_tab));
-	new->word = malloc(strlen(n)+1);
-	strncpy(new->word,n,strlen(n));
+	new->ext = strdup(e);
 	new->next = NULL;
 	/* first element */
 	if (l->head == NULL) {
@@ -211,172 +436,613 @@ void insert_list_ht(list_ht *l, char *n)
 	}
 }
 
-node_tab* list_find(list_ht *l, char *word)
-{
-	node_tab *cur = l->head;
-	while (cur != NULL && strcmp(cur->word,word) != 0) {
-		cur = cur->next;
-	}
-	return cur;
-}
-
 void free_list(list *l)
 {
 	node_ext *cur = l->head, *nxt;
 	while (cur != NULL) {
 		nxt = cur->next;
+		free(cur->ext);
 		free(cur);
 		cur = nxt;
 	}
 	free(l);
 }
 
-void free_list_ht(list_ht *l)
+/** Other program functions */
+
+void break_ext(char *str, list *list)
 {
-	node_tab *cur = l->head, *nxt;
-	while (cur != NULL) {
-		nxt = cur->next;
-		free(cur->word);
-		free(cur);
-		cur = nxt;
+	char *saveptr, *token;
+
+	for (int j = 0 ; ; j++, str = NULL) {
+		token = strtok_r(str, ":", &saveptr);	/* ':' delimiter */
+		if (token == NULL)
+			break;
+		insert_list(list,token);
 	}
 }
 
-/*** Hash table functions ***/
+void save_word(harvest_ctx *hc, const char *word, size_t len, const char *stored)
+{
+	stats_add(&hc->count->added, 1);
+	if (hc->keep) {
+		if (hc->nsaved == hc->saved_cap) {
+			hc->saved_cap = hc->saved_cap ? 2 * hc->saved_cap : 4096;
+			if (!(hc->saved = realloc(hc->saved, hc->saved_cap * sizeof(char *)))) {
+				perror("can't allocate word list");
+				exit(1);
+			}
+		}
+		hc->saved[hc->nsaved++] = stored;
+	}
+	else if (hc->w)
+		writer_word(hc->w, &hc->out, word, len);
+	if (hc->cc)
+		crack_word(hc->cc, &hc->cand, word, len);
+}
 
-/** XOR version djb2 algorithm */
-unsigned long hash_function(char *str)
+void flush_words(harvest_ctx *hc)
 {
-    int c;
-    unsigned long hash = 5381;	/* seed */
-    while ((c = *str++ ))
-         hash = ((hash << 5) + hash) ^ c;	/* hash(i - 1) * 33 ^ str[i] */
-    return hash;
+	if (hc->cc && hc->cand->len) {
+		crack_submit(hc->cc, hc->cand);
+		hc->cand = crack_batch(hc->cc);
+	}
 }
 
-void print_hashtable(list_ht *hash)
+void write_kept(harvest_ctx *hc, int jobs, const char *outfile, const out_opts *opts)
 {
-	node_tab *cur;
+	const char **words = hc[0].saved;
+	size_t n = hc[0].nsaved;
+	uint32_t *freqs = NULL;
+	writer *w;
+	outbuf *out;
 
-	for (long i = 0; i < MAXTABLE; i++) {
-		cur = hash[i].head;
-		while (cur != NULL) {
-			printf("(%ld) \"%s\"\n", i, cur->word);
-			cur = cur->next;
+	/* the other threads words are appended to the first thread list */
+	for (int i = 1; i < jobs; i++) {
+		if (n + hc[i].nsaved > hc[0].saved_cap) {
+			hc[0].saved_cap = n + hc[i].nsaved;
+			if (!(words = hc[0].saved = realloc(words, hc[0].saved_cap * sizeof(char *)))) {
+				perror("can't allocate word list");
+				exit(1);
+			}
+		}
+		if (hc[i].nsaved)
+			memcpy(words + n, hc[i].saved, hc[i].nsaved * sizeof(char *));
+		n += hc[i].nsaved;
+	}
+	if (opts->freq)
+		n = rank_words(words, n, opts->top);
+	if (opts->binary) {
+		if (opts->freq && !(freqs = malloc((n ? n : 1) * sizeof(uint32_t)))) {
+			perror("can't allocate word list");
+			exit(1);
 		}
+		for (size_t i = 0; freqs && i < n; i++)
+			freqs[i] = ARENA_COUNT(words[i]);
+		dict_write(outfile, words, freqs, n);
+		free(freqs);
+		return;
 	}
+	w = writer_open(outfile, 0, 0, 1);
+	out = writer_batch(w);
+	for (size_t i = 0; i < n; i++)
+		writer_word(w, &out, words[i], ARENA_LEN(words[i]));
+	writer_put(w, out);
+	writer_close(w);
 }
 
-void destroy_hash(list_ht *hash)
+void write_file(harvest_ctx *hc, const char *word, size_t len, uint64_t hash)
 {
-	for (int i = 0; i < MAXTABLE; i++) {
-		free_list_ht(&hash[i]);
+	const char *stored;
+
+	/* already in the dictionary of the previous runs */
+	if (hc->base && setfile_find(hc->base, hash, word, len))
+		return;
+	/* new word -> insert and write to file */
+	if (hashset_insert_hash(hc->ht, hash, word, len, &stored)) {
+		if (hc->sb)
+			spill_word(hc->sb, word, len, hash);
+		save_word(hc, word, len, stored);
+		/* its words are already in the runs: the set starts over */
+		if (hc->sb && hashset_memory(hc->ht) > hc->budget)
+			hashset_clear(hc->ht);
 	}
-	free(hash);
 }
 
-/** Other program functions */
+void write_shared(harvest_ctx *hc, const char *word, size_t len, uint64_t hash)
+{
+	const char *stored;
 
-void break_ext(char *str, list *list)
+	/* hot words never reach the shared set */
+	if ((stored = recent_find(hc->recent, hash, word, len))) {
+		if (hc->counted)
+			hashset_hit(stored);
+		return;
+	}
+	if (hc->base && (stored = setfile_find(hc->base, hash, word, len))) {
+		recent_add(hc->recent, hash, stored);
+		return;
+	}
+	/* only the thread inserting a new word writes it */
+	if (shardset_insert(hc->ss, hash, word, len, &stored))
+		save_word(hc, word, len, stored);
+	recent_add(hc->recent, hash, stored);
+}
+
+void emit_word(const char *word, size_t len, uint64_t hash, void *ctx)
 {
-	char *saveptr, *token;
+	harvest_ctx *hc = ctx;
 
-	for (int j = 0 ; ; j++, str = NULL) {
-		token = strtok_r(str, ":", &saveptr);	/* ':' delimiter */
-		if (token == NULL)
-			break;
-		/* not checking token size (max 4 char extensions are stored) */
-		insert_list(list,token);
+	stats_add(&hc->count->words, 1);
+	if (hc->ss)
+		write_shared(hc, word, len, hash);
+	else
+		write_file(hc, word, len, hash);
+}
+
+void harvest_chunk(mapped_file *mf, size_t off, size_t len, harvest_ctx *hc)
+{
+	const unsigned char *m = (const unsigned char *)mf->map;
+	size_t start = off, end = off + len, rest;
+
+	/* skip the end of a word started in the previous chunk */
+	if (start > 0 && tok_inword(m[start - 1]))
+		while (start < end && tok_inword(m[start]))
+			start++;
+	/* finish the last word past the chunk end */
+	if (end > start && tok_inword(m[end - 1]))
+		while (end < mf->size && tok_inword(m[end]))
+			end++;
+	stats_add(&hc->count->bytes, len);
+	if (start >= end)
+		return;
+	rest = tokenize_block(mf->map + start, end - start, emit_word, hc);
+	if (rest < end - start)
+		tokenize_word(mf->map + start + rest, end - start - rest, emit_word, hc);
+}
+
+int harvest_split(int fd, size_t size, harvest_ctx *hc, workqueue *wq, int id)
+{
+	size_t nchunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	mapped_file *mf;
+	task *t;
+	char *map;
+
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return -1;
+	madvise(map, size, MADV_WILLNEED);
+	mf = malloc(sizeof(mapped_file));
+	mf->map = map;
+	mf->size = size;
+	mf->refs = nchunks;
+	/* other chunks can be stolen by idle workers */
+	for (size_t i = nchunks - 1; i > 0; i--) {
+		t = calloc(1, sizeof(task));
+		t->mf = mf;
+		t->off = i * CHUNK_SIZE;
+		t->len = (i == nchunks - 1) ? size - t->off : CHUNK_SIZE;
+		wq_push(wq, id, t);
 	}
+	t = calloc(1, sizeof(task));
+	t->mf = mf;
+	t->len = CHUNK_SIZE;
+	run_task(wq, id, t, hc - id);
+	return 0;
 }
 
-void write_file(list_ht *ht, char *word, FILE *fp)
+int harvest_mapped(int fd, size_t size, harvest_ctx *hc)
 {
-	/* hash index fitting the table size (hash mod MAXTABLE) */
-	unsigned long index = hash_function(word) % MAXTABLE;
-	/* searching only at hash index */
-	node_tab *found = list_find(&ht[index],word);
+	char *map;
+	size_t rest;
+
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return -1;
+	/* let the kernel read ahead the whole file */
+	madvise(map, size, MADV_SEQUENTIAL);
+	madvise(map, size, MADV_WILLNEED);
+	stats_add(&hc->count->bytes, size);
+	rest = tokenize_block(map, size, emit_word, hc);
+	/* last word of the file */
+	if (rest < size)
+		tokenize_word(map + rest, size - rest, emit_word, hc);
+	munmap(map, size);
+	return 0;
+}
 
-	if (found) {}
-	else {	/* new word -> insert and write to file */
-		insert_list_ht(&ht[index],word);
-		fprintf(fp, "%s\n", word);
+void harvest_read(int fd, char *filename, harvest_ctx *hc, content_reader *cr, size_t pre)
+{
+	size_t keep = 0, n, off, rest;
+	int skip = 0;	/* inside a word over the max length */
+	ssize_t r = pre;
+
+	/* read blocks (the first one may be read already), carrying over a word
+	   cut at the end of the block */
+	for (; r > 0 || (r = cr ? content_read(cr, hc->buf + keep, hc->buf_cap - keep) :
+	                 read(fd, hc->buf + keep, hc->buf_cap - keep)) > 0; r = 0) {
+		stats_add(&hc->count->bytes, r);
+		n = keep + r;
+		off = 0;
+		if (skip) {
+			while (off < n && tok_inword(hc->buf[off]))
+				off++;
+			if (off == n)
+				continue;
+			skip = 0;
+		}
+		rest = off + tokenize_block(hc->buf + off, n - off, emit_word, hc);
+		keep = n - rest;
+		if (keep < hc->buf_cap)
+			memmove(hc->buf, hc->buf + rest, keep);
+		/* whole buffer is one word: too long, or make room for it */
+		else if (keep > tok_max_len) {
+			skip = 1;
+			keep = 0;
+		}
+		else if (!(hc->buf = realloc(hc->buf, hc->buf_cap *= 2))) {
+			perror("can't allocate read buffer");
+			exit(1);
+		}
 	}
+	if (r < 0)
+		fprintf(stderr,"can't read file %s\n", filename);
+	/* last word of the file */
+	if (keep)
+		tokenize_word(hc->buf, keep, emit_word, hc);
 }
 
-void harvest_words(char *filename, list_ht *ht, FILE *ofp)
+void harvest_words(char *filename, harvest_ctx *hc, workqueue *wq, int id)
 {
-	FILE *fp;
-	char word[30];	/* 29 char words */
+	struct stat st;
+	content_reader *cr;
+	int fd, kind = CONTENT_TEXT;
+	ssize_t n;
 
-	if ((fp = fopen(filename,"r")) == NULL) {
-		fprintf(stderr,"can't open file %s", filename);
+	/* unchanged since the previous incremental run */
+	if (hc->man && stat(filename, &st) == 0 && manifest_check(hc->man, filename, &st))
+		return;
+	if ((fd = open(filename, O_RDONLY)) < 0) {
+		fprintf(stderr,"can't open file %s\n", filename);
+		return;
 	}
-	else {
-		/* scan for alphanumeric words */
-		while (fscanf(fp, "%29[a-zA-Z0-9]", word) == 1) {
-			write_file(ht, word, ofp);
-			/* any other char is a word separator */
-			if (fscanf(fp, "%29[^a-zA-Z0-9]", word) != 1) {
-				/* not checking for very long (30 chars plus) words, might "cut" them */
-				continue;
+	stats_add(&hc->count->files, 1);
+	/* binaries are skipped, compressed files and documents decompressed from
+	   the start (the first block of a small file is tokenized once read) */
+	if ((n = read(fd, hc->buf, CONTENT_SNIFF)) > 0)
+		kind = content_sniff((const unsigned char *)hc->buf, n);
+	if (kind != CONTENT_TEXT) {
+		if (kind != CONTENT_BINARY && hc->decompress) {
+			if (lseek(fd, 0, SEEK_SET) < 0)
+				fprintf(stderr, "can't decompress file %s, it is not seekable\n", filename);
+			else if ((cr = content_open(fd, filename, kind))) {
+				harvest_read(fd, filename, hc, cr, 0);
+				content_close(cr);
 			}
 		}
+		close(fd);
+		return;
+	}
+	/* map big regular files (split in parallel mode), read anything else */
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size < MMAP_MIN ||
+	    ((!wq || st.st_size < 2 * CHUNK_SIZE || harvest_split(fd, st.st_size, hc, wq, id) < 0) &&
+	     harvest_mapped(fd, st.st_size, hc) < 0))
+		harvest_read(fd, filename, hc, NULL, n > 0 ? n : 0);
+	close(fd);
+}
+
+int harvest_file(char *path, void *ctx)
+{
+	harvest_ctx *hc = ctx;
+
+	harvest_words(path, hc, NULL, 0);
+	flush_words(hc);
+	return hc->cc && crack_found(hc->cc);
+}
+
+int queue_file(char *path, void *ctx)
+{
+	harvest_ctx *hc = ((workqueue *)ctx)->ctx;
+	task *t = calloc(1, sizeof(task));
+
+	t->path = strdup(path);
+	wq_push(ctx, -1, t);
+	return hc->cc && crack_found(hc->cc);
+}
+
+void run_task(workqueue *wq, int id, void *item, void *ctx)
+{
+	harvest_ctx *hc = (harvest_ctx *)ctx + id;
+	task *t = item;
+	/* tasks left after the password is found are dropped */
+	int skip = hc->cc && crack_found(hc->cc);
+
+	if (t->mf) {
+		if (!skip)
+			harvest_chunk(t->mf, t->off, t->len, hc);
+		/* last chunk harvested releases the mapping */
+		if (__atomic_sub_fetch(&t->mf->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+			munmap(t->mf->map, t->mf->size);
+			free(t->mf);
+		}
 	}
-	fclose(fp);
+	else if (!skip)
+		harvest_words(t->path, hc, wq, id);
+	flush_words(hc);
+	free(t->path);
+	free(t);
 }
 
-void find_and_harvest(list *l, list_ht *ht, char *dir, char *outfile)
+char* find_and_harvest(list *l, hashset *ht, char *dir, char *outfile, int jobs,
+                       zip_archive *za, const out_opts *opts, const rule_set *rules,
+                       int decompress, unsigned interval)
 {
-	node_ext *p = l->head;
-	FILE *fp, *ofp;
-	char command[1024], filename[1024];
+	ext_set es = { 0 };
+	harvest_ctx *hc = calloc(jobs, sizeof(harvest_ctx));
+	/* in spill mode each thread dedups in a set of its own */
+	spill *sp = (outfile && opts->mem_limit) ? spill_create(outfile, opts->mem_limit, jobs) : NULL;
+	shardset *ss = (jobs > 1 && !sp) ? shardset_create(jobs) : NULL;
+	/* binary and frequency ordered outputs are written at the end */
+	int keep = outfile && (opts->binary || opts->freq);
+	crack_ctx *cc = za ? crack_create(&za, 1, jobs, rules) : NULL;
+	char *password = NULL, *state = NULL;
+	setfile base = { 0 };
+	manifest *man = NULL;
+	harvest_count *counts = NULL;
+	harvest_stats hs = { .jobs = jobs, .ht = ht, .ss = ss, .spilled = sp != NULL };
+	uint64_t *tested = NULL;
+	stats *st = NULL;
+	workqueue *wq;
+	writer *w;
 
-	ofp = fopen(outfile,"w");
-	if (!ofp) {
-		perror("can't open write file");
+	/* state of the previous runs: words appended only if there is one */
+	if (outfile && opts->incremental) {
+		if (!(state = malloc(strlen(outfile) + sizeof(".manifest")))) {
+			perror("can't allocate state file name");
+			exit(1);
+		}
+		sprintf(state, "%s.set", outfile);
+		if (setfile_open(state, &base) < 0)
+			exit(1);
+		sprintf(state, "%s.manifest", outfile);
+		man = manifest_open(state, base.map != NULL);
+	}
+	w = (outfile && !keep && !sp) ? writer_open(outfile, base.map != NULL, jobs > 1, jobs) : NULL;
+	if (!hc || posix_memalign((void **)&counts, 64, jobs * sizeof(harvest_count)) != 0) {
+		perror("can't allocate harvest contexts");
 		exit(1);
 	}
-	while (p) {
-		/* find files with 'find', removing errors */
-		if ( snprintf(command, sizeof(command),
-		     "find %s -name \"*.%s\" -type f 2>/dev/null",
-		     dir, p->ext) > sizeof(command) )
-		{
-			fprintf(stderr,"path too long, it may be truncated");
+	memset(counts, 0, jobs * sizeof(harvest_count));
+	hs.counts = counts;
+	if (interval) {
+		if (cc) {
+			if (!(tested = calloc(jobs, sizeof(uint64_t)))) {
+				perror("can't allocate stats");
+				exit(1);
+			}
+			crack_count_threads(cc, tested);
+			hs.tested = tested;
+			hs.testers = jobs;
+		}
+		st = stats_start(interval, print_stats, &hs);
+	}
+
+	if (keep && opts->freq) {
+		hashset_count_words(ht);
+		if (ss)
+			shardset_count_words(ss);
+	}
+	for (int i = 0; i < jobs; i++) {
+		hc[i].ht = (sp && i) ? hashset_create(0) : ht;
+		hc[i].ss = ss;
+		if (sp) {
+			hc[i].sb = spill_buffer(sp);
+			hc[i].budget = opts->mem_limit / jobs;
+		}
+		hc[i].base = base.map ? &base : NULL;
+		hc[i].man = man;
+		hc[i].w = w;
+		if (w)
+			hc[i].out = writer_batch(w);
+		hc[i].cc = cc;
+		if (cc)
+			hc[i].cand = crack_batch(cc);
+		hc[i].keep = keep;
+		hc[i].counted = keep && opts->freq;
+		hc[i].decompress = decompress;
+		hc[i].count = &counts[i];
+		if (ss && !(hc[i].recent = calloc(1, sizeof(recent_cache)))) {
+			perror("can't allocate recent words cache");
+			exit(1);
 		}
-		/* send 'find' command */
-		if ((fp = popen(command, "r")) == NULL) {
-			perror("find");
+		hc[i].buf_cap = TOK_BLOCK;
+		if (!(hc[i].buf = malloc(TOK_BLOCK))) {
+			perror("can't allocate read buffer");
+			exit(1);
 		}
-		/* harvest on each file found */
-		while (fgets(filename, sizeof(filename)-1, fp) != NULL) {
-			filename[strcspn(filename, "\n")] = 0;	/* remove '\n' */
-			harvest_words(filename, ht, ofp);
+	}
+	/* all extensions are matched in a single traversal */
+	for (node_ext *p = l->head; p; p = p->next)
+		ext_set_add(&es, p->ext);
+	if (jobs > 1) {
+		wq = wq_create(jobs, run_task, hc);
+		walk_tree(dir, &es, queue_file, wq);
+		wq_finish(wq);
+	}
+	else
+		walk_tree(dir, &es, harvest_file, hc);
+	ext_set_free(&es);
+	/* the sets still hold the words */
+	if (keep)
+		write_kept(hc, jobs, outfile, opts);
+	for (int i = 0; i < jobs; i++) {
+		if (w)
+			writer_put(w, hc[i].out);
+		if (cc && hc[i].cand->len)
+			crack_submit(cc, hc[i].cand);
+		else if (cc)
+			crack_release(cc, hc[i].cand);
+		if (sp) {
+			spill_flush(hc[i].sb);
+			if (i)
+				hashset_destroy(hc[i].ht);
+			else
+				hashset_clear(ht);
+		}
+		free(hc[i].recent);
+		free(hc[i].buf);
+		free(hc[i].saved);
+	}
+	free(hc);
+	if (w)
+		writer_close(w);
+	/* the output is written from the runs, once every word reached them */
+	if (sp)
+		spill_finish(sp, outfile);
+	if (cc)
+		crack_finish(cc, &password);
+	/* the new state is saved once the dictionary is complete (a set with no new
+	   words is only rewritten to add its filter) */
+	if (man) {
+		sprintf(state, "%s.set", outfile);
+		if (ss) {
+			hashset *sets[1UL << ss->bits];
+			size_t added = 0;
+
+			for (size_t i = 0; i < (1UL << ss->bits); i++) {
+				sets[i] = ss->shards[i].hs;
+				added += sets[i]->count;
+			}
+			if (added || !base.filter)
+				setfile_write(state, &base, sets, 1UL << ss->bits);
 		}
-		pclose(fp);
-		p = p->next;
+		else if (ht->count || !base.filter)
+			setfile_write(state, &base, &ht, 1);
+		manifest_close(man);
+		setfile_close(&base);
+		free(state);
+	}
+	/* the sets are measured before their shards are released */
+	if (st)
+		stats_finish(st);
+	free(counts);
+	free(tested);
+	if (ss)
+		shardset_destroy(ss);
+	return password;
+}
+
+void print_stats(FILE *f, double elapsed, int final, void *ctx)
+{
+	const harvest_stats *hs = ctx;
+	uint64_t files = 0, bytes = 0, words = 0, added = 0, tested = 0;
+	size_t count = 0, slots = 0, probes = 0, max = 0, m;
+
+	for (int i = 0; i < hs->jobs; i++) {
+		files += stats_get(&hs->counts[i].files);
+		bytes += stats_get(&hs->counts[i].bytes);
+		words += stats_get(&hs->counts[i].words);
+		added += stats_get(&hs->counts[i].added);
+	}
+	fprintf(f, "%" PRIu64 " files (", files);
+	stats_rate(f, files, elapsed);
+	fprintf(f, "/s), %.1f MB (%.1f MB/s), %" PRIu64 " words (", bytes / 1e6, bytes / 1e6 / elapsed, words);
+	stats_rate(f, words, elapsed);
+	fprintf(f, "/s), %" PRIu64 " new", added);
+	if (hs->tested) {
+		for (int i = 0; i < hs->testers; i++)
+			tested += stats_get(&hs->tested[i]);
+		fprintf(f, ", %" PRIu64 " candidates (", tested);
+		stats_rate(f, tested, elapsed);
+		fprintf(f, "/s, per thread");
+		for (int i = 0; i < hs->testers; i++) {
+			fputc(' ', f);
+			stats_rate(f, stats_get(&hs->tested[i]), elapsed);
+		}
+		fputc(')', f);
+	}
+	/* the threads are done with the sets by the final report */
+	if (!final || hs->spilled)
+		return;
+	if (hs->ss) {
+		for (size_t i = 0; i < (1UL << hs->ss->bits); i++) {
+			count += hs->ss->shards[i].hs->count;
+			slots += hs->ss->shards[i].hs->mask + 1;
+			probes += hashset_probes(hs->ss->shards[i].hs, &m);
+			max = m > max ? m : max;
+		}
+	}
+	else {
+		count = hs->ht->count;
+		slots = hs->ht->mask + 1;
+		probes = hashset_probes(hs->ht, &max);
+	}
+	fprintf(f, ", set %zu words in %zu slots (load %.2f, probe length mean %.2f max %zu)",
+	        count, slots, (double)count / slots, count ? (double)probes / count : 0.0, max);
+}
+
+size_t parse_size(const char *str)
+{
+	char *end;
+	unsigned long long n = strtoull(str, &end, 10);
+
+	if (end == str || str[0] == '-')
+		return 0;
+	switch (*end) {
+		case 'G': case 'g':
+			n <<= 10;
+			/* fall through */
+		case 'M': case 'm':
+			n <<= 10;
+			/* fall through */
+		case 'K': case 'k':
+			n <<= 10;
+			end++;
+			break;
 	}
-	fclose(ofp);
+	return *end ? 0 : n;
 }
 
 void usage(void)
 {
-	fprintf(stderr, "Usage: wordharvest [-e extensions] -d directory -o outfile\n");
+	fprintf(stderr, "Usage: wordharvest [-e extensions] [-j threads] [--min-len n] [--max-len n]"
+	                " [--format text|binary] [--order seen|freq] [--top n] [--incremental]"
+	                " [--mem-limit size] [--decompress] [--utf8] [--nfc] [--fold] [--stats[=seconds]] -d directory -o outfile | -z zipfile [-r rules]\n");
 	exit(1);
 }
 
 int main(int argc, char **argv)
 {
-	int opt, misopt, dflag = 0, eflag = 0, oflag = 0;
-	char *default_ext[]={"txt","text"}, *path, *outfile;
-	list *list = calloc(1,sizeof(list));
-	list_ht *htable = calloc(MAXTABLE,sizeof(list_ht));
+	int opt, misopt = 0, dflag = 0, eflag = 0, oflag = 0, jobs = 1, ret = 0, decompress = 0;
+	int unicode = 0, interval = 0;
+	char *default_ext[]={"txt","text"}, *path = NULL, *outfile = NULL, *zipname = NULL;
+	char *password;
+	zip_archive *za = NULL;
+	rule_set *rules = NULL;
+	long min_len = 0, max_len = 0, top;
+	out_opts opts = { 0 };
+	list *list = calloc(1,sizeof(*list));
+	hashset *htable = hashset_create(0);
+	static const struct option long_opts[] = {
+		{ "min-len", required_argument, NULL, OPT_MIN_LEN },
+		{ "max-len", required_argument, NULL, OPT_MAX_LEN },
+		{ "format", required_argument, NULL, OPT_FORMAT },
+		{ "order", required_argument, NULL, OPT_ORDER },
+		{ "top", required_argument, NULL, OPT_TOP },
+		{ "incremental", no_argument, NULL, OPT_INCREMENTAL },
+		{ "mem-limit", required_argument, NULL, OPT_MEM_LIMIT },
+		{ "decompress", no_argument, NULL, OPT_DECOMPRESS },
+		{ "utf8", no_argument, NULL, OPT_UTF8 },
+		{ "nfc", no_argument, NULL, OPT_NFC },
+		{ "fold", no_argument, NULL, OPT_FOLD },
+		{ "stats", optional_argument, NULL, OPT_STATS },
+		{ NULL, 0, NULL, 0 }
+	};
 
 	if (argc < 5)
 		usage();
 	/* comand-line options and arguments */
-	while ((opt = getopt (argc, argv, ":d:o:e:")) != -1) {
+	while ((opt = getopt_long (argc, argv, ":d:o:e:j:z:r:", long_opts, NULL)) != -1) {
 		switch (opt) {
 			case 'e':
 				eflag = 1;
@@ -397,6 +1063,96 @@ int main(int argc, char **argv)
 				oflag = 1;
 				outfile = argv[optind-1];
 				break;
+			case 'z':
+				if (optarg[0]=='-')
+					misopt = 'z';
+				zipname = optarg;
+				break;
+			case 'r':
+				if (optarg[0]=='-')
+					misopt = 'r';
+				if (rules)
+					rules_free(rules);
+				rules = rules_load(optarg);
+				break;
+			case 'j':
+				if (optarg[0]=='-')
+					misopt = 'j';
+				jobs = atoi(optarg);
+				if (jobs < 1) {
+					fprintf(stderr, "option '-j' requires a positive number\n");
+					usage();
+				}
+				break;
+			case OPT_MIN_LEN:
+				min_len = atol(optarg);
+				if (min_len < 0) {
+					fprintf(stderr, "option '--min-len' requires a non negative number\n");
+					usage();
+				}
+				break;
+			case OPT_MAX_LEN:
+				max_len = atol(optarg);
+				if (max_len < 0) {
+					fprintf(stderr, "option '--max-len' requires a non negative number\n");
+					usage();
+				}
+				break;
+			case OPT_FORMAT:
+				if (strcmp(optarg, "binary") == 0)
+					opts.binary = 1;
+				else if (strcmp(optarg, "text") != 0) {
+					fprintf(stderr, "option '--format' must be 'text' or 'binary'\n");
+					usage();
+				}
+				break;
+			case OPT_ORDER:
+				if (strcmp(optarg, "freq") == 0)
+					opts.freq = 1;
+				else if (strcmp(optarg, "seen") != 0) {
+					fprintf(stderr, "option '--order' must be 'seen' or 'freq'\n");
+					usage();
+				}
+				break;
+			case OPT_TOP:
+				/* keeping the most frequent words implies frequency order */
+				top = atol(optarg);
+				if (top < 1) {
+					fprintf(stderr, "option '--top' requires a positive number\n");
+					usage();
+				}
+				opts.top = top;
+				opts.freq = 1;
+				break;
+			case OPT_INCREMENTAL:
+				opts.incremental = 1;
+				break;
+			case OPT_MEM_LIMIT:
+				if (!(opts.mem_limit = parse_size(optarg))) {
+					fprintf(stderr, "option '--mem-limit' requires a positive size (with K, M or G suffix)\n");
+					usage();
+				}
+				break;
+			case OPT_DECOMPRESS:
+				decompress = 1;
+				break;
+			/* --nfc and --fold imply --utf8 */
+			case OPT_UTF8:
+				unicode |= TOK_UTF8;
+				break;
+			case OPT_NFC:
+				unicode |= TOK_UTF8 | TOK_NFC;
+				break;
+			case OPT_FOLD:
+				unicode |= TOK_UTF8 | TOK_FOLD;
+				break;
+			case OPT_STATS:
+				interval = optarg ? atoi(optarg) : STATS_INTERVAL;
+				if (interval <= 0) {
+					fprintf(stderr, "option '--stats' requires a positive number of seconds\n");
+					usage();
+				}
+				break;
 			case ':':
 			/* missing option argument */
 				fprintf(stderr, "option '-%c' requires an argument\n", optopt);
@@ -415,21 +1171,63 @@ int main(int argc, char **argv)
 		fprintf(stderr, "option '-%c' requires an argument\n", misopt);
 		usage();
 	}
-	/* missing required options */
-	if ((dflag && oflag) == 0) {
+	/* missing required options ('-o' is optional in pipeline mode) */
+	if ((dflag && (oflag || zipname)) == 0) {
 		fprintf(stderr, "missing required option '-%c'\n", (dflag==0) ? 'd' : 'o');
 		usage();
 	}
+	/* appending needs a text output in first-seen order */
+	if (opts.incremental && (!oflag || opts.binary || opts.freq)) {
+		fprintf(stderr, "option '--incremental' requires '-o' with a text output in first-seen order\n");
+		usage();
+	}
+	/* the output is the concatenation of the runs deduplicated */
+	if (opts.mem_limit && (!oflag || opts.binary || opts.freq || opts.incremental)) {
+		fprintf(stderr, "option '--mem-limit' requires '-o' with a text output in first-seen order,"
+		                " not '--incremental'\n");
+		usage();
+	}
+	if (rules && !zipname) {
+		fprintf(stderr, "option '-r' requires '-z'\n");
+		usage();
+	}
 	/* missing '-e' option */
 	if (eflag == 0) {
 		insert_list(list,default_ext[0]);
 		insert_list(list,default_ext[1]);
 	}
+	if (max_len && min_len > max_len) {
+		fprintf(stderr, "option '--min-len' is greater than '--max-len'\n");
+		usage();
+	}
 	/* search for files and harvest words */
-	find_and_harvest(list,htable,path,outfile);
+	tokenizer_unicode(unicode);
+	tokenizer_init();
+	tokenizer_limits(min_len, max_len);
+	if (zipname) {
+		if (!(za = zip_open(zipname)))
+			return 1;
+		if (za->n == 0) {
+			fprintf(stderr, "%s has no ZipCrypto encrypted entries\n", zipname);
+			return 1;
+		}
+		zipcrypto_init();
+	}
+	password = find_and_harvest(list,htable,path,outfile,jobs,za,&opts,rules,decompress,interval);
+	if (password)
+		printf("The password is %s\n", password);
+	else if (za) {
+		fprintf(stderr, "password not found\n");
+		ret = 1;
+	}
 
-	destroy_hash(htable);
+	free(password);
+	if (za)
+		zip_close(za);
+	hashset_destroy(htable);
 	free_list(list);
+	if (rules)
+		rules_free(rules);
 
-	return 0;
+	return ret;
 }
\ No newline at end of file
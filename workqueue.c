@@ -0,0 +1,222 @@
+/**
+ * @file workqueue.c
+ * @brief Pool of worker threads with work-stealing deques
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "workqueue.h"
+
+/**
+ * @brief Struct for the arguments of a worker thread.
+ */
+typedef struct _worker_arg {
+	workqueue *wq;
+	int id;
+} worker_arg;
+
+/**
+ * Pushes an item at the bottom of the deque, growing it if full.
+ */
+static void deque_push(deque_wq *d, void *item);
+
+/**
+ * Pops the most recent item from the bottom of the deque (owner side).
+ *
+ * @return item, or NULL if empty
+ */
+static void* deque_pop(deque_wq *d);
+
+/**
+ * Takes the oldest item from the top of the deque (thief side).
+ *
+ * @return item, or NULL if empty
+ */
+static void* deque_steal(deque_wq *d);
+
+/**
+ * Gets an item for worker id: from its own deque, or stolen from
+ * the other deques starting at a pseudo-random victim.
+ *
+ * @return item, or NULL if there is none
+ */
+static void* next_item(workqueue *wq, int id, unsigned *seed);
+
+/**
+ * Worker thread main loop.
+ */
+static void* worker(void *arg);
+
+static void deque_push(deque_wq *d, void *item)
+{
+	void **items;
+
+	pthread_mutex_lock(&d->lock);
+	if (d->bottom - d->top == d->cap) {
+		items = malloc(2 * d->cap * sizeof(void *));
+		if (!items) {
+			perror("can't allocate work queue");
+			exit(1);
+		}
+		for (size_t i = d->top; i != d->bottom; i++)
+			items[i & (2 * d->cap - 1)] = d->items[i & (d->cap - 1)];
+		free(d->items);
+		d->items = items;
+		d->cap *= 2;
+	}
+	d->items[d->bottom & (d->cap - 1)] = item;
+	__atomic_store_n(&d->bottom, d->bottom + 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&d->lock);
+}
+
+static void* deque_pop(deque_wq *d)
+{
+	void *item = NULL;
+
+	pthread_mutex_lock(&d->lock);
+	if (d->bottom != d->top) {
+		__atomic_store_n(&d->bottom, d->bottom - 1, __ATOMIC_RELAXED);
+		item = d->items[d->bottom & (d->cap - 1)];
+	}
+	pthread_mutex_unlock(&d->lock);
+	return item;
+}
+
+static void* deque_steal(deque_wq *d)
+{
+	void *item = NULL;
+
+	/* cheap unlocked peek, the locked check below is the real one */
+	if (__atomic_load_n(&d->bottom, __ATOMIC_RELAXED) == __atomic_load_n(&d->top, __ATOMIC_RELAXED))
+		return NULL;
+	pthread_mutex_lock(&d->lock);
+	if (d->bottom != d->top) {
+		item = d->items[d->top & (d->cap - 1)];
+		__atomic_store_n(&d->top, d->top + 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&d->lock);
+	return item;
+}
+
+static void* next_item(workqueue *wq, int id, unsigned *seed)
+{
+	void *item = deque_pop(&wq->deques[id]);
+	int victim;
+
+	if (!item && wq->nthreads > 1) {
+		*seed = *seed * 1103515245 + 12345;
+		victim = (*seed >> 16) % wq->nthreads;
+		for (int i = 0; i < wq->nthreads && !item; i++, victim = (victim + 1) % wq->nthreads) {
+			if (victim != id)
+				item = deque_steal(&wq->deques[victim]);
+		}
+	}
+	if (item)
+		__atomic_sub_fetch(&wq->queued, 1, __ATOMIC_SEQ_CST);
+	return item;
+}
+
+static void* worker(void *arg)
+{
+	workqueue *wq = ((worker_arg *)arg)->wq;
+	int id = ((worker_arg *)arg)->id;
+	unsigned seed = id + 1;
+	void *item;
+
+	free(arg);
+	for (;;) {
+		if ((item = next_item(wq, id, &seed)) != NULL) {
+			wq->fn(wq, id, item, wq->ctx);
+			/* last item finished after closing: wake everyone up to exit */
+			if (__atomic_sub_fetch(&wq->pending, 1, __ATOMIC_SEQ_CST) == 0 &&
+			    __atomic_load_n(&wq->closed, __ATOMIC_SEQ_CST)) {
+				pthread_mutex_lock(&wq->idle_lock);
+				pthread_cond_broadcast(&wq->idle_cond);
+				pthread_mutex_unlock(&wq->idle_lock);
+			}
+			continue;
+		}
+		pthread_mutex_lock(&wq->idle_lock);
+		__atomic_add_fetch(&wq->sleepers, 1, __ATOMIC_SEQ_CST);
+		while (__atomic_load_n(&wq->queued, __ATOMIC_SEQ_CST) == 0 &&
+		       !(wq->closed && __atomic_load_n(&wq->pending, __ATOMIC_SEQ_CST) == 0))
+			pthread_cond_wait(&wq->idle_cond, &wq->idle_lock);
+		__atomic_sub_fetch(&wq->sleepers, 1, __ATOMIC_SEQ_CST);
+		if (wq->closed && __atomic_load_n(&wq->pending, __ATOMIC_SEQ_CST) == 0) {
+			pthread_mutex_unlock(&wq->idle_lock);
+			break;
+		}
+		pthread_mutex_unlock(&wq->idle_lock);
+	}
+	return NULL;
+}
+
+workqueue* wq_create(int nthreads, wq_fn fn, void *ctx)
+{
+	workqueue *wq = calloc(1, sizeof(workqueue));
+	worker_arg *arg;
+
+	if (!wq) {
+		perror("can't allocate work queue");
+		exit(1);
+	}
+	wq->nthreads = nthreads;
+	wq->fn = fn;
+	wq->ctx = ctx;
+	wq->threads = calloc(nthreads, sizeof(pthread_t));
+	wq->deques = calloc(nthreads, sizeof(deque_wq));
+	pthread_mutex_init(&wq->idle_lock, NULL);
+	pthread_cond_init(&wq->idle_cond, NULL);
+	for (int i = 0; i < nthreads; i++) {
+		pthread_mutex_init(&wq->deques[i].lock, NULL);
+		wq->deques[i].cap = WQ_MIN_CAP;
+		wq->deques[i].items = malloc(WQ_MIN_CAP * sizeof(void *));
+	}
+	for (int i = 0; i < nthreads; i++) {
+		arg = malloc(sizeof(worker_arg));
+		arg->wq = wq;
+		arg->id = i;
+		if (pthread_create(&wq->threads[i], NULL, worker, arg) != 0) {
+			perror("can't create worker thread");
+			exit(1);
+		}
+	}
+	return wq;
+}
+
+void wq_push(workqueue *wq, int id, void *item)
+{
+	if (id < 0)
+		id = wq->next++ % wq->nthreads;
+	__atomic_add_fetch(&wq->pending, 1, __ATOMIC_SEQ_CST);
+	deque_push(&wq->deques[id], item);
+	__atomic_add_fetch(&wq->queued, 1, __ATOMIC_SEQ_CST);
+	/* wake up an idle worker, if any */
+	if (__atomic_load_n(&wq->sleepers, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&wq->idle_lock);
+		pthread_cond_signal(&wq->idle_cond);
+		pthread_mutex_unlock(&wq->idle_lock);
+	}
+}
+
+void wq_finish(workqueue *wq)
+{
+	pthread_mutex_lock(&wq->idle_lock);
+	__atomic_store_n(&wq->closed, 1, __ATOMIC_SEQ_CST);
+	pthread_cond_broadcast(&wq->idle_cond);
+	pthread_mutex_unlock(&wq->idle_lock);
+	for (int i = 0; i < wq->nthreads; i++)
+		pthread_join(wq->threads[i], NULL);
+	for (int i = 0; i < wq->nthreads; i++) {
+		pthread_mutex_destroy(&wq->deques[i].lock);
+		free(wq->deques[i].items);
+	}
+	pthread_mutex_destroy(&wq->idle_lock);
+	pthread_cond_destroy(&wq->idle_cond);
+	free(wq->deques);
+	free(wq->threads);
+	free(wq);
+}
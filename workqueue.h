@@ -0,0 +1,92 @@
+/**
+ * @file workqueue.h
+ * @brief Pool of worker threads with work-stealing deques
+ *
+ * Each worker owns a deque of items: it pops the most recent item from its own
+ * deque (LIFO, the data is still warm in cache) and, when it is empty, steals the
+ * oldest item of another worker deque. Items are pushed by an external producer
+ * (spread round-robin over the workers) or by the workers themselves, e.g. to
+ * split a big item in pieces that idle workers can steal.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/** Initial capacity of each deque */
+#define WQ_MIN_CAP 256
+
+/**
+ * @brief Struct for a worker deque (ring buffer protected by a lock).
+ */
+typedef struct _deque_wq {
+	pthread_mutex_t lock;
+	void **items;
+	size_t cap;	/* power of two */
+	size_t top;	/* oldest item, stolen by other workers */
+	size_t bottom;	/* next free position, owner side */
+} deque_wq;
+
+typedef struct _workqueue workqueue;
+
+/**
+ * Callback running one item.
+ *
+ * @param wq  pointer to work queue, to push more items
+ * @param id  worker index (0 to nthreads - 1)
+ * @param item  item to be run
+ * @param ctx  context pointer passed to wq_create
+ */
+typedef void (*wq_fn)(workqueue *wq, int id, void *item, void *ctx);
+
+/**
+ * @brief Struct for the work queue.
+ */
+struct _workqueue {
+	int nthreads;
+	pthread_t *threads;
+	deque_wq *deques;
+	wq_fn fn;
+	void *ctx;
+	size_t next;	/* round-robin position for external pushes */
+	size_t pending;	/* items pushed and not finished yet */
+	size_t queued;	/* items waiting in the deques */
+	int sleepers;	/* idle workers waiting for items */
+	int closed;	/* no more external items */
+	pthread_mutex_t idle_lock;
+	pthread_cond_t idle_cond;
+};
+
+/**
+ * Allocates the work queue and starts the worker threads.
+ *
+ * @param nthreads  number of worker threads
+ * @param fn  callback running each item
+ * @param ctx  context pointer passed to fn
+ *
+ * @return pointer to new work queue
+ */
+workqueue* wq_create(int nthreads, wq_fn fn, void *ctx);
+
+/**
+ * Pushes an item in a worker deque.
+ *
+ * @param wq  pointer to work queue
+ * @param id  index of the worker pushing the item, or -1 for external producers
+ * @param item  item to be run
+ */
+void wq_push(workqueue *wq, int id, void *item);
+
+/**
+ * Waits for all items to be run, stops the workers
+ * and deallocates the work queue.
+ *
+ * @param wq  pointer to work queue
+ */
+void wq_finish(workqueue *wq);
+
+#endif
@@ -0,0 +1,237 @@
+/**
+ * @file writer.c
+ * @brief Buffered batched output writer for the dictionary file
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "writer.h"
+
+/**
+ * Allocates a batch with cap bytes.
+ */
+static outbuf* new_batch(size_t cap, int oneshot);
+
+/**
+ * Writes the list of batches with writev, OUT_IOV batches per call.
+ */
+static void write_batches(writer *w, outbuf *list);
+
+/**
+ * Puts written batches back in the pool (long word batches are freed).
+ */
+static void recycle(writer *w, outbuf *list);
+
+/**
+ * Queues a batch for the writer thread, or writes it right away.
+ */
+static void enqueue(writer *w, outbuf *b);
+
+/**
+ * Writer thread main loop.
+ */
+static void* writer_main(void *arg);
+
+static outbuf* new_batch(size_t cap, int oneshot)
+{
+	outbuf *b = malloc(sizeof(outbuf));
+
+	if (!b || !(b->data = malloc(cap))) {
+		perror("can't allocate output buffer");
+		exit(1);
+	}
+	b->len = 0;
+	b->cap = cap;
+	b->oneshot = oneshot;
+	b->next = NULL;
+	return b;
+}
+
+static void write_batches(writer *w, outbuf *list)
+{
+	struct iovec iov[OUT_IOV];
+	int n, i;
+	ssize_t r;
+
+	while (list) {
+		for (n = 0; list && n < OUT_IOV; list = list->next, n++) {
+			iov[n].iov_base = list->data;
+			iov[n].iov_len = list->len;
+		}
+		/* write everything, resuming after partial writes */
+		for (i = 0; i < n; ) {
+			r = writev(w->fd, iov + i, n - i);
+			if (r < 0) {
+				if (errno == EINTR)
+					continue;
+				perror("can't write output file");
+				exit(1);
+			}
+			for (; i < n && (size_t)r >= iov[i].iov_len; i++)
+				r -= iov[i].iov_len;
+			if (i < n) {
+				iov[i].iov_base = (char *)iov[i].iov_base + r;
+				iov[i].iov_len -= r;
+			}
+		}
+	}
+}
+
+static void recycle(writer *w, outbuf *list)
+{
+	outbuf *nxt;
+
+	pthread_mutex_lock(&w->lock);
+	for (; list; list = nxt) {
+		nxt = list->next;
+		if (list->oneshot) {
+			free(list->data);
+			free(list);
+			continue;
+		}
+		list->len = 0;
+		list->next = w->pool;
+		w->pool = list;
+	}
+	pthread_cond_broadcast(&w->free_cond);
+	pthread_mutex_unlock(&w->lock);
+}
+
+static void enqueue(writer *w, outbuf *b)
+{
+	b->next = NULL;
+	if (!w->threaded) {
+		write_batches(w, b);
+		recycle(w, b);
+		return;
+	}
+	pthread_mutex_lock(&w->lock);
+	if (w->tail)
+		w->tail->next = b;
+	else
+		w->head = b;
+	w->tail = b;
+	pthread_cond_signal(&w->full_cond);
+	pthread_mutex_unlock(&w->lock);
+}
+
+static void* writer_main(void *arg)
+{
+	writer *w = arg;
+	outbuf *list;
+
+	for (;;) {
+		pthread_mutex_lock(&w->lock);
+		while (!w->head && !w->closing)
+			pthread_cond_wait(&w->full_cond, &w->lock);
+		list = w->head;
+		w->head = w->tail = NULL;
+		pthread_mutex_unlock(&w->lock);
+		if (!list)	/* closing and nothing left */
+			break;
+		write_batches(w, list);
+		recycle(w, list);
+	}
+	return NULL;
+}
+
+writer* writer_open(const char *path, int append, int threaded, int nthreads)
+{
+	writer *w = calloc(1, sizeof(writer));
+
+	if (!w) {
+		perror("can't allocate writer");
+		exit(1);
+	}
+	w->fd = open(path, O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC) | O_CLOEXEC, 0666);
+	if (w->fd < 0) {
+		perror("can't open write file");
+		exit(1);
+	}
+	w->threaded = threaded;
+	/* one batch being filled and one queued per thread, plus the one being written */
+	w->max_batches = 2 * nthreads + 1;
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->full_cond, NULL);
+	pthread_cond_init(&w->free_cond, NULL);
+	if (threaded && pthread_create(&w->thread, NULL, writer_main, w) != 0) {
+		perror("can't create writer thread");
+		exit(1);
+	}
+	return w;
+}
+
+outbuf* writer_batch(writer *w)
+{
+	outbuf *b = NULL;
+
+	pthread_mutex_lock(&w->lock);
+	/* back pressure: wait for the writer thread instead of growing */
+	while (!w->pool && w->threaded && w->nbatches >= w->max_batches)
+		pthread_cond_wait(&w->free_cond, &w->lock);
+	if (w->pool) {
+		b = w->pool;
+		w->pool = b->next;
+	}
+	else
+		w->nbatches++;
+	pthread_mutex_unlock(&w->lock);
+	return b ? b : new_batch(OUT_BATCH, 0);
+}
+
+void writer_submit(writer *w, outbuf **b)
+{
+	enqueue(w, *b);
+	*b = writer_batch(w);
+}
+
+void writer_long(writer *w, outbuf **b, const char *word, size_t len)
+{
+	outbuf *o = new_batch(len + 1, 1);
+
+	if ((*b)->len)
+		writer_submit(w, b);
+	memcpy(o->data, word, len);
+	o->data[len] = '\n';
+	o->len = len + 1;
+	enqueue(w, o);
+}
+
+void writer_put(writer *w, outbuf *b)
+{
+	if (b->len)
+		enqueue(w, b);
+	else
+		recycle(w, b);
+}
+
+void writer_close(writer *w)
+{
+	outbuf *nxt;
+
+	if (w->threaded) {
+		pthread_mutex_lock(&w->lock);
+		w->closing = 1;
+		pthread_cond_signal(&w->full_cond);
+		pthread_mutex_unlock(&w->lock);
+		pthread_join(w->thread, NULL);
+	}
+	for (outbuf *b = w->pool; b; b = nxt) {
+		nxt = b->next;
+		free(b->data);
+		free(b);
+	}
+	if (close(w->fd) < 0)
+		perror("can't write output file");
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->full_cond);
+	pthread_cond_destroy(&w->free_cond);
+	free(w);
+}
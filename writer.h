@@ -0,0 +1,137 @@
+/**
+ * @file writer.h
+ * @brief Buffered batched output writer for the dictionary file
+ *
+ * Words are appended, one per line, to batches (large buffers) owned by each
+ * harvesting thread, so no lock is taken per word. Full batches are handed to
+ * the writer, which writes them with writev: either right away in the calling
+ * thread, or in a writer thread, so harvesting threads never wait on the disk
+ * (they only wait when all the batches in the pool are still queued).
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+
+/** Size of each batch */
+#define OUT_BATCH (1UL << 20)
+
+/** Max batches written at once by a writev call */
+#define OUT_IOV 64
+
+/**
+ * @brief Struct for output batches.
+ */
+typedef struct _outbuf {
+	char *data;
+	size_t len;
+	size_t cap;
+	int oneshot;	/* sized for one long word, freed after writing */
+	struct _outbuf *next;
+} outbuf;
+
+/**
+ * @brief Struct for the output writer.
+ */
+typedef struct _writer {
+	int fd;
+	int threaded;	/* batches written by the writer thread */
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t full_cond;	/* batches queued, or closing */
+	pthread_cond_t free_cond;	/* batches back to the pool */
+	outbuf *head, *tail;	/* batches waiting to be written */
+	outbuf *pool;	/* empty batches */
+	size_t nbatches;	/* batches allocated */
+	size_t max_batches;
+	int closing;
+} writer;
+
+/**
+ * Creates (truncating, or appending to) the output file and, if threaded,
+ * starts the writer thread. Exits on error.
+ *
+ * @param path  string with output file name
+ * @param append  1 to append to an existing file, 0 to truncate it
+ * @param threaded  1 to write from a writer thread
+ * @param nthreads  number of threads appending words
+ *
+ * @return pointer to new writer
+ */
+writer* writer_open(const char *path, int append, int threaded, int nthreads);
+
+/**
+ * Gets an empty batch from the writer pool.
+ *
+ * @param w  pointer to writer
+ *
+ * @return pointer to batch
+ */
+outbuf* writer_batch(writer *w);
+
+/**
+ * Hands the batch to the writer, replacing it with an empty one.
+ *
+ * @param w  pointer to writer
+ * @param b  pointer to the caller batch
+ */
+void writer_submit(writer *w, outbuf **b);
+
+/**
+ * Writes a word longer than a batch (after the current batch).
+ *
+ * @param w  pointer to writer
+ * @param b  pointer to the caller batch
+ * @param word  word chars
+ * @param len  word length
+ */
+void writer_long(writer *w, outbuf **b, const char *word, size_t len);
+
+/**
+ * Hands the last batch of a thread to the writer.
+ *
+ * @param w  pointer to writer
+ * @param b  batch
+ */
+void writer_put(writer *w, outbuf *b);
+
+/**
+ * Writes all queued batches, stops the writer thread,
+ * closes the file and deallocates the writer.
+ *
+ * @param w  pointer to writer
+ */
+void writer_close(writer *w);
+
+/**
+ * Appends the word and a newline to the batch, handing
+ * it to the writer when full.
+ *
+ * @param w  pointer to writer
+ * @param b  pointer to the caller batch
+ * @param word  word chars (not NUL-terminated)
+ * @param len  word length
+ */
+static inline void writer_word(writer *w, outbuf **b, const char *word, size_t len)
+{
+	outbuf *o = *b;
+
+	if (o->cap - o->len < len + 1) {
+		if (len + 1 > o->cap) {
+			writer_long(w, b, word, len);
+			return;
+		}
+		writer_submit(w, b);
+		o = *b;
+	}
+	memcpy(o->data + o->len, word, len);
+	o->data[o->len + len] = '\n';
+	o->len += len + 1;
+}
+
+#endif
@@ -0,0 +1,466 @@
+/**
+ * @file zipcrypto.c
+ * @brief ZipCrypto (traditional PKWARE encryption) password checks
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "zipcrypto.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ZC_X86
+#endif
+
+/** Size of the steps decrypting and inflating an entry */
+#define ZC_STEP (64 * 1024)
+
+/** Group routine type (one per instruction set) */
+typedef size_t (*many_fn)(const zip_archive *za, const zc_cand *c, size_t n);
+
+/** Routine type testing keys already past the password */
+typedef size_t (*keys_fn)(const zip_archive *za, const zc_key_rows *k, size_t n);
+
+uint32_t zc_crc_table[256];
+
+static many_fn test_many;
+static keys_fn test_keys;
+static const char *many_name;
+
+/**
+ * Header checks and full verification of keys initialized with a password.
+ *
+ * @return 1 if the password is right, 0 if wrong
+ */
+static int check_keys(const zip_archive *za, const zc_keys *k);
+
+static int check_keys(const zip_archive *za, const zc_keys *k)
+{
+	size_t n = za->n < ZC_MAX_CHECKS ? za->n : ZC_MAX_CHECKS;
+
+	for (size_t i = 0; i < n; i++) {
+		if (!zc_check_header(k, &za->entries[i]))
+			return 0;
+	}
+	return zc_verify(k, &za->entries[0]);
+}
+
+/**
+ * Tests the candidates one by one (also the fallback for long ones).
+ */
+static size_t many_scalar(const zip_archive *za, const zc_cand *c, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		if (zc_test(za, c[i].pw, c[i].len))
+			return i;
+	}
+	return n;
+}
+
+/**
+ * Tests the keys one by one.
+ */
+static size_t keys_scalar(const zip_archive *za, const zc_key_rows *k, size_t n)
+{
+	zc_keys t;
+
+	for (size_t i = 0; i < n; i++) {
+		t.k0 = k->k0[i], t.k1 = k->k1[i], t.k2 = k->k2[i];
+		if (check_keys(za, &t))
+			return i;
+	}
+	return n;
+}
+
+/**
+ * Tests the lanes whose header check passed, like keys_scalar.
+ *
+ * @return index of the right password, or n if none is
+ */
+static size_t keys_hits(const zip_archive *za, const zc_key_rows *k, size_t i, unsigned hits, size_t n)
+{
+	zc_keys t;
+	size_t r;
+
+	for (; hits; hits &= hits - 1) {
+		r = i + __builtin_ctz(hits);
+		t.k0 = k->k0[r], t.k1 = k->k1[r], t.k2 = k->k2[r];
+		if (check_keys(za, &t))
+			return r;
+	}
+	return n;
+}
+
+/**
+ * Copies a group of candidates in columns (byte position major), zero padded,
+ * so each step loads the bytes of all lanes at once.
+ *
+ * @return length of the longest candidate
+ */
+static size_t transpose(const zc_cand *c, size_t lanes, size_t width,
+                        unsigned char cols[][16], uint32_t *lens)
+{
+	size_t max = 0;
+
+	for (size_t j = 0; j < lanes; j++)
+		max = c[j].len > max ? c[j].len : max;
+	if (max > ZC_SIMD_LEN)
+		return max;
+	memset(cols, 0, max * sizeof(cols[0]));
+	memset(lens, 0, width * sizeof(uint32_t));
+	for (size_t j = 0; j < lanes; j++) {
+		for (size_t b = 0; b < c[j].len; b++)
+			cols[b][j] = c[j].pw[b];
+		lens[j] = c[j].len;
+	}
+	return max;
+}
+
+#ifdef ZC_X86
+
+/*** AVX2 and AVX-512 routines ***/
+
+static inline __attribute__((always_inline, target("avx2")))
+void update_avx2(__m256i *k0, __m256i *k1, __m256i *k2, __m256i c)
+{
+	const __m256i ff = _mm256_set1_epi32(0xff);
+	__m256i i0 = _mm256_and_si256(_mm256_xor_si256(*k0, c), ff);
+
+	*k0 = _mm256_xor_si256(_mm256_srli_epi32(*k0, 8),
+	                       _mm256_i32gather_epi32((const int *)zc_crc_table, i0, 4));
+	*k1 = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_add_epi32(*k1, _mm256_and_si256(*k0, ff)),
+	                                          _mm256_set1_epi32(134775813)), _mm256_set1_epi32(1));
+	i0 = _mm256_and_si256(_mm256_xor_si256(*k2, _mm256_srli_epi32(*k1, 24)), ff);
+	*k2 = _mm256_xor_si256(_mm256_srli_epi32(*k2, 8),
+	                       _mm256_i32gather_epi32((const int *)zc_crc_table, i0, 4));
+}
+
+/**
+ * Decrypts the encryption header of the entry in every lane.
+ *
+ * @return mask of the lanes whose last byte matches the check byte
+ */
+static inline __attribute__((always_inline, target("avx2")))
+unsigned header_avx2(__m256i k0, __m256i k1, __m256i k2, const zip_entry *e)
+{
+	__m256i t, p = _mm256_setzero_si256();
+
+	for (int h = 0; h < ZIP_HEADER_SIZE; h++) {
+		t = _mm256_and_si256(_mm256_or_si256(k2, _mm256_set1_epi32(2)), _mm256_set1_epi32(0xffff));
+		t = _mm256_srli_epi32(_mm256_mullo_epi32(t, _mm256_xor_si256(t, _mm256_set1_epi32(1))), 8);
+		p = _mm256_and_si256(_mm256_xor_si256(_mm256_set1_epi32(e->header[h]), t), _mm256_set1_epi32(0xff));
+		update_avx2(&k0, &k1, &k2, p);
+	}
+	return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(p, _mm256_set1_epi32(e->check))));
+}
+
+__attribute__((target("avx2")))
+static size_t many_avx2(const zip_archive *za, const zc_cand *c, size_t n)
+{
+	const zip_entry *e = &za->entries[0];
+	unsigned char cols[ZC_SIMD_LEN][16];
+	uint32_t lens[8];
+	__m256i k0, k1, k2, n0, n1, n2, len, m;
+	size_t lanes, max, r;
+	unsigned hits;
+
+	for (size_t i = 0; i < n; i += lanes) {
+		lanes = n - i < 8 ? n - i : 8;
+		if ((max = transpose(c + i, lanes, 8, cols, lens)) > ZC_SIMD_LEN) {
+			if ((r = many_scalar(za, c + i, lanes)) < lanes)
+				return i + r;
+			continue;
+		}
+		k0 = _mm256_set1_epi32(ZC_KEY0);
+		k1 = _mm256_set1_epi32(ZC_KEY1);
+		k2 = _mm256_set1_epi32(ZC_KEY2);
+		len = _mm256_loadu_si256((const __m256i *)lens);
+		/* password bytes, lanes past their length keep their keys */
+		for (size_t b = 0; b < max; b++) {
+			n0 = k0, n1 = k1, n2 = k2;
+			update_avx2(&n0, &n1, &n2, _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)cols[b])));
+			m = _mm256_cmpgt_epi32(len, _mm256_set1_epi32(b));
+			k0 = _mm256_blendv_epi8(k0, n0, m);
+			k1 = _mm256_blendv_epi8(k1, n1, m);
+			k2 = _mm256_blendv_epi8(k2, n2, m);
+		}
+		hits = header_avx2(k0, k1, k2, e) & ((1U << lanes) - 1);
+		/* the few candidates left go through all the checks */
+		for (; hits; hits &= hits - 1) {
+			r = __builtin_ctz(hits);
+			if (zc_test(za, c[i + r].pw, c[i + r].len))
+				return i + r;
+		}
+	}
+	return n;
+}
+
+static inline __attribute__((always_inline, target("avx512f")))
+void update_avx512(__m512i *k0, __m512i *k1, __m512i *k2, __m512i c, __mmask16 m)
+{
+	const __m512i ff = _mm512_set1_epi32(0xff);
+	__m512i i0 = _mm512_and_si512(_mm512_xor_si512(*k0, c), ff);
+
+	*k0 = _mm512_mask_xor_epi32(*k0, m, _mm512_srli_epi32(*k0, 8),
+	                            _mm512_i32gather_epi32(i0, (const int *)zc_crc_table, 4));
+	*k1 = _mm512_mask_add_epi32(*k1, m, _mm512_mullo_epi32(_mm512_add_epi32(*k1, _mm512_and_si512(*k0, ff)),
+	                                                        _mm512_set1_epi32(134775813)), _mm512_set1_epi32(1));
+	i0 = _mm512_and_si512(_mm512_xor_si512(*k2, _mm512_srli_epi32(*k1, 24)), ff);
+	*k2 = _mm512_mask_xor_epi32(*k2, m, _mm512_srli_epi32(*k2, 8),
+	                            _mm512_i32gather_epi32(i0, (const int *)zc_crc_table, 4));
+}
+
+/**
+ * Decrypts the encryption header of the entry in every lane.
+ *
+ * @return mask of the lanes whose last byte matches the check byte
+ */
+static inline __attribute__((always_inline, target("avx512f")))
+unsigned header_avx512(__m512i k0, __m512i k1, __m512i k2, const zip_entry *e)
+{
+	__m512i t, p = _mm512_setzero_si512();
+
+	for (int h = 0; h < ZIP_HEADER_SIZE; h++) {
+		t = _mm512_and_si512(_mm512_or_si512(k2, _mm512_set1_epi32(2)), _mm512_set1_epi32(0xffff));
+		t = _mm512_srli_epi32(_mm512_mullo_epi32(t, _mm512_xor_si512(t, _mm512_set1_epi32(1))), 8);
+		p = _mm512_and_si512(_mm512_xor_si512(_mm512_set1_epi32(e->header[h]), t), _mm512_set1_epi32(0xff));
+		update_avx512(&k0, &k1, &k2, p, 0xffff);
+	}
+	return _mm512_cmpeq_epi32_mask(p, _mm512_set1_epi32(e->check));
+}
+
+__attribute__((target("avx512f")))
+static size_t many_avx512(const zip_archive *za, const zc_cand *c, size_t n)
+{
+	const zip_entry *e = &za->entries[0];
+	unsigned char cols[ZC_SIMD_LEN][16];
+	uint32_t lens[16];
+	__m512i k0, k1, k2, len;
+	size_t lanes, max, r;
+	unsigned hits;
+
+	for (size_t i = 0; i < n; i += lanes) {
+		lanes = n - i < 16 ? n - i : 16;
+		if ((max = transpose(c + i, lanes, 16, cols, lens)) > ZC_SIMD_LEN) {
+			if ((r = many_scalar(za, c + i, lanes)) < lanes)
+				return i + r;
+			continue;
+		}
+		k0 = _mm512_set1_epi32(ZC_KEY0);
+		k1 = _mm512_set1_epi32(ZC_KEY1);
+		k2 = _mm512_set1_epi32(ZC_KEY2);
+		len = _mm512_loadu_si512(lens);
+		/* password bytes, lanes past their length are masked out */
+		for (size_t b = 0; b < max; b++)
+			update_avx512(&k0, &k1, &k2, _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)cols[b])),
+			              _mm512_cmpgt_epu32_mask(len, _mm512_set1_epi32(b)));
+		hits = header_avx512(k0, k1, k2, e) & ((1U << lanes) - 1);
+		/* the few candidates left go through all the checks */
+		for (; hits; hits &= hits - 1) {
+			r = __builtin_ctz(hits);
+			if (zc_test(za, c[i + r].pw, c[i + r].len))
+				return i + r;
+		}
+	}
+	return n;
+}
+
+__attribute__((target("avx2")))
+static size_t keys_avx2(const zip_archive *za, const zc_key_rows *k, size_t n)
+{
+	size_t lanes, r;
+	unsigned hits;
+
+	/* the rows are padded up to the group size, the lanes past n are masked out */
+	for (size_t i = 0; i < n; i += lanes) {
+		lanes = n - i < 8 ? n - i : 8;
+		hits = header_avx2(_mm256_loadu_si256((const __m256i *)&k->k0[i]),
+		                   _mm256_loadu_si256((const __m256i *)&k->k1[i]),
+		                   _mm256_loadu_si256((const __m256i *)&k->k2[i]), &za->entries[0]);
+		if ((r = keys_hits(za, k, i, hits & ((1U << lanes) - 1), n)) < n)
+			return r;
+	}
+	return n;
+}
+
+__attribute__((target("avx512f")))
+static size_t keys_avx512(const zip_archive *za, const zc_key_rows *k, size_t n)
+{
+	size_t lanes, r;
+	unsigned hits;
+
+	for (size_t i = 0; i < n; i += lanes) {
+		lanes = n - i < 16 ? n - i : 16;
+		hits = header_avx512(_mm512_loadu_si512(&k->k0[i]), _mm512_loadu_si512(&k->k1[i]),
+		                     _mm512_loadu_si512(&k->k2[i]), &za->entries[0]);
+		if ((r = keys_hits(za, k, i, hits & ((1U << lanes) - 1), n)) < n)
+			return r;
+	}
+	return n;
+}
+
+#endif
+
+void zipcrypto_init(void)
+{
+	uint32_t c;
+
+	for (uint32_t i = 0; i < 256; i++) {
+		c = i;
+		for (int j = 0; j < 8; j++)
+			c = (c & 1) ? (c >> 1) ^ 0xedb88320 : c >> 1;
+		zc_crc_table[i] = c;
+	}
+#if defined(ZC_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		test_many = many_avx512;
+		test_keys = keys_avx512;
+		many_name = "avx512";
+	}
+	else if (__builtin_cpu_supports("avx2")) {
+		test_many = many_avx2;
+		test_keys = keys_avx2;
+		many_name = "avx2";
+	}
+	else
+#endif
+	{
+		test_many = many_scalar;
+		test_keys = keys_scalar;
+		many_name = "scalar";
+	}
+}
+
+const char* zipcrypto_name(void)
+{
+	if (!test_many)
+		zipcrypto_init();
+	return many_name;
+}
+
+int zc_verify(const zc_keys *k, const zip_entry *e)
+{
+	unsigned char in[ZC_STEP], out[ZC_STEP];
+	zc_keys t = *k;
+	z_stream zs = { 0 };
+	uint64_t pos = 0, total = 0;
+	uLong crc = crc32(0, Z_NULL, 0);
+	size_t n;
+	int r = Z_OK;
+
+	for (int i = 0; i < ZIP_HEADER_SIZE; i++)
+		zc_decrypt(&t, e->header[i]);
+	if (e->method == ZIP_DEFLATED && inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+		fprintf(stderr, "can't initialize zlib\n");
+		exit(1);
+	}
+	while (pos < e->csize && r != Z_STREAM_END) {
+		/* a small first step, most wrong passwords end there */
+		n = pos == 0 && e->method == ZIP_DEFLATED ? ZIP_PROBE_SIZE : ZC_STEP;
+		n = e->csize - pos < n ? e->csize - pos : n;
+		for (size_t i = 0; i < n; i++)
+			in[i] = zc_decrypt(&t, e->data[pos + i]);
+		pos += n;
+		if (e->method == ZIP_STORED) {
+			crc = crc32(crc, in, n);
+			total += n;
+			continue;
+		}
+		/* garbage from a wrong password is almost always an invalid deflate stream */
+		zs.next_in = in;
+		zs.avail_in = n;
+		do {
+			zs.next_out = out;
+			zs.avail_out = ZC_STEP;
+			r = inflate(&zs, Z_NO_FLUSH);
+			if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR)
+				goto wrong;
+			crc = crc32(crc, out, ZC_STEP - zs.avail_out);
+			total += ZC_STEP - zs.avail_out;
+			if (total > e->usize)
+				goto wrong;
+		} while (zs.avail_out == 0 && r != Z_STREAM_END);
+	}
+	if (e->method == ZIP_DEFLATED) {
+		inflateEnd(&zs);
+		if (r != Z_STREAM_END)
+			return 0;
+	}
+	return total == e->usize && crc == e->crc;
+
+wrong:
+	inflateEnd(&zs);
+	return 0;
+}
+
+int zc_test(const zip_archive *za, const char *pw, size_t len)
+{
+	zc_keys k;
+
+	zc_init_keys(&k, pw, len);
+	return check_keys(za, &k);
+}
+
+size_t zc_test_many(const zip_archive *za, const zc_cand *c, size_t n)
+{
+	return test_many(za, c, n);
+}
+
+void zc_prefix_init(zc_prefix *p)
+{
+	p->stack[0].k0 = ZC_KEY0;
+	p->stack[0].k1 = ZC_KEY1;
+	p->stack[0].k2 = ZC_KEY2;
+	p->prev = NULL;
+	p->depth = 0;
+}
+
+void zc_prefix_keys(zc_prefix *p, const zc_cand *c, size_t n, zc_key_rows *k)
+{
+	zc_keys t;
+	size_t l;
+
+	/* stack[d]: keys after the first d bytes of the previous candidate */
+	for (size_t i = 0; i < n; i++) {
+		for (l = 0; l < p->depth && l < c[i].len && p->prev[l] == c[i].pw[l]; l++)
+			;
+		t = p->stack[l];
+		for (; l < c[i].len; l++) {
+			zc_update(&t, c[i].pw[l]);
+			if (l < ZC_PREFIX_LEN)
+				p->stack[l + 1] = t;
+		}
+		p->prev = c[i].pw;
+		p->depth = c[i].len < ZC_PREFIX_LEN ? c[i].len : ZC_PREFIX_LEN;
+		k->k0[i] = t.k0;
+		k->k1[i] = t.k1;
+		k->k2[i] = t.k2;
+	}
+}
+
+size_t zc_test_keys(const zip_archive *za, const zc_key_rows *k, size_t n)
+{
+	return test_keys(za, k, n);
+}
+
+size_t zc_test_prefixed(const zip_archive *za, const zc_cand *c, size_t n)
+{
+	zc_prefix p;
+	zc_key_rows k;
+	size_t lanes, r;
+
+	zc_prefix_init(&p);
+	for (size_t i = 0; i < n; i += lanes) {
+		lanes = n - i < ZC_KEYS_GROUP ? n - i : ZC_KEYS_GROUP;
+		zc_prefix_keys(&p, c + i, lanes, &k);
+		if ((r = test_keys(za, &k, lanes)) < lanes)
+			return i + r;
+	}
+	return n;
+}
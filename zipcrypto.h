@@ -0,0 +1,235 @@
+/**
+ * @file zipcrypto.h
+ * @brief ZipCrypto (traditional PKWARE encryption) password checks
+ *
+ * The password feeds a key schedule of three 32 bit keys, which generates the
+ * stream decrypting the entry. The 12 byte encryption header is decrypted first:
+ * its last byte must match the entry check byte, which rejects 255 of every 256
+ * wrong passwords with 12 key updates and no decompression. Only passwords passing
+ * the header checks are fully verified, decrypting and inflating the entry (zlib)
+ * and comparing its CRC-32 and size.
+ * Candidates are also tested in groups, advancing the keys of 8 (AVX2) or 16
+ * (AVX-512) candidates in lockstep, one byte position per step, with gathers for
+ * the CRC table lookups (the routine is chosen at runtime by zipcrypto_init).
+ * Candidates ordered so that neighbours share prefixes (rule variants of the same
+ * word, sorted dictionaries) can be tested with zc_test_prefixed instead: the keys
+ * after each byte of the previous candidate are kept in a stack, so a candidate
+ * only runs the bytes past the prefix it shares with the previous one, and only
+ * the encryption headers run in lockstep. As the keys past the password do not
+ * depend on the archive, zc_prefix_keys and zc_test_keys split the two steps to
+ * test the same keys on several archives.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef ZIPCRYPTO_H
+#define ZIPCRYPTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "zipfile.h"
+
+/** Entries whose headers are checked before the full verification */
+#define ZC_MAX_CHECKS 8
+
+/** Candidates longer than this are tested one by one */
+#define ZC_SIMD_LEN 64
+
+/** Longest prefix whose keys are kept for the next candidate */
+#define ZC_PREFIX_LEN 64
+
+/** Candidates whose keys are computed before testing their headers together */
+#define ZC_KEYS_GROUP 64
+
+/** Initial keys, before the password */
+#define ZC_KEY0 0x12345678
+#define ZC_KEY1 0x23456789
+#define ZC_KEY2 0x34567890
+
+/**
+ * @brief Struct for the key schedule state.
+ */
+typedef struct _zc_keys {
+	uint32_t k0, k1, k2;
+} zc_keys;
+
+/**
+ * @brief Struct for a candidate password (not NUL-terminated).
+ */
+typedef struct _zc_cand {
+	const char *pw;
+	size_t len;
+} zc_cand;
+
+/**
+ * @brief Struct for the keys of a group of candidates past their password
+ * (one row per key, so SIMD lanes load them directly).
+ */
+typedef struct _zc_key_rows {
+	uint32_t k0[ZC_KEYS_GROUP];
+	uint32_t k1[ZC_KEYS_GROUP];
+	uint32_t k2[ZC_KEYS_GROUP];
+} zc_key_rows;
+
+/**
+ * @brief Struct for the keys of the prefixes of the previous candidate.
+ */
+typedef struct _zc_prefix {
+	zc_keys stack[ZC_PREFIX_LEN + 1];	/* keys after each of its first bytes */
+	const char *prev;	/* previous candidate (must stay valid) */
+	size_t depth;	/* prefix bytes with keys in the stack */
+} zc_prefix;
+
+/** CRC-32 lookup table used by the key schedule */
+extern uint32_t zc_crc_table[256];
+
+/**
+ * Builds the CRC-32 table and selects the fastest group routine
+ * supported by the CPU. Called once before checking passwords.
+ */
+void zipcrypto_init(void);
+
+/**
+ * Name of the group routine in use ("avx512", "avx2", "scalar").
+ *
+ * @return routine name
+ */
+const char* zipcrypto_name(void);
+
+/**
+ * Updates the keys with a plain text byte.
+ */
+static inline void zc_update(zc_keys *k, unsigned char c)
+{
+	k->k0 = (k->k0 >> 8) ^ zc_crc_table[(k->k0 ^ c) & 0xff];
+	k->k1 = (k->k1 + (k->k0 & 0xff)) * 134775813 + 1;
+	k->k2 = (k->k2 >> 8) ^ zc_crc_table[(k->k2 ^ (k->k1 >> 24)) & 0xff];
+}
+
+/**
+ * Decrypts a byte, updating the keys.
+ */
+static inline unsigned char zc_decrypt(zc_keys *k, unsigned char c)
+{
+	uint32_t t = (k->k2 | 2) & 0xffff;
+
+	c ^= (t * (t ^ 1)) >> 8;
+	zc_update(k, c);
+	return c;
+}
+
+/**
+ * Initializes the keys with the password.
+ *
+ * @param k  pointer to keys
+ * @param pw  password chars (not NUL-terminated)
+ * @param len  password length
+ */
+static inline void zc_init_keys(zc_keys *k, const char *pw, size_t len)
+{
+	k->k0 = ZC_KEY0;
+	k->k1 = ZC_KEY1;
+	k->k2 = ZC_KEY2;
+	for (size_t i = 0; i < len; i++)
+		zc_update(k, pw[i]);
+}
+
+/**
+ * Decrypts the encryption header of the entry and compares its last byte.
+ *
+ * @param k  keys initialized with the password (left unchanged)
+ * @param e  pointer to entry
+ *
+ * @return 1 if the password may be right, 0 if wrong
+ */
+static inline int zc_check_header(const zc_keys *k, const zip_entry *e)
+{
+	zc_keys t = *k;
+	unsigned char c = 0;
+
+	for (int i = 0; i < ZIP_HEADER_SIZE; i++)
+		c = zc_decrypt(&t, e->header[i]);
+	return c == e->check;
+}
+
+/**
+ * Decrypts and decompresses the whole entry, comparing its size and CRC-32.
+ *
+ * @param k  keys initialized with the password
+ * @param e  pointer to entry
+ *
+ * @return 1 if the password is right, 0 if wrong
+ */
+int zc_verify(const zc_keys *k, const zip_entry *e);
+
+/**
+ * Tests a password on the archive: header checks on up to
+ * ZC_MAX_CHECKS entries, then full verification of the cheapest one.
+ *
+ * @param za  pointer to archive (with encrypted entries)
+ * @param pw  password chars (not NUL-terminated)
+ * @param len  password length
+ *
+ * @return 1 if the password is right, 0 if wrong
+ */
+int zc_test(const zip_archive *za, const char *pw, size_t len);
+
+/**
+ * Tests a group of candidates on the archive, like zc_test. Each lane runs up
+ * to the longest candidate of its group, so candidates of similar lengths
+ * should be adjacent.
+ *
+ * @param za  pointer to archive (with encrypted entries)
+ * @param c  array of candidates
+ * @param n  number of candidates
+ *
+ * @return index of the right password, or n if none is
+ */
+size_t zc_test_many(const zip_archive *za, const zc_cand *c, size_t n);
+
+/**
+ * Tests a group of candidates on the archive, like zc_test_many, reusing the
+ * keys of the prefix each candidate shares with the previous one (up to
+ * ZC_PREFIX_LEN bytes). Any order is valid, the lengths need not be grouped.
+ *
+ * @param za  pointer to archive (with encrypted entries)
+ * @param c  array of candidates
+ * @param n  number of candidates
+ *
+ * @return index of the right password, or n if none is
+ */
+size_t zc_test_prefixed(const zip_archive *za, const zc_cand *c, size_t n);
+
+/**
+ * Starts a sequence of candidates for zc_prefix_keys, with no previous one.
+ *
+ * @param p  pointer to prefix state
+ */
+void zc_prefix_init(zc_prefix *p);
+
+/**
+ * Initializes the keys of a group of candidates with their passwords, reusing
+ * the keys of the prefix each one shares with the previous (the last one of
+ * the previous call included).
+ *
+ * @param p  pointer to prefix state
+ * @param c  array of candidates
+ * @param n  number of candidates (at most ZC_KEYS_GROUP)
+ * @param k  pointer to keys filled
+ */
+void zc_prefix_keys(zc_prefix *p, const zc_cand *c, size_t n, zc_key_rows *k);
+
+/**
+ * Tests keys initialized with the passwords of a group of candidates
+ * on the archive, like zc_test_many.
+ *
+ * @param za  pointer to archive (with encrypted entries)
+ * @param k  pointer to keys (see zc_prefix_keys)
+ * @param n  number of candidates
+ *
+ * @return index of the right password, or n if none is
+ */
+size_t zc_test_keys(const zip_archive *za, const zc_key_rows *k, size_t n);
+
+#endif
@@ -0,0 +1,347 @@
+/**
+ * @file zipfile.c
+ * @brief Reader for the entries of ZipCrypto encrypted ZIP archives
+ *
+ * @author Victor C. Leal
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "zipfile.h"
+
+/** Record signatures */
+#define SIG_LOCAL 0x04034b50
+#define SIG_CENTRAL 0x02014b50
+#define SIG_END 0x06054b50
+#define SIG_END64 0x06064b50
+#define SIG_LOCATOR64 0x07064b50
+
+/** Record sizes (without variable fields) */
+#define LOCAL_SIZE 30
+#define CENTRAL_SIZE 46
+#define END_SIZE 22
+#define END64_SIZE 56
+#define LOCATOR64_SIZE 20
+
+/** General purpose flags */
+#define FLAG_ENCRYPTED 0x0001
+#define FLAG_DESCRIPTOR 0x0008
+#define FLAG_STRONG 0x0040
+
+/** Extra field with the ZIP64 sizes and offset */
+#define EXTRA_ZIP64 0x0001
+
+static inline uint16_t get16(const unsigned char *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static inline uint32_t get32(const unsigned char *p)
+{
+	return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+static inline uint64_t get64(const unsigned char *p)
+{
+	return get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+/**
+ * Finds the end of central directory record, searching back from
+ * the end of the archive (it is followed by a comment up to 64 KB).
+ *
+ * @return pointer to the record, or NULL if not found
+ */
+static const unsigned char* find_end(const zip_archive *za);
+
+/**
+ * Reads the central directory position from the ZIP64 end record,
+ * for archives where the 32 bit fields are saturated.
+ *
+ * @return 0 on success, -1 if the ZIP64 records are missing or invalid
+ */
+static int read_end64(const zip_archive *za, const unsigned char *end,
+                      uint64_t *count, uint64_t *offset, uint64_t *size);
+
+/**
+ * Replaces the saturated sizes and offset of a central directory
+ * entry with the ones in its ZIP64 extra field.
+ */
+static void read_extra64(const unsigned char *extra, size_t len,
+                         uint64_t *usize, uint64_t *csize, uint64_t *offset);
+
+/**
+ * Finds the data of an entry after its local header, which has its own
+ * variable fields.
+ *
+ * @return 0 on success, -1 if the archive is invalid
+ */
+static int entry_data(const zip_archive *za, uint64_t offset, uint64_t csize, uint64_t *data);
+
+/**
+ * Fills an entry from its central directory record and local header.
+ *
+ * @return 1 if it is a supported encrypted entry, 0 if it is not encrypted,
+ *         -1 if it is encrypted but not supported, -2 if the archive is invalid
+ */
+static int read_entry(const zip_archive *za, const unsigned char *cd, size_t avail,
+                      size_t *rec_len, zip_entry *e);
+
+/**
+ * Bytes decrypted to reject a wrong password passing the header checks:
+ * a deflated entry is almost always rejected within its first
+ * ZIP_PROBE_SIZE bytes, a stored one is decrypted up to its CRC.
+ */
+static uint64_t verify_cost(const zip_entry *e);
+
+/**
+ * Orders entries by verification cost, then data size, so the cheapest
+ * one is fully verified (empty entries last, as any password decrypts them).
+ */
+static int cmp_entry(const void *a, const void *b);
+
+static const unsigned char* find_end(const zip_archive *za)
+{
+	const unsigned char *p, *low;
+
+	if (za->size < END_SIZE)
+		return NULL;
+	low = za->size > END_SIZE + 0xffff ? za->map + za->size - END_SIZE - 0xffff : za->map;
+	for (p = za->map + za->size - END_SIZE; p >= low; p--) {
+		if (get32(p) == SIG_END && p + END_SIZE + get16(p + 20) <= za->map + za->size)
+			return p;
+	}
+	return NULL;
+}
+
+static int read_end64(const zip_archive *za, const unsigned char *end,
+                      uint64_t *count, uint64_t *offset, uint64_t *size)
+{
+	const unsigned char *loc = end - LOCATOR64_SIZE, *e64;
+	uint64_t pos;
+
+	if (end - za->map < LOCATOR64_SIZE || get32(loc) != SIG_LOCATOR64)
+		return -1;
+	pos = get64(loc + 8);
+	if (za->size < END64_SIZE || pos > za->size - END64_SIZE)
+		return -1;
+	e64 = za->map + pos;
+	if (get32(e64) != SIG_END64)
+		return -1;
+	*count = get64(e64 + 32);
+	*size = get64(e64 + 40);
+	*offset = get64(e64 + 48);
+	return 0;
+}
+
+static void read_extra64(const unsigned char *extra, size_t len,
+                         uint64_t *usize, uint64_t *csize, uint64_t *offset)
+{
+	const unsigned char *p, *end = extra + len;
+	size_t id, n;
+
+	while (end - extra >= 4) {
+		id = get16(extra);
+		n = get16(extra + 2);
+		p = extra + 4;
+		if (n > (size_t)(end - p))
+			return;
+		if (id == EXTRA_ZIP64) {
+			/* only the saturated fields are present, in this order */
+			if (*usize == 0xffffffff && n >= 8) {
+				*usize = get64(p);
+				p += 8, n -= 8;
+			}
+			if (*csize == 0xffffffff && n >= 8) {
+				*csize = get64(p);
+				p += 8, n -= 8;
+			}
+			if (*offset == 0xffffffff && n >= 8)
+				*offset = get64(p);
+			return;
+		}
+		extra = p + n;
+	}
+}
+
+static int entry_data(const zip_archive *za, uint64_t offset, uint64_t csize, uint64_t *data)
+{
+	const unsigned char *local;
+
+	if (za->size < LOCAL_SIZE || offset > za->size - LOCAL_SIZE || get32(za->map + offset) != SIG_LOCAL)
+		return -1;
+	local = za->map + offset;
+	*data = offset + LOCAL_SIZE + get16(local + 26) + get16(local + 28);
+	if (*data > za->size || csize > za->size - *data)
+		return -1;
+	return 0;
+}
+
+static int read_entry(const zip_archive *za, const unsigned char *cd, size_t avail,
+                      size_t *rec_len, zip_entry *e)
+{
+	size_t name_len, extra_len;
+	uint64_t usize, csize, offset, data;
+
+	if (avail < CENTRAL_SIZE || get32(cd) != SIG_CENTRAL)
+		return -2;
+	name_len = get16(cd + 28);
+	extra_len = get16(cd + 30);
+	*rec_len = CENTRAL_SIZE + name_len + extra_len + get16(cd + 32);
+	if (*rec_len > avail)
+		return -2;
+	e->flags = get16(cd + 8);
+	if (!(e->flags & FLAG_ENCRYPTED))
+		return 0;
+	e->method = get16(cd + 10);
+	e->crc = get32(cd + 16);
+	csize = get32(cd + 20);
+	usize = get32(cd + 24);
+	offset = get32(cd + 42);
+	read_extra64(cd + CENTRAL_SIZE + name_len, extra_len, &usize, &csize, &offset);
+	/* AES (method 99) and strong encryption use other headers */
+	if ((e->flags & FLAG_STRONG) || (e->method != ZIP_STORED && e->method != ZIP_DEFLATED))
+		return -1;
+	/* encrypted data starts after the local header */
+	if (entry_data(za, offset, csize, &data) < 0 || csize < ZIP_HEADER_SIZE)
+		return -2;
+	memcpy(e->header, za->map + data, ZIP_HEADER_SIZE);
+	/* with a data descriptor the CRC is not known when encrypting, the time is used */
+	e->check = (e->flags & FLAG_DESCRIPTOR) ? cd[13] : e->crc >> 24;
+	e->data = za->map + data + ZIP_HEADER_SIZE;
+	e->csize = csize - ZIP_HEADER_SIZE;
+	e->usize = usize;
+	if (!(e->name = strndup((const char *)cd + CENTRAL_SIZE, name_len))) {
+		perror("can't allocate zip entry");
+		exit(1);
+	}
+	return 1;
+}
+
+static uint64_t verify_cost(const zip_entry *e)
+{
+	if (e->method == ZIP_DEFLATED && e->csize > ZIP_PROBE_SIZE)
+		return ZIP_PROBE_SIZE;
+	return e->csize;
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+	const zip_entry *x = a, *y = b;
+	uint64_t cx = verify_cost(x), cy = verify_cost(y);
+
+	if ((x->usize == 0) != (y->usize == 0))
+		return x->usize == 0 ? 1 : -1;
+	if (cx != cy)
+		return (cx > cy) - (cx < cy);
+	return (x->csize > y->csize) - (x->csize < y->csize);
+}
+
+zip_archive* zip_open(const char *path)
+{
+	zip_archive *za = calloc(1, sizeof(zip_archive));
+	const unsigned char *end, *cd;
+	uint64_t count, offset, size;
+	size_t rec_len;
+	struct stat st;
+	int fd, r;
+
+	if (!za) {
+		perror("can't allocate zip archive");
+		exit(1);
+	}
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &st) < 0) {
+		perror("can't open zip file");
+		if (fd >= 0)
+			close(fd);
+		free(za);
+		return NULL;
+	}
+	za->size = st.st_size;
+	za->map = za->size ? mmap(NULL, za->size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (za->map == MAP_FAILED) {
+		za->map = NULL;
+		goto invalid;
+	}
+	if (!(end = find_end(za)))
+		goto invalid;
+	count = get16(end + 10);
+	size = get32(end + 12);
+	offset = get32(end + 16);
+	if ((count == 0xffff || size == 0xffffffff || offset == 0xffffffff) &&
+	    read_end64(za, end, &count, &offset, &size) < 0)
+		goto invalid;
+	if (offset > za->size || size > za->size - offset)
+		goto invalid;
+	if (count > size / CENTRAL_SIZE)
+		goto invalid;
+	za->entries = calloc(count ? count : 1, sizeof(zip_entry));
+	if (!za->entries) {
+		perror("can't allocate zip entries");
+		exit(1);
+	}
+	cd = za->cd = za->map + offset;
+	za->cd_count = count;
+	za->cd_size = size;
+	for (uint64_t i = 0; i < count; i++, cd += rec_len, size -= rec_len) {
+		r = read_entry(za, cd, size, &rec_len, &za->entries[za->n]);
+		if (r == -2)
+			goto invalid;
+		if (r == -1)
+			za->skipped++;
+		else if (r == 1)
+			za->n++;
+	}
+	qsort(za->entries, za->n, sizeof(zip_entry), cmp_entry);
+	return za;
+
+invalid:
+	fprintf(stderr, "%s is not a valid zip file\n", path);
+	zip_close(za);
+	return NULL;
+}
+
+int zip_find(const zip_archive *za, const char *name, zip_entry *e)
+{
+	const unsigned char *cd = za->cd;
+	size_t len = strlen(name), name_len, extra_len, rec_len;
+	uint64_t size = za->cd_size, offset, data;
+
+	/* the central directory was checked by zip_open */
+	for (uint64_t i = 0; i < za->cd_count; i++, cd += rec_len, size -= rec_len) {
+		name_len = get16(cd + 28);
+		extra_len = get16(cd + 30);
+		rec_len = CENTRAL_SIZE + name_len + extra_len + get16(cd + 32);
+		if (name_len != len || memcmp(cd + CENTRAL_SIZE, name, len) != 0)
+			continue;
+		e->flags = get16(cd + 8);
+		e->method = get16(cd + 10);
+		e->crc = get32(cd + 16);
+		e->csize = get32(cd + 20);
+		e->usize = get32(cd + 24);
+		offset = get32(cd + 42);
+		read_extra64(cd + CENTRAL_SIZE + name_len, extra_len, &e->usize, &e->csize, &offset);
+		if (entry_data(za, offset, e->csize, &data) < 0)
+			return -1;
+		e->data = za->map + data;
+		return 0;
+	}
+	return -1;
+}
+
+void zip_close(zip_archive *za)
+{
+	for (size_t i = 0; i < za->n; i++)
+		free(za->entries[i].name);
+	free(za->entries);
+	if (za->map)
+		munmap(za->map, za->size);
+	free(za);
+}
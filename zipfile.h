@@ -0,0 +1,91 @@
+/**
+ * @file zipfile.h
+ * @brief Reader for the entries of ZipCrypto encrypted ZIP archives
+ *
+ * The archive is memory mapped and its central directory parsed once (ZIP64 sizes
+ * and offsets included), keeping for each entry encrypted with the traditional
+ * PKWARE encryption (ZipCrypto) the 12 byte encryption header, the check byte the
+ * last decrypted header byte must match, and a pointer to the compressed data, so
+ * passwords are tested without touching the file again. Entries encrypted with
+ * AES or the PKWARE strong encryption are not supported and left out.
+ *
+ * @author Victor C. Leal
+ */
+
+#ifndef ZIPFILE_H
+#define ZIPFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Size of the ZipCrypto encryption header */
+#define ZIP_HEADER_SIZE 12
+
+/** Bytes of a deflated entry inflated first when verifying a password, garbage
+    from a wrong one is almost always an invalid deflate stream by then */
+#define ZIP_PROBE_SIZE 1024
+
+/** Compression methods supported */
+#define ZIP_STORED 0
+#define ZIP_DEFLATED 8
+
+/**
+ * @brief Struct for an encrypted entry of the archive.
+ */
+typedef struct _zip_entry {
+	char *name;
+	unsigned char header[ZIP_HEADER_SIZE];	/* encryption header */
+	unsigned char check;	/* expected last byte of the decrypted header */
+	uint16_t flags;
+	uint16_t method;
+	uint32_t crc;
+	const unsigned char *data;	/* encrypted data, after the header */
+	uint64_t csize;	/* size of data */
+	uint64_t usize;	/* uncompressed size */
+} zip_entry;
+
+/**
+ * @brief Struct for a memory mapped archive.
+ */
+typedef struct _zip_archive {
+	unsigned char *map;
+	size_t size;
+	zip_entry *entries;	/* encrypted entries, cheapest to verify first (empty ones last) */
+	size_t n;
+	size_t skipped;	/* encrypted entries with unsupported encryption or method */
+	const unsigned char *cd;	/* central directory, for zip_find */
+	uint64_t cd_count;
+	uint64_t cd_size;
+} zip_archive;
+
+/**
+ * Maps the archive and reads its encrypted entries.
+ * Prints the reason to stderr on error.
+ *
+ * @param path  string with archive file name
+ *
+ * @return pointer to archive, or NULL if it can't be read or is not a ZIP file
+ */
+zip_archive* zip_open(const char *path);
+
+/**
+ * Finds an entry by name, encrypted or not, to be read in place (e.g. the text
+ * of a document in a ZIP container).
+ *
+ * @param za  pointer to archive
+ * @param name  string with entry name
+ * @param e  pointer to entry filled (name and encryption header left unset,
+ *           data pointing in the mapping, including any encryption header)
+ *
+ * @return 0 if found, -1 if there is no such entry or it is invalid
+ */
+int zip_find(const zip_archive *za, const char *name, zip_entry *e);
+
+/**
+ * Unmaps the archive and deallocates it.
+ *
+ * @param za  pointer to archive
+ */
+void zip_close(zip_archive *za);
+
+#endif